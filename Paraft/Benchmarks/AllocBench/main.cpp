@@ -0,0 +1,94 @@
+// Counts heap allocations and allocated bytes of extracting and tracking
+// features, per time step, with serial and with slab-parallel extraction.
+//
+//   AllocBench [-blobs count] [-steps count] [-threads count]
+//
+// The default volume is 96x100x90 with 600 small blobs, where copying
+// feature bodies around used to dominate. Every operator new of the process
+// is counted, including those of worker threads.
+
+#include "../SyntheticData.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using namespace std;
+
+static std::atomic<unsigned long> numAllocations(0), numBytes(0);
+
+void* operator new(size_t bytes) {
+    numAllocations++;
+    numBytes += bytes;
+    void *p = malloc(bytes ? bytes : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t bytes) {
+    return operator new(bytes);
+}
+
+void operator delete(void *p) noexcept           { free(p); }
+void operator delete[](void *p) noexcept         { free(p); }
+void operator delete(void *p, size_t) noexcept   { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+static void usage() {
+    cout << "usage: AllocBench [-blobs count] [-steps count] [-threads count]" << endl;
+    exit(EXIT_FAILURE);
+}
+
+static void countAllocations(const SyntheticData &data, int numSteps, int numThreads) {
+    vector<vector<float> > volumes(numSteps);
+    for (int t = 0; t < numSteps; ++t) {
+        data.Step(t, volumes[t]);
+    }
+
+    FeatureTracker tracker(data.Dim());
+    tracker.SetTF(SyntheticData::RampTF());
+    tracker.SetNumThreads(numThreads);
+
+    printf("%s extraction\n%4s %12s %12s %9s\n", numThreads > 1 ? "parallel" : "serial",
+           "step", "allocations", "MB", "features");
+    unsigned long totalAllocations = 0, totalBytes = 0;
+    for (int t = 0; t < numSteps; ++t) {
+        vector<VolumeView> views(1, SyntheticData::View(volumes[t]));
+
+        unsigned long allocations = numAllocations, bytes = numBytes;
+        if (t == 0) {
+            tracker.SetVolume(views);
+            tracker.ExtractAllFeatures();
+        } else {
+            tracker.TrackFeature(views, FT_FORWARD, FT_DIRECT);
+        }
+        tracker.SaveExtractedFeatures(t);
+        allocations = numAllocations - allocations;
+        bytes = numBytes - bytes;
+        totalAllocations += allocations;
+        totalBytes += bytes;
+
+        printf("%4d %12lu %12.1f %9d\n", t, allocations, bytes / 1048576.0,
+               (int)tracker.GetFeatureVectorPointer(t)->size());
+    }
+    printf("%4s %12lu %12.1f\n\n", "all", totalAllocations, totalBytes / 1048576.0);
+}
+
+int main(int argc, char **argv) {
+    int numBlobs = 600, numSteps = 8, numThreads = 4;
+    for (int arg = 1; arg < argc; ++arg) {
+        if (arg+1 == argc) usage();
+        if (strcmp(argv[arg], "-blobs") == 0)        numBlobs = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-steps") == 0)   numSteps = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-threads") == 0) numThreads = atoi(argv[++arg]);
+        else usage();
+    }
+    if (numBlobs < 1 || numSteps < 1 || numThreads < 2) usage();
+
+    SyntheticData data(vector3i(96, 100, 90), numBlobs, 3.0f, 6.0f);
+    countAllocations(data, numSteps, 1);
+    countAllocations(data, numSteps, numThreads);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,134 @@
+// Compares the RangeKernels min/max, clamp and normalize passes with the
+// scalar loops they replaced in DataManager and CStructuredMeshData.
+//
+//   KernelBench [-n size] [-repeat count] [-threads count]
+//
+// Volumes are size^3 floats of a synthetic step. Each pass runs repeat times
+// on a fresh copy and the fastest run is reported. Add -mavx to
+// QMAKE_CXXFLAGS to time the AVX path instead of SSE.
+
+#include "../SyntheticData.h"
+#include "RangeKernels.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+typedef std::chrono::steady_clock Clock;
+
+static void usage() {
+    cout << "usage: KernelBench [-n size] [-repeat count] [-threads count]" << endl;
+    exit(EXIT_FAILURE);
+}
+
+// Fastest of repeat runs of pass over a fresh copy of source, in ms
+template <class Pass>
+static double fastest(const vector<float> &source, vector<float> &work, int repeat, Pass pass) {
+    double best = 1e30;
+    for (int r = 0; r < repeat; ++r) {
+        work = source;
+        Clock::time_point begin = Clock::now();
+        pass(work.data(), work.size());
+        best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - begin).count());
+    }
+    return best;
+}
+
+// The loops as they were before RangeKernels
+static void scalarMinMax(const float *pData, size_t count, float &min, float &max) {
+    min = pData[0], max = pData[0];
+    for (size_t i = 1; i < count; ++i) {
+        min = std::min(min, pData[i]);
+        max = std::max(max, pData[i]);
+    }
+}
+
+static void scalarClamp(float *data, size_t count, float lo, float hi) {
+    for (size_t x = 0; x < count; ++x) {
+        if (data[x] > hi) data[x] = hi;
+    }
+    for (size_t x = 0; x < count; ++x) {
+        if (data[x] < lo) data[x] = lo;
+    }
+}
+
+static void scalarNormalize(float *data, size_t count, float min, float max) {
+    double range = max - min;
+    for (size_t s = 0; s < count; s++) {
+        data[s] = (data[s] - min) / range;
+    }
+}
+
+static float maxDifference(const vector<float> &a, const vector<float> &b) {
+    float diff = 0.0f;
+    for (size_t i = 0; i < a.size(); ++i) {
+        diff = std::max(diff, std::fabs(a[i] - b[i]));
+    }
+    return diff;
+}
+
+static void report(const char *pass, double scalarMs, double kernelMs, double threadedMs, float diff) {
+    printf("%-10s %10.2f %10.2f %10.2f %8.2fx %12g\n", pass, scalarMs, kernelMs, threadedMs,
+           scalarMs / threadedMs, diff);
+}
+
+int main(int argc, char **argv) {
+    int size = 256, repeat = 5, numThreads = 4;
+    for (int arg = 1; arg < argc; ++arg) {
+        if (arg+1 == argc) usage();
+        if (strcmp(argv[arg], "-n") == 0)            size = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-repeat") == 0)  repeat = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-threads") == 0) numThreads = atoi(argv[++arg]);
+        else usage();
+    }
+    if (size < 8 || repeat < 1 || numThreads < 1) usage();
+
+    vector<float> source, work, expected;
+    SyntheticData(vector3i(size, size, size), 64, size / 16.0f, size / 8.0f).Step(0, source);
+    const size_t count = source.size();
+
+    float lo, hi;
+    scalarMinMax(source.data(), count, lo, hi);
+    const float clampLo = lo + 0.25f * (hi - lo), clampHi = hi - 0.25f * (hi - lo);
+
+#if defined(__AVX__)
+    const char *path = "AVX";
+#elif defined(__SSE__) || defined(_M_X64)
+    const char *path = "SSE";
+#else
+    const char *path = "scalar";
+#endif
+    printf("%d^3 floats, best of %d, %s kernels, %d thread(s)\n", size, repeat, path, numThreads);
+    printf("%-10s %10s %10s %10s %9s %12s\n", "pass", "scalar ms", "kernel ms", "threads ms", "speedup", "max diff");
+
+    float kernelLo, kernelHi;
+    double scalarMs = fastest(source, work, repeat, [&](float *d, size_t n) { scalarMinMax(d, n, lo, hi); });
+    double kernelMs = fastest(source, work, repeat, [&](float *d, size_t n) {
+        kernelLo = d[0], kernelHi = d[0];
+        RangeKernels::MinMax(d, n, kernelLo, kernelHi);
+    });
+    double threadedMs = fastest(source, work, repeat, [&](float *d, size_t n) {
+        kernelLo = d[0], kernelHi = d[0];
+        RangeKernels::MinMax(d, n, kernelLo, kernelHi, numThreads);
+    });
+    report("minmax", scalarMs, kernelMs, threadedMs, std::max(std::fabs(kernelLo - lo), std::fabs(kernelHi - hi)));
+
+    scalarMs = fastest(source, expected, repeat, [&](float *d, size_t n) { scalarClamp(d, n, clampLo, clampHi); });
+    kernelMs = fastest(source, work, repeat, [&](float *d, size_t n) { RangeKernels::Clamp(d, n, clampLo, clampHi); });
+    threadedMs = fastest(source, work, repeat, [&](float *d, size_t n) {
+        RangeKernels::Clamp(d, n, clampLo, clampHi, numThreads);
+    });
+    report("clamp", scalarMs, kernelMs, threadedMs, maxDifference(expected, work));
+
+    scalarMs = fastest(source, expected, repeat, [&](float *d, size_t n) { scalarNormalize(d, n, lo, hi); });
+    kernelMs = fastest(source, work, repeat, [&](float *d, size_t n) { RangeKernels::Normalize(d, n, lo, hi); });
+    threadedMs = fastest(source, work, repeat, [&](float *d, size_t n) {
+        RangeKernels::Normalize(d, n, lo, hi, numThreads);
+    });
+    report("normalize", scalarMs, kernelMs, threadedMs, maxDifference(expected, work));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+// Synthetic time steps for the benchmarks: spherical blobs of opacity 1 at
+// the center falling off to 0 at their radius, drifting in x and y by up to
+// a voxel per step, over a little noise. The same seed always gives the same
+// volumes, so runs of different builds can be compared.
+
+#ifndef SYNTHETICDATA_H
+#define SYNTHETICDATA_H
+
+#include "FeatureTracker.h"
+
+#include <random>
+
+class SyntheticData {
+public:
+    SyntheticData(const vector3i &dim, int numBlobs, float minRadius, float maxRadius, unsigned seed = 5)
+        : dim_(dim), seed_(seed) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> u(0.0f, 1.0f);
+        for (int i = 0; i < numBlobs; ++i) {
+            Blob b;
+            b.cx = u(rng) * dim.x;
+            b.cy = u(rng) * dim.y;
+            b.cz = u(rng) * dim.z;
+            b.r  = minRadius + (maxRadius - minRadius) * u(rng);
+            b.vx = 2*u(rng) - 1;
+            b.vy = 2*u(rng) - 1;
+            blobs_.push_back(b);
+        }
+    }
+
+    const vector3i& Dim() const { return dim_; }
+
+    // Values of time step t, x fastest
+    void Step(int t, vector<float> &data) const {
+        data.assign((size_t)dim_.x * dim_.y * dim_.z, 0.0f);
+        for (size_t i = 0; i < blobs_.size(); ++i) {
+            const Blob &b = blobs_[i];
+            float cx = b.cx + b.vx*t, cy = b.cy + b.vy*t;
+            int r = (int)ceil(b.r);
+            for (int z = std::max(0, (int)(b.cz - r)); z <= std::min(dim_.z-1, (int)(b.cz + r)); ++z) {
+                for (int y = std::max(0, (int)(cy - r)); y <= std::min(dim_.y-1, (int)(cy + r)); ++y) {
+                    for (int x = std::max(0, (int)(cx - r)); x <= std::min(dim_.x-1, (int)(cx + r)); ++x) {
+                        float d = sqrtf((x-cx)*(x-cx) + (y-cy)*(y-cy) + (z-b.cz)*(z-b.cz));
+                        float &v = data[((size_t)z*dim_.y + y)*dim_.x + x];
+                        v = std::max(v, 1.0f - d / b.r);
+                    }
+                }
+            }
+        }
+        std::mt19937 rng(seed_ + 1 + t);
+        std::uniform_real_distribution<float> noise(0.0f, 0.1f);
+        for (size_t i = 0; i < data.size(); ++i) {
+            data[i] += noise(rng);
+        }
+    }
+
+    // data normalized to [0, 1] as DataManager does it, by its range
+    static VolumeView View(const vector<float> &data) {
+        float lo = *std::min_element(data.begin(), data.end());
+        float hi = *std::max_element(data.begin(), data.end());
+        return VolumeView(data.data(), QuantizedVolume::FLOAT32, lo, hi > lo ? 1.0f / (hi - lo) : 0.0f);
+    }
+
+    // Opacity equal to the value, at the default TF resolution
+    static shared_ptr<const TransferFunction> RampTF() {
+        shared_ptr<TransferFunction> tf = make_shared<TransferFunction>();
+        tf->map.resize(DEFAULT_TF_RES);
+        for (int i = 0; i < DEFAULT_TF_RES; ++i) {
+            tf->map[i] = i / (float)(DEFAULT_TF_RES - 1);
+        }
+        tf->hash = 0;
+        return tf;
+    }
+
+private:
+    struct Blob {
+        float cx, cy, cz, r, vx, vy;
+    };
+
+    vector3i     dim_;
+    unsigned     seed_;
+    vector<Blob> blobs_;
+};
+
+#endif // SYNTHETICDATA_H
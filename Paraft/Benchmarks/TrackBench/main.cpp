@@ -0,0 +1,121 @@
+// Time per time step of extracting and tracking features, and of the body
+// voxel removal shrinking does, on synthetic blobs. A few large features are
+// where per-voxel containers hurt most, hence the defaults.
+//
+//   TrackBench [-n size] [-blobs count] [-steps count] [-threads count]
+//
+// The removal part compares a std::list searched with std::find for every
+// removed voxel, as the tracker kept feature bodies before, with VoxelSet.
+
+#include "../SyntheticData.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+
+using namespace std;
+
+typedef std::chrono::steady_clock Clock;
+
+static double millisecondsSince(Clock::time_point begin) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+}
+
+static void usage() {
+    cout << "usage: TrackBench [-n size] [-blobs count] [-steps count] [-threads count]" << endl;
+    exit(EXIT_FAILURE);
+}
+
+static void benchTracking(const SyntheticData &data, int numSteps, int numThreads) {
+    FeatureTracker tracker(data.Dim());
+    tracker.SetTF(SyntheticData::RampTF());
+    tracker.SetNumThreads(numThreads);
+
+    printf("%4s %10s %9s %12s\n", "step", "ms", "features", "voxels");
+    double total = 0.0;
+    vector<float> volume;
+    for (int t = 0; t < numSteps; ++t) {
+        data.Step(t, volume);
+        vector<VolumeView> views(1, SyntheticData::View(volume));
+
+        Clock::time_point begin = Clock::now();
+        if (t == 0) {
+            tracker.SetVolume(views);
+            tracker.ExtractAllFeatures();
+        } else {
+            tracker.TrackFeature(views, FT_FORWARD, FT_DIRECT);
+        }
+        tracker.SaveExtractedFeatures(t);
+        double ms = millisecondsSince(begin);
+        if (t > 0) total += ms;
+
+        const vector<Feature> &features = *tracker.GetFeatureVectorPointer(t);
+        size_t voxels = 0;
+        for (size_t i = 0; i < features.size(); ++i) {
+            voxels += features[i].bodyVoxels.size();
+        }
+        printf("%4d %10.2f %9d %12lu\n", t, ms, (int)features.size(), (unsigned long)voxels);
+    }
+    if (numSteps > 1) printf("tracked steps: %.2f ms on average\n", total / (numSteps - 1));
+}
+
+// Removes a tenth of a cube of side voxels from its body, in random order
+static void benchRemoval(int side) {
+    vector<vector3i> voxels;
+    for (int z = 0; z < side; ++z) {
+        for (int y = 0; y < side; ++y) {
+            for (int x = 0; x < side; ++x) {
+                voxels.push_back(vector3i(x, y, z));
+            }
+        }
+    }
+    vector<vector3i> removed(voxels);
+    std::mt19937 rng(1);
+    std::shuffle(removed.begin(), removed.end(), rng);
+    removed.resize(removed.size() / 10);
+
+    list<vector3i> bodyList(voxels.begin(), voxels.end());
+    Clock::time_point begin = Clock::now();
+    for (size_t i = 0; i < removed.size(); ++i) {
+        list<vector3i>::iterator it = std::find(bodyList.begin(), bodyList.end(), removed[i]);
+        if (it != bodyList.end()) bodyList.erase(it);
+    }
+    double listMs = millisecondsSince(begin);
+
+    VoxelSet bodySet;
+    for (size_t i = 0; i < voxels.size(); ++i) {
+        bodySet.insert(voxels[i]);
+    }
+    begin = Clock::now();
+    for (size_t i = 0; i < removed.size(); ++i) {
+        bodySet.erase(removed[i]);
+    }
+    double setMs = millisecondsSince(begin);
+
+    printf("%9lu %9lu %12.2f %12.3f\n", (unsigned long)voxels.size(), (unsigned long)removed.size(), listMs, setMs);
+}
+
+int main(int argc, char **argv) {
+    int size = 128, numBlobs = 2, numSteps = 8, numThreads = 1;
+    for (int arg = 1; arg < argc; ++arg) {
+        if (arg+1 == argc) usage();
+        if (strcmp(argv[arg], "-n") == 0)            size = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-blobs") == 0)   numBlobs = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-steps") == 0)   numSteps = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-threads") == 0) numThreads = atoi(argv[++arg]);
+        else usage();
+    }
+    if (size < 8 || numBlobs < 1 || numSteps < 1 || numThreads < 1) usage();
+
+    printf("tracking %d^3, %d blobs, %d thread(s)\n", size, numBlobs, numThreads);
+    SyntheticData data(vector3i(size, size, size), numBlobs, size / 8.0f, size / 6.0f);
+    benchTracking(data, numSteps, numThreads);
+
+    printf("\nbody voxel removal\n%9s %9s %12s %12s\n", "voxels", "removed", "list ms", "VoxelSet ms");
+    for (int side = 10; side <= 40; side += 10) {
+        benchRemoval(side);
+    }
+    return EXIT_SUCCESS;
+}
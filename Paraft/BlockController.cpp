@@ -1,27 +1,488 @@
 #include "BlockController.h"
 
-BlockController::BlockController() {}
+#include <cstdio>
+
+BlockController::BlockController() : pDataManager_(NULL), leader_(NULL), tracker_(NULL), trackedT_(INT_MIN), predictor_(FT_DIRECT),
+    forcedPredictor_(-1), predicateIndex_(0), numThreads_(1), historyBudget_(0), keepMasks_(false), lastWrittenT_(INT_MIN),
+    pPrepareQueue_(NULL), aheadT_(INT_MIN) {}
 BlockController::~BlockController() {
-    pDataManager_->~DataManager();
-    pFeatureTracker_->~FeatureTracker();
+    if (pPrepareQueue_ != NULL) {
+        pPrepareQueue_->Close();
+        preparer_.join();
+        delete pPrepareQueue_;
+    }
+    if (aheadT_ != INT_MIN) {
+        delete ahead_.get();
+    }
+    delete tracker_;
+    if (leader_ == NULL) {
+        delete pDataManager_;
+    }
+}
+
+void BlockController::SetCurrentTimestep(int t) {
+    currentT_ = t;
+    for (size_t f = 0; f < followers_.size(); ++f) {
+        followers_[f]->SetCurrentTimestep(t);
+    }
+}
+
+void BlockController::AddFollower(BlockController *follower) {
+    follower->leader_ = this;
+    followers_.push_back(follower);
+}
+
+vector<BlockController*> BlockController::group() {
+    vector<BlockController*> members(1, this);
+    members.insert(members.end(), followers_.begin(), followers_.end());
+    return members;
 }
 
 void BlockController::InitParameters(const Metadata &meta) {
+    if (predicateIndex_ < 0 || predicateIndex_ >= (int)meta.predicates().size()) {
+        cout << "no predicate " << predicateIndex_ << " in the config" << endl;
+        exit(EXIT_FAILURE);
+    }
+    predicate_ = meta.predicates()[predicateIndex_];
+    predictor_ = forcedPredictor_ >= 0 ? forcedPredictor_ : meta.predictor();
+
+    if (leader_ != NULL) {
+        pDataManager_ = leader_->pDataManager_;
+        initTracker(meta);
+        return;     // the leader sets up the trackers along with its own
+    }
+
     pDataManager_ = new DataManager();
+    if (!meta.profile().empty()) {
+        profileFormat_ = meta.profile();
+        profilePath_ = meta.path() + "/" + meta.prefix() + outputTag_ + ".profile." + profileFormat_;
+        pDataManager_->EnableProfile();
+    }
     pDataManager_->InitTF(meta);
     pDataManager_->LoadDataSequence(meta, currentT_);
 
-    pFeatureTracker_ = new FeatureTracker(pDataManager_->GetBlockDim());
-    pFeatureTracker_->SetTFRes(pDataManager_->GetTFRes());
-    pFeatureTracker_->SetTFMap(pDataManager_->GetTFMap());
-    pFeatureTracker_->SetDataPtr(pDataManager_->GetDataPtr(currentT_));
+    initTracker(meta);
+    for (size_t f = 0; f < followers_.size(); ++f) {
+        followers_[f]->InitParameters(meta);
+    }
+    initTrackers();
+}
+
+void BlockController::initTrackers() {
+    PreparedStep step;
+    prepareStep(currentT_, pDataManager_->GetVolumes(currentT_), *pDataManager_->GetTF(currentT_), groupPredicates(), step);
+    applyStep(step);
+
+    vector<BlockController*> members = group();
+    for (size_t c = 0; c < members.size(); ++c) {
+        members[c]->tracker_->SetTF(pDataManager_->GetTF(currentT_));
+        members[c]->tracker_->SetVolume(pDataManager_->GetVolumes(currentT_));
+    }
+}
+
+vector<FeaturePredicate> BlockController::groupPredicates() {
+    vector<BlockController*> members = group();
+    vector<FeaturePredicate> predicates;
+    for (size_t c = 0; c < members.size(); ++c) {
+        predicates.push_back(members[c]->predicate_);
+    }
+    return predicates;
 }
 
 void BlockController::TrackForward(const Metadata &meta) {
-    pDataManager_->LoadDataSequence(meta, currentT_);
-    pFeatureTracker_->SetTFMap(pDataManager_->GetTFMap());
-    pFeatureTracker_->ExtractAllFeatures();
-    pFeatureTracker_->TrackFeature(pDataManager_->GetDataPtr(currentT_), FT_FORWARD, FT_DIRECT);
-    pFeatureTracker_->SaveExtractedFeatures(currentT_);
-    pDataManager_->SaveMaskVolume(pFeatureTracker_->GetMaskPtr(), meta, currentT_);
+    track(meta, FT_FORWARD);
+}
+
+void BlockController::TrackBackward(const Metadata &meta) {
+    track(meta, FT_BACKWARD);
+}
+
+void BlockController::track(const Metadata &meta, int direction) {
+    // the classify stage has to be done with its step before any data is unloaded
+    auto waitBegin = std::chrono::steady_clock::now();
+    PreparedStep *pStep = takeStep(currentT_);
+    auto begin = std::chrono::steady_clock::now();
+
+    Profile *pProfile = pDataManager_->GetProfile();
+    if (pProfile != NULL) {
+        pProfile->Set(currentT_, PC_LOAD_QUEUE, pDataManager_->LoadQueueDepth());
+        pProfile->Set(currentT_, PC_WRITE_QUEUE, pDataManager_->WriteQueueDepth());
+    }
+
+    pDataManager_->LoadDataSequence(meta, currentT_, direction);
+
+    vector<BlockController*> members = group();
+    int fromT = direction == FT_BACKWARD ? currentT_+1 : currentT_-1;
+    vector<BlockController*> stale;     // holding another step, they resume from the checkpoint of fromT
+    for (size_t c = 0; c < members.size(); ++c) {
+        BlockController *member = members[c];
+        if (member->trackedT_ == fromT || member->trackedT_ == INT_MIN) continue;
+        if (member->findCheckpoint(meta, fromT)) {
+            stale.push_back(member);
+        } else {
+            cout << "no checkpoint @ " << fromT << ", tracking on from " << member->trackedT_ << endl;
+        }
+    }
+    for (size_t c = 0; c < stale.size(); ++c) {
+        stale[c]->restoreCheckpoint(fromT);
+    }
+
+    if (pStep == NULL) {    // not prepared ahead, e.g. the first step or after a jump
+        auto prepareBegin = std::chrono::steady_clock::now();
+        pStep = new PreparedStep;
+        prepareStep(currentT_, pDataManager_->GetVolumes(currentT_), *pDataManager_->GetTF(currentT_), groupPredicates(), *pStep);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - prepareBegin;
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        classifyStats_.items++;
+        classifyStats_.busySeconds += elapsed.count();
+    }
+    applyStep(*pStep);
+    delete pStep;
+
+    int nextT = direction == FT_BACKWARD ? currentT_-1 : currentT_+1;
+    if (nextT >= meta.start() && nextT < meta.end()) {
+        requestStep(nextT);
+    }
+
+    for (size_t c = 0; c < members.size(); ++c) {
+        members[c]->trackStep(meta, direction);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double> waited = begin - waitBegin, busy = end - begin;
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    trackStats_.items++;
+    trackStats_.waitSeconds += waited.count();
+    trackStats_.busySeconds += busy.count();
+}
+
+// Whether a and b classify voxels alike, minVoxels only matters later
+static bool sameVisibility(const FeaturePredicate &a, const FeaturePredicate &b) {
+    if (a.opacity != b.opacity || a.ranges.size() != b.ranges.size()) return false;
+    for (size_t i = 0; i < a.ranges.size(); ++i) {
+        if (a.ranges[i].lo != b.ranges[i].lo || a.ranges[i].hi != b.ranges[i].hi) return false;
+    }
+    return true;
+}
+
+void BlockController::prepareStep(int t, const vector<VolumeView> &volumes, const TransferFunction &tf,
+                                  const vector<FeaturePredicate> &predicates, PreparedStep &step) {
+    ScopedTimer timer(pDataManager_->GetProfile(), t, PT_CLASSIFY);
+    step.masks.assign(predicates.size(), VisibilityMask());
+
+    // members that only differ in predictor or minVoxels share one classification
+    vector<int> source(predicates.size());
+    vector<FeaturePredicate> distinct;
+    for (size_t p = 0; p < predicates.size(); ++p) {
+        source[p] = (int)p;
+        for (size_t q = 0; q < p; ++q) {
+            if (sameVisibility(predicates[p], predicates[q])) { source[p] = (int)q; break; }
+        }
+        if (source[p] == (int)p) distinct.push_back(predicates[p]);
+    }
+
+    vector<VisibilityMask*> masks;
+    for (size_t p = 0; p < predicates.size(); ++p) {
+        if (source[p] == (int)p) masks.push_back(&step.masks[p]);
+    }
+    VisibilityMask::ClassifyAll(masks, distinct, volumes, volumeDim_, tf.map, numThreads_);
+    for (size_t p = 0; p < predicates.size(); ++p) {
+        if (source[p] != (int)p) step.masks[p] = step.masks[source[p]];
+    }
+}
+
+void BlockController::applyStep(PreparedStep &step) {
+    vector<BlockController*> members = group();
+    for (size_t c = 0; c < members.size(); ++c) {
+        members[c]->tracker_->NextVisibility().Swap(step.masks[c]);
+    }
+}
+
+void BlockController::requestStep(int t) {
+    shared_future<vector<VolumeView> > volumes = pDataManager_->GetVolumesFuture(t);
+    if (!volumes.valid()) return;   // not queued for loading, it is prepared when tracked
+
+    if (pPrepareQueue_ == NULL) {
+        pPrepareQueue_ = new BoundedQueue<PrepareRequest*>(1);
+        preparer_ = std::thread(&BlockController::preparerLoop, this);
+    }
+    PrepareRequest *request = new PrepareRequest;
+    request->t = t;
+    request->volumes = volumes;
+    request->tf = pDataManager_->GetTF(t);
+    request->predicates = groupPredicates();
+    ahead_ = request->step.get_future();
+    aheadT_ = t;
+    pPrepareQueue_->Push(request);
+}
+
+BlockController::PreparedStep* BlockController::takeStep(int t) {
+    if (aheadT_ == INT_MIN) return NULL;
+    PreparedStep *pStep = ahead_.get();
+    if (aheadT_ != t) {     // the caller jumped elsewhere
+        delete pStep;
+        pStep = NULL;
+    }
+    aheadT_ = INT_MIN;
+    return pStep;
+}
+
+void BlockController::preparerLoop() {
+    PrepareRequest *request = NULL;
+    while (pPrepareQueue_->Pop(request)) {
+        auto begin = std::chrono::steady_clock::now();
+        const vector<VolumeView> &volumes = request->volumes.get();     // waits until read
+        auto ready = std::chrono::steady_clock::now();
+
+        PreparedStep *pStep = new PreparedStep;
+        prepareStep(request->t, volumes, *request->tf, request->predicates, *pStep);
+
+        std::chrono::duration<double> waited = ready - begin, busy = std::chrono::steady_clock::now() - ready;
+        {
+            std::lock_guard<std::mutex> lock(statsMutex_);
+            classifyStats_.items++;
+            classifyStats_.waitSeconds += waited.count();
+            classifyStats_.busySeconds += busy.count();
+        }
+        request->step.set_value(pStep);
+        delete request;
+    }
+}
+
+void BlockController::PrintIOSummary() {
+    pDataManager_->PrintIOSummary();
+    {
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        classifyStats_.Print("classify", "waited for data");
+        trackStats_.Print("track", "waited for classification");
+    }
+
+    Profile *pProfile = pDataManager_->GetProfile();
+    if (pProfile == NULL || leader_ != NULL) return;
+    bool written = profileFormat_ == "json" ? pProfile->WriteJSON(profilePath_) : pProfile->WriteCSV(profilePath_);
+    if (written) {
+        cout << "profile saved: " << profilePath_ << endl;
+    } else {
+        cerr << "cannot output to file: " << profilePath_ << endl;
+    }
+}
+
+void BlockController::trackStep(const Metadata &meta, int direction) {
+    auto stepBegin = std::chrono::steady_clock::now();
+    int fromT = direction == FT_BACKWARD ? currentT_+1 : currentT_-1;
+    Profile *pProfile = pDataManager_->GetProfile();
+
+    set<int> tracked;       // mask values of the features tracked from fromT
+    {
+        ScopedTimer timer(pProfile, currentT_, PT_EXTRACT);
+        tracker_->SetTF(pDataManager_->GetTF(currentT_));
+        tracker_->ExtractAllFeatures();
+        const vector<Feature> &from = tracker_->GetCurrentFeatures();
+        for (size_t i = 0; i < from.size(); ++i) {
+            tracked.insert(from[i].maskValue);
+        }
+        tracker_->TrackFeature(pDataManager_->GetVolumes(currentT_), direction, predictor_);
+        tracker_->SaveExtractedFeatures(currentT_);
+    }
+
+    vector<FeatureEdge> edges;
+    {
+        ScopedTimer timer(pProfile, currentT_, PT_CREATE);
+        if (direction == FT_BACKWARD) {
+            // the graph is oriented in time, the file in tracking order
+            backwardGraph_.Update(GetMask(), GetPrevMask(), fromT);
+            edges = backwardGraph_.Edges(fromT);
+            for (size_t i = 0; i < edges.size(); ++i) {
+                std::swap(edges[i].prevId, edges[i].id);
+            }
+        } else {
+            featureGraph_.Update(GetPrevMask(), GetMask(), currentT_);
+            edges = featureGraph_.Edges(currentT_);
+        }
+    }
+    pDataManager_->SaveFeatures(GetMask(), edges, meta, currentT_, outputTag_);
+
+    TrackerCounters counters = tracker_->TakeCounters();
+    if (pProfile != NULL) pProfile->Add(currentT_, counters);
+    int features = 0, found = 0, lost = 0;
+    countFeatures(tracked, features, found, lost);
+    if (pProfile != NULL) {
+        pProfile->Add(currentT_, PC_FEATURES, features);
+        pProfile->Add(currentT_, PC_FEATURES_FOUND, found);
+        pProfile->Add(currentT_, PC_FEATURES_LOST, lost);
+    }
+    if (meta.saveMask()) {
+        pDataManager_->SaveMaskVolume(GetMask(), meta, currentT_, outputTag_);
+    }
+
+    trackedT_ = currentT_;
+    saveCheckpoint(currentT_);
+    if (keepMasks_) trackedMasks_[currentT_] = GetMask();
+
+    stepsSinceWritten_.push_back(currentT_);
+    int interval = meta.checkpointInterval();
+    if (interval > 0 && direction == FT_FORWARD && (currentT_ - meta.start()) % interval == 0) {
+        writeCheckpoint(meta);
+    }
+    pruneCheckpoints();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - stepBegin;
+    summary_.steps++;
+    summary_.features += features;
+    summary_.maxFeatures = std::max(summary_.maxFeatures, features);
+    summary_.found += found;
+    summary_.lost += lost;
+    summary_.seconds += elapsed.count();
+}
+
+void BlockController::countFeatures(const set<int> &tracked, int &numFeatures, int &found, int &lost) {
+    // tracked features keep their mask values, any other one is new
+    const vector<Feature> &features = tracker_->GetCurrentFeatures();
+    numFeatures = (int)features.size();
+    found = 0;
+    for (size_t i = 0; i < features.size(); ++i) {
+        if (tracked.count(features[i].maskValue) == 0) found++;
+    }
+    lost = (int)tracked.size() - (numFeatures - found);
+}
+
+void BlockController::writeCheckpoint(const Metadata &meta) {
+    Checkpoint *pCheckpoint = new Checkpoint;
+    pCheckpoint->t = currentT_;
+    pCheckpoint->prevT = lastWrittenT_;
+    for (size_t s = 0; s < stepsSinceWritten_.size(); ++s) {
+        int t = stepsSinceWritten_[s];
+        const vector<Feature> *pFeatures = tracker_->GetFeatureVectorPointer(t);
+        if (pFeatures != NULL) pCheckpoint->history[t] = *pFeatures;
+    }
+    pDataManager_->GetFeatureOutputSize(outputTag_, pCheckpoint->featuresBytes, pCheckpoint->indexBytes);
+    checkpointWriter_.Submit(checkpointPath(meta), checkpoints_[currentT_], pCheckpoint);
+
+    lastWrittenT_ = currentT_;
+    stepsSinceWritten_.clear();
+}
+
+int BlockController::Resume(const Metadata &meta) {
+    int t = LatestCheckpoint(checkpointPath(meta));
+    if (t == INT_MIN) return INT_MIN;
+
+    SetCurrentTimestep(t);
+    InitParameters(meta);
+    vector<BlockController*> members = group();
+    for (size_t c = 0; c < members.size(); ++c) {
+        members[c]->resumeFrom(meta, t);
+    }
+    cout << "resumed from checkpoint @ " << t << endl;
+    return t;
+}
+
+void BlockController::resumeFrom(const Metadata &meta, int t) {
+    string basePath = checkpointPath(meta);
+    Checkpoint checkpoint;
+    if (!ReadCheckpoint(basePath, t, checkpoint)) {
+        cout << "cannot read checkpoint: " << basePath << " @ " << t << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // the feature history is spread over the chain of earlier checkpoints
+    Checkpoint older;
+    for (Checkpoint *c = &checkpoint; ; c = &older) {
+        for (auto it = c->history.begin(); it != c->history.end(); ++it) {
+            tracker_->RestoreExtractedFeatures(it->first, it->second);
+        }
+        if (c->prevT == INT_MIN) break;
+        if (!ReadCheckpoint(basePath, c->prevT, older)) {
+            cout << "cannot read checkpoint: " << basePath << " @ " << c->prevT << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pDataManager_->ResumeFeatures(meta, outputTag_, checkpoint.featuresBytes, checkpoint.indexBytes);
+    checkpoint.history.clear();
+    checkpoints_.clear();
+    checkpoints_[t] = make_shared<const Checkpoint>(std::move(checkpoint));
+    restoreCheckpoint(t);
+    applyHistoryBudget();
+
+    lastWrittenT_ = t;
+    stepsSinceWritten_.clear();
+}
+
+const SparseMask* BlockController::GetTrackedMask(int t) {
+    auto kept = trackedMasks_.find(t);
+    if (kept != trackedMasks_.end()) return &kept->second;
+    auto it = checkpoints_.find(t);
+    if (it == checkpoints_.end()) return NULL;
+    return &it->second->state.mask;
+}
+
+void BlockController::saveCheckpoint(int t) {
+    // a new one each time, the old one may still be waiting for the writer
+    shared_ptr<Checkpoint> pCheckpoint = make_shared<Checkpoint>();
+    tracker_->SaveState(pCheckpoint->state);
+    checkpoints_[t] = pCheckpoint;
+}
+
+void BlockController::pruneCheckpoints() {
+    // tracking goes on from the latest step, a jump back restores the last
+    // written one, anything older is read from disk on resume
+    for (auto it = checkpoints_.begin(); it != checkpoints_.end(); ) {
+        if (it->first != trackedT_ && it->first != lastWrittenT_) {
+            it = checkpoints_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    applyHistoryBudget();
+}
+
+void BlockController::applyHistoryBudget() {
+    if (historyBudget_ == 0) return;
+    size_t checkpointBytes = 0;
+    for (auto it = checkpoints_.begin(); it != checkpoints_.end(); ++it) {
+        checkpointBytes += MemoryBytes(*it->second);
+    }
+    // a history budget of 0 would be none at all, the least it keeps is its latest step
+    size_t left = historyBudget_ > checkpointBytes ? historyBudget_ - checkpointBytes : 0;
+    tracker_->SetHistoryBudget(std::max<size_t>(1, left));
+}
+
+bool BlockController::findCheckpoint(const Metadata &meta, int t) {
+    if (checkpoints_.count(t) > 0) return true;
+
+    // pruned from memory, but maybe written
+    shared_ptr<Checkpoint> pCheckpoint = make_shared<Checkpoint>();
+    if (!ReadCheckpoint(checkpointPath(meta), t, *pCheckpoint)) {
+        return false;
+    }
+    pCheckpoint->history.clear();
+    checkpoints_[t] = pCheckpoint;
+    return true;
+}
+
+bool BlockController::restoreCheckpoint(int t) {
+    auto it = checkpoints_.find(t);
+    if (it == checkpoints_.end()) return false;
+
+    tracker_->RestoreState(it->second->state);
+
+    // new features are extracted from the data the state belongs to, the
+    // caller has it loaded
+    tracker_->SetTF(pDataManager_->GetTF(t));
+    tracker_->SetVolume(pDataManager_->GetVolumes(t));
+    trackedT_ = t;
+    return true;
+}
+
+void BlockController::initTracker(const Metadata &meta) {
+    volumeDim_ = pDataManager_->GetBlockDim();
+    numThreads_ = meta.numThreads();
+    historyBudget_ = meta.historyBudget();
+    tracker_ = new FeatureTracker(volumeDim_);
+    tracker_->SetNumThreads(numThreads_);
+    tracker_->SetPredicate(predicate_);
+    tracker_->SetMinNumVoxels(predicate_.minVoxels);
+    if (historyBudget_ > 0) {
+        tracker_->SetHistoryBudget(historyBudget_, meta.path() + "/" + meta.prefix() + outputTag_ + ".history");
+    }
 }
@@ -4,6 +4,8 @@
 #include "Utils.h"
 #include "DataManager.h"
 #include "FeatureTracker.h"
+#include "FeatureGraph.h"
+#include "Checkpoint.h"
 
 class BlockController {
 
@@ -12,14 +14,146 @@ public:
    ~BlockController();
 
     void InitParameters(const Metadata& meta);
+    // Track the features into current time step, from the step before it
+    // (forward) or after it (backward). If the trackers hold another step,
+    // they resume from the checkpoint of that neighbor, so scrubbing back
+    // and forth does not start over from the first time step. Only the
+    // latest and the last written checkpoint stay in memory, a jump to
+    // another neighbor reads its checkpoint from disk if there is one.
     void TrackForward(const Metadata& meta);
-    void ExtractAllFeatures();
-    void SetCurrentTimestep(int t) { currentT_ = t; }
+    void TrackBackward(const Metadata& meta);
+    void SetCurrentTimestep(int t);
+    // Throughput of the read, classify, track and write stages. With a
+    // profile in the config, also writes its per time step rows.
+    void PrintIOSummary();
+
+    // Feature labels of the whole volume at current time step
+    const SparseMask& GetMask()     { return tracker_->GetMask(); }
+    const SparseMask& GetPrevMask() { return tracker_->GetPrevMask(); }
+
+    // Continuation, split, merge, birth and death of features per time step,
+    // as found by tracking in the given direction. Both are oriented in time.
+    const FeatureGraph& GetFeatureGraph(int direction = FT_FORWARD) {
+        return direction == FT_BACKWARD ? backwardGraph_ : featureGraph_;
+    }
+
+    // Labels of the whole volume at a tracked time step, NULL if they are
+    // not kept. Without KeepMasks only the steps with a checkpoint in memory
+    // have them: the latest one and the last one written.
+    const SparseMask* GetTrackedMask(int t);
+    // Keep the labels of every tracked step, e.g. to compare directions
+    // after a sweep. They grow with the run, so they are off by default.
+    void KeepMasks(bool keep)           { keepMasks_ = keep; }
+
+    // Forward and backward output go to different files
+    void SetOutputTag(const string& tag) { outputTag_ = tag; }
+    // Which of meta.predicates() defines the features, the first by default
+    void SetPredicateIndex(int index)    { predicateIndex_ = index; }
+    // Motion prediction of the trackers in place of meta.predictor(), e.g.
+    // to compare modes over the same data
+    void SetPredictor(int predictor)     { forcedPredictor_ = predictor; }
+
+    // Track another predicate over the same data, e.g. a threshold sweep. The
+    // follower reads the time steps this controller loads, and its visibility
+    // comes out of this controller's classification pass, so the data is read
+    // and classified once for all of them. From then on only this controller
+    // is driven, it steps its followers along. Call before InitParameters.
+    void AddFollower(BlockController* follower);
+
+    // Restore the latest checkpoint on disk and make it the current time
+    // step, in place of InitParameters. Returns that time step, or INT_MIN
+    // if there is no checkpoint to resume from.
+    int Resume(const Metadata& meta);
+
+    // What this controller found over the steps it tracked, and the time its
+    // own tracking took, without the read and classify stages it shares
+    struct Summary {
+        int     steps;
+        int64_t features;       // summed over the steps
+        int     maxFeatures;
+        int     found;          // new in tracking order, extracted or split off
+        int     lost;           // no longer tracked
+        double  seconds;
+        Summary() : steps(0), features(0), maxFeatures(0), found(0), lost(0), seconds(0.0) { }
+    };
+    const Summary& GetSummary() const { return summary_; }
 
 private:
-    DataManager    *pDataManager_;
-    FeatureTracker *pFeatureTracker_;
+    // A time step made ready for tracking: the visibility of every tracker
+    // in the group
+    struct PreparedStep {
+        vector<VisibilityMask> masks;   // per group member
+    };
+    // Everything the classify stage needs, so it never touches the trackers
+    struct PrepareRequest {
+        int                                 t;
+        shared_future<vector<VolumeView> >  volumes;
+        shared_ptr<const TransferFunction>  tf;
+        vector<FeaturePredicate>            predicates;
+        promise<PreparedStep*>              step;
+    };
+
+    void initTracker(const Metadata& meta);
+    vector<BlockController*> group();       // this controller and its followers
+    void initTrackers();                    // TF and first volumes of the trackers of the whole group
+    vector<FeaturePredicate> groupPredicates();
+    void prepareStep(int t, const vector<VolumeView>& volumes, const TransferFunction& tf,
+                     const vector<FeaturePredicate>& predicates, PreparedStep& step);
+    void applyStep(PreparedStep& step);     // hand prepared data and visibility to the trackers of the group
+    void requestStep(int t);                // start preparing t on the classify stage
+    PreparedStep* takeStep(int t);          // prepared t, NULL if something else was requested
+    void preparerLoop();                    // classify stage, serves pPrepareQueue_
+    void track(const Metadata& meta, int direction);
+    void trackStep(const Metadata& meta, int direction);    // this controller's part of a time step
+    void countFeatures(const set<int>& tracked, int& features, int& found, int& lost);   // of the step just tracked
+    void resumeFrom(const Metadata& meta, int t);   // restore checkpoint t written by this controller
+    void saveCheckpoint(int t);
+    void pruneCheckpoints();                // all but the latest and the last written one
+    void applyHistoryBudget();              // what the checkpoints leave of it to the feature histories
+    bool findCheckpoint(const Metadata& meta, int t);  // in memory, or read back if it was written
+    bool restoreCheckpoint(int t);
+    void writeCheckpoint(const Metadata& meta);     // current time step to disk, in the background
+    string checkpointPath(const Metadata& meta) { return meta.path() + "/" + meta.prefix() + outputTag_ + ".ckpt"; }
+
+    DataManager    *pDataManager_;          // the leader's if this is a follower
+    BlockController *leader_;               // NULL unless following
+    vector<BlockController*> followers_;
+    FeatureTracker *tracker_;               // the whole volume
+    vector3i        volumeDim_;
     int             currentT_;
+    int             trackedT_;              // time step the trackers currently hold
+    int             predictor_;             // motion prediction mode of the trackers
+    int             forcedPredictor_;       // -1 unless SetPredictor
+    int             predicateIndex_;
+    FeaturePredicate predicate_;
+    int             numThreads_;            // of classification and extraction
+    size_t          historyBudget_;         // bytes for feature histories and checkpoints, 0: no limit
+    string          outputTag_;
+    string          profileFormat_;         // csv or json, empty if not profiled
+    string          profilePath_;
+
+    FeatureGraph    featureGraph_;
+    FeatureGraph    backwardGraph_;
+
+    // in memory, by time step. A checkpoint never changes once saved, the
+    // writer copies it on its own thread.
+    map<int, shared_ptr<const Checkpoint> > checkpoints_;
+    bool            keepMasks_;
+    map<int, SparseMask> trackedMasks_;     // with keepMasks_, per tracked step
+    CheckpointWriter checkpointWriter_;
+    int             lastWrittenT_;          // time step of the last checkpoint on disk
+    vector<int>     stepsSinceWritten_;     // tracked since then, their features go with the next one
+
+    // Classify stage: the step after the current one in tracking direction
+    // is classified while the current one is tracked
+    BoundedQueue<PrepareRequest*> *pPrepareQueue_;  // started with the first request
+    std::thread     preparer_;
+    int             aheadT_;                // step being prepared, INT_MIN if none
+    future<PreparedStep*> ahead_;
+    std::mutex      statsMutex_;
+    StageStats      classifyStats_;         // waited: for the data to be read
+    StageStats      trackStats_;            // waited: for the classification
+    Summary         summary_;
 };
 
 #endif // DATABLOCKCONTROLLER_H
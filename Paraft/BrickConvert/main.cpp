@@ -0,0 +1,74 @@
+// Converts raw float volumes, one file per time step as Paraft and the
+// renderers read them, into bricked volumes. Every output is read back and
+// compared with its input before the next one is converted.
+//
+//   BrickConvert [-b brickSize] [-raw] dimX dimY dimZ in.raw out.bvol [in.raw out.bvol ...]
+
+#include "BrickedVolume.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+static void usage() {
+    cout << "usage: BrickConvert [-b brickSize] [-raw] dimX dimY dimZ in.raw out.bvol [in.raw out.bvol ...]" << endl;
+    exit(EXIT_FAILURE);
+}
+
+static bool readRaw(const string &fpath, vector<float> &data) {
+    ifstream in(fpath.c_str(), ios::binary);
+    return in && in.read(reinterpret_cast<char*>(data.data()), data.size()*sizeof(float));
+}
+
+int main(int argc, char **argv) {
+    int brickSize = BrickedVolume::DEFAULT_BRICK_SIZE;
+    bool compress = true;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+        if (strcmp(argv[arg], "-b") == 0 && arg+1 < argc) {
+            brickSize = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "-raw") == 0) {
+            compress = false;
+        } else {
+            usage();
+        }
+    }
+    if (brickSize <= 0 || argc - arg < 5 || (argc - arg - 3) % 2 != 0) usage();
+
+    BrickedVolume::Extent dim(atoi(argv[arg]), atoi(argv[arg+1]), atoi(argv[arg+2]));
+    BrickedVolume::Extent brick(brickSize, brickSize, brickSize);
+    if (dim.x <= 0 || dim.y <= 0 || dim.z <= 0) usage();
+
+    vector<float> data(dim.Volume()), check(dim.Volume());
+    for (arg += 3; arg < argc; arg += 2) {
+        string inPath = argv[arg], outPath = argv[arg+1];
+        if (!readRaw(inPath, data)) {
+            cout << "cannot read file: " << inPath << endl;
+            return EXIT_FAILURE;
+        }
+        if (!BrickedVolume::Write(outPath, data.data(), dim, brick, compress)) {
+            cout << "cannot output to file: " << outPath << endl;
+            return EXIT_FAILURE;
+        }
+
+        BrickedVolume::Reader reader;
+        if (!reader.Open(outPath) || !reader.ReadAll(check.data()) ||
+            memcmp(data.data(), check.data(), data.size()*sizeof(float)) != 0) {
+            cout << "verification failed: " << outPath << endl;
+            return EXIT_FAILURE;
+        }
+
+        int numConstant = 0;
+        uint64_t bytes = sizeof(BrickedVolume::Header) + reader.numBricks()*sizeof(BrickedVolume::BrickInfo);
+        for (int i = 0; i < reader.numBricks(); ++i) {
+            bytes += reader.brick(i).bytes;
+            if (reader.brick(i).codec == BrickedVolume::CODEC_CONSTANT) numConstant++;
+        }
+        printf("%s: %d bricks, %d constant, %.1f%% of raw size\n", outPath.c_str(), reader.numBricks(),
+               numConstant, 100.0 * bytes / (data.size()*sizeof(float)));
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+#include "Checkpoint.h"
+
+#include <cstdio>
+
+using util::writeRaw;
+using util::readRaw;
+
+static const char CHECKPOINT_MAGIC[4] = { 'P', 'F', 'C', 'K' };
+static const int CHECKPOINT_VERSION = 4;
+
+static void writeInt(ostream &out, int value) {
+    writeRaw(out, &value, 1);
+}
+
+static bool readInt(istream &in, int &value) {
+    return readRaw(in, &value, 1);
+}
+
+static void writeMask(ostream &out, const SparseMask &mask) {
+    writeInt(out, mask.NumLabeled());
+    mask.ForEach([&](int index, int label) {
+        int entry[2] = { index, label };
+        writeRaw(out, entry, 2);
+    });
+}
+
+static bool readMask(istream &in, SparseMask &mask) {
+    int count = 0;
+    if (!readInt(in, count) || count < 0) return false;
+    mask.Clear();
+    vector<int> entries(count*2);
+    if (!readRaw(in, entries.data(), entries.size())) return false;
+    for (int i = 0; i < count; ++i) {
+        mask.Set(entries[i*2], entries[i*2+1]);
+    }
+    return true;
+}
+
+static void writeTrackerState(ostream &out, const TrackerState &state) {
+    WriteFeatures(out, state.currentFeatures);
+    writeInt(out, (int)state.motion.size());
+    writeRaw(out, state.motion.data(), state.motion.size());
+    writeMask(out, state.mask);
+    writeMask(out, state.maskPrev);
+    int counters[2] = { state.globalMaskValue, state.lastDirection };
+    writeRaw(out, counters, 2);
+}
+
+static bool readTrackerState(istream &in, TrackerState &state) {
+    int counters[2];
+    int numMotion = 0;
+    if (!ReadFeatures(in, state.currentFeatures) || !readInt(in, numMotion) || numMotion < 0) {
+        return false;
+    }
+    state.motion.resize(numMotion);
+    if (!readRaw(in, state.motion.data(), numMotion) ||
+        !readMask(in, state.mask) || !readMask(in, state.maskPrev) || !readRaw(in, counters, 2)) {
+        return false;
+    }
+    state.globalMaskValue   = counters[0];
+    state.lastDirection     = counters[1];
+    return true;
+}
+
+// A labeled voxel costs its slot in the IndexMap table, kept at most half full
+static size_t maskBytes(const SparseMask &mask) {
+    return (size_t)mask.NumLabeled() * 2*(sizeof(uint64_t)+sizeof(int));
+}
+
+size_t MemoryBytes(const Checkpoint &c) {
+    const TrackerState &state = c.state;
+    return FeatureBytes(state.currentFeatures) + state.motion.capacity() * sizeof(FeatureMotion) +
+           maskBytes(state.mask) + maskBytes(state.maskPrev);
+}
+
+static string checkpointPath(const string &basePath, int t) {
+    char suffix[24];
+    sprintf(suffix, ".%d", t);
+    return basePath + suffix;
+}
+
+bool WriteCheckpoint(const string &basePath, const Checkpoint &c) {
+    string fpath = checkpointPath(basePath, c.t);
+    string tmpPath = fpath + ".tmp";
+    {
+        ofstream out(tmpPath.c_str(), ios::binary | ios::trunc);
+        if (!out) return false;
+
+        writeRaw(out, CHECKPOINT_MAGIC, 4);
+        int header[3] = { CHECKPOINT_VERSION, c.t, c.prevT };
+        writeRaw(out, header, 3);
+        uint64_t sizes[2] = { c.featuresBytes, c.indexBytes };
+        writeRaw(out, sizes, 2);
+
+        writeTrackerState(out, c.state);
+        writeInt(out, (int)c.history.size());
+        for (auto it = c.history.begin(); it != c.history.end(); ++it) {
+            writeInt(out, it->first);
+            WriteFeatures(out, it->second);
+        }
+
+        out.flush();
+        if (!out) return false;
+    }
+    if (rename(tmpPath.c_str(), fpath.c_str()) != 0) return false;
+
+    // only now the checkpoint is complete, point the latest marker at it
+    string latestTmp = basePath + ".tmp";
+    {
+        ofstream out(latestTmp.c_str(), ios::trunc);
+        out << c.t << endl;
+        if (!out) return false;
+    }
+    return rename(latestTmp.c_str(), basePath.c_str()) == 0;
+}
+
+bool ReadCheckpoint(const string &basePath, int t, Checkpoint &c) {
+    ifstream in(checkpointPath(basePath, t).c_str(), ios::binary);
+    char magic[4];
+    int header[3];
+    uint64_t sizes[2];
+    if (!in || !readRaw(in, magic, 4) || !equal(magic, magic+4, CHECKPOINT_MAGIC) ||
+        !readRaw(in, header, 3) || header[0] != CHECKPOINT_VERSION || header[1] != t ||
+        !readRaw(in, sizes, 2)) {
+        return false;
+    }
+    c.t = header[1];
+    c.prevT = header[2];
+    c.featuresBytes = sizes[0];
+    c.indexBytes = sizes[1];
+
+    int numSteps = 0;
+    if (!readTrackerState(in, c.state) || !readInt(in, numSteps)) return false;
+    c.history.clear();
+    for (int s = 0; s < numSteps; ++s) {
+        int step = 0;
+        if (!readInt(in, step) || !ReadFeatures(in, c.history[step])) return false;
+    }
+    return true;
+}
+
+int LatestCheckpoint(const string &basePath) {
+    ifstream in(basePath.c_str());
+    int t = INT_MIN;
+    if (!(in >> t)) return INT_MIN;
+    return t;
+}
+
+CheckpointWriter::CheckpointWriter() : queue_(2) {
+    writer_ = std::thread(&CheckpointWriter::writerLoop, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    queue_.Close();
+    writer_.join();
+}
+
+void CheckpointWriter::Submit(const string &basePath, const shared_ptr<const Checkpoint> &state, Checkpoint *pCheckpoint) {
+    Job job = { basePath, state, pCheckpoint };
+    if (!queue_.Push(job)) {
+        delete pCheckpoint;
+    }
+}
+
+void CheckpointWriter::writerLoop() {
+    Job job;
+    while (queue_.Pop(job)) {
+        Checkpoint &c = *job.pCheckpoint;
+        c.state = job.state->state;
+        job.state.reset();
+
+        if (WriteCheckpoint(job.basePath, *job.pCheckpoint)) {
+            cout << "checkpoint saved: " << job.basePath << " @ " << job.pCheckpoint->t << endl;
+        } else {
+            cerr << "cannot write checkpoint: " << job.basePath << " @ " << job.pCheckpoint->t << endl;
+        }
+        delete job.pCheckpoint;
+    }
+}
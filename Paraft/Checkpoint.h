@@ -0,0 +1,58 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "Utils.h"
+#include "FeatureTracker.h"
+#include "BoundedQueue.h"
+
+// Tracker state after tracking one time step, enough to resume tracking
+// from there in either direction.
+struct Checkpoint {
+    TrackerState             state;
+
+    // Only used on disk. Each checkpoint file carries the extracted features
+    // of the time steps since the checkpoint before it, so the history is
+    // written once instead of again with every checkpoint.
+    int                      t;
+    int                      prevT;             // INT_MIN if this is the first
+    map<int, vector<Feature> > history;    // time step -> features
+    uint64_t                 featuresBytes;     // size of the feature output files
+    uint64_t                 indexBytes;        // ... when the checkpoint was taken
+};
+
+// Estimated heap footprint of the tracking state, without the on-disk fields
+size_t MemoryBytes(const Checkpoint &checkpoint);
+
+// Binary checkpoint files, <basePath>.<t>. <basePath> itself holds the time
+// step of the latest complete checkpoint. Both are written to a temporary
+// file first and renamed, so a crash never leaves a half written one behind.
+bool WriteCheckpoint(const string &basePath, const Checkpoint &checkpoint);
+bool ReadCheckpoint(const string &basePath, int t, Checkpoint &checkpoint);
+int  LatestCheckpoint(const string &basePath);  // INT_MIN if there is none
+
+// Writes checkpoints on a background thread. Submit blocks only while two
+// checkpoints are still pending.
+class CheckpointWriter {
+public:
+    CheckpointWriter();
+   ~CheckpointWriter();     // finishes pending checkpoints
+
+    // pCheckpoint has the on-disk fields, it is owned by the writer from
+    // now on. The tracking state is copied in from state on the writer
+    // thread, so state must not change anymore.
+    void Submit(const string &basePath, const shared_ptr<const Checkpoint> &state, Checkpoint *pCheckpoint);
+
+private:
+    struct Job {
+        string      basePath;
+        shared_ptr<const Checkpoint> state;
+        Checkpoint *pCheckpoint;
+    };
+
+    void writerLoop();
+
+    BoundedQueue<Job> queue_;
+    std::thread writer_;
+};
+
+#endif // CHECKPOINT_H
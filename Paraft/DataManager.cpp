@@ -1,19 +1,86 @@
 #include "DataManager.h"
+#include "RangeKernels.h"
+#include "BrickedVolume.h"
 
-DataManager::DataManager() {}
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+DataManager::DataManager() : stepBytes_(0), volumeSize_(0), precision_(QuantizedVolume::FLOAT32), dynamicTF_(false), numTFsRead_(0), numTFsShared_(0), pLoadQueue_(NULL),
+    writeQueue_(2), ioSeconds_(0.0), waitSeconds_(0.0), numLoaded_(0), pProfile_(NULL) {
+    writer_ = std::thread(&DataManager::writerLoop, this);
+}
 
 DataManager::~DataManager() {
-    if (!dataSequence_.empty()) {
-        for (auto it = dataSequence_.begin(); it != dataSequence_.end(); ++it) {
-            delete [] it->second;  // unload data
+    writeQueue_.Close();        // writer finishes what is queued, then exits
+    writer_.join();
+    if (pLoadQueue_ != NULL) {
+        pLoadQueue_->Close();   // loader finishes what is queued, then exits
+        loader_.join();
+        delete pLoadQueue_;
+    }
+    vector<StepFuture> steps = cache_.Clear();
+    for (size_t i = 0; i < steps.size(); ++i) {
+        const vector<VolumeView> &volumes = steps[i].get();
+        for (size_t v = 0; v < volumes.size(); ++v) {
+            unloadTimestep(volumes[v]);
         }
     }
+    delete pProfile_;
+}
+
+VolumeView DataManager::GetVolume(int t) {
+    vector<VolumeView> volumes = GetVolumes(t);
+    return volumes.empty() ? VolumeView() : volumes[0];
+}
+
+shared_future<vector<VolumeView> > DataManager::GetVolumesFuture(int t) {
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    StepFuture volumes = cache_.Use(t);
+    if (!volumes.valid() && pLoadQueue_ != NULL && t >= meta_.start() && t <= meta_.end()) {
+        volumes = queueLoad(t, true);
+    }
+    return volumes;
+}
+
+vector<VolumeView> DataManager::GetVolumes(int t) {
+    StepFuture volumes = GetVolumesFuture(t);
+    if (!volumes.valid()) {
+        return vector<VolumeView>();
+    }
+
+    if (volumes.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        auto begin = std::chrono::steady_clock::now();
+        volumes.wait();
+        std::chrono::duration<double> stall = std::chrono::steady_clock::now() - begin;
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        waitSeconds_ += stall.count();
+    }
+    return volumes.get();
 }
 
 void DataManager::InitTF(const Metadata &meta) {
-    ifstream inf(meta.tfPath().c_str(), ios::binary);
+    meta_ = meta;
+    dynamicTF_ = meta.dynamicTF();
+    if (!dynamicTF_) {
+        staticTF_ = loadTF(meta.tfPath());
+    }
+}
+
+shared_ptr<const TransferFunction> DataManager::GetTF(int t) {
+    if (!dynamicTF_) return staticTF_;
+
+    std::lock_guard<std::mutex> lock(tfMutex_);
+    auto it = stepTFs_.find(t);
+    if (it != stepTFs_.end()) return it->second;
+    return loadTF(meta_.tfFile(t));     // not queued for loading, nothing to keep it for
+}
+
+shared_ptr<const TransferFunction> DataManager::loadTF(const string &fpath) {
+    ifstream inf(fpath.c_str(), ios::binary);
     if (!inf) {
-        cout << "cannot load tf setting: " << meta.tfPath() << endl;
+        cout << "cannot load tf setting: " << fpath << endl;
         exit(EXIT_FAILURE);
     }
 
@@ -24,77 +91,332 @@ void DataManager::InitTF(const Metadata &meta) {
         exit(EXIT_FAILURE);
     }
 
-    tfRes_ = (int)tfResF;
-    pTFMap_ = new float[tfRes_];
-    inf.read(reinterpret_cast<char*>(pTFMap_), tfRes_*sizeof(float));
+    TransferFunction *pTF = new TransferFunction;
+    pTF->map.resize((int)tfResF);
+    inf.read(reinterpret_cast<char*>(pTF->map.data()), pTF->map.size()*sizeof(float));
     inf.close();
+    pTF->hash = util::hashBytes(pTF->map.data(), pTF->map.size()*sizeof(float));
+    numTFsRead_++;
+
+    // a TF that did not change is the same instance, its users skip it by pointer
+    shared_ptr<const TransferFunction> &cached = tfCache_[pTF->hash];
+    if (!cached || cached->map != pTF->map) {
+        cached.reset(pTF);
+    } else {
+        delete pTF;
+        numTFsShared_++;
+    }
+    return cached;
+}
+
+void DataManager::SaveMaskVolume(const SparseMask &mask, const Metadata &meta, const int timestep, const string &tag) {
+    WriteJob *job = new WriteJob;
+    job->kind = WriteJob::MASK;
+    job->t = timestep;
+    job->path = meta.path() + "/" + meta.prefix() + meta.timestamp(timestep) + tag + ".mask";
+    job->mask = mask;
+
+    auto begin = std::chrono::steady_clock::now();
+    writeQueue_.Push(job);
+    std::chrono::duration<double> stall = std::chrono::steady_clock::now() - begin;
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    writeStats_.waitSeconds += stall.count();
+}
+
+void DataManager::SaveFeatures(const SparseMask &mask, const vector<FeatureEdge> &edges, const Metadata &meta,
+                               const int timestep, const string &tag) {
+    WriteJob *job = new WriteJob;
+    job->kind = WriteJob::FEATURES;
+    job->t = timestep;
+    job->tag = tag;
+    job->path = meta.path() + "/" + meta.prefix() + tag;
+    job->mask = mask;
+    job->edges = edges;
+
+    auto begin = std::chrono::steady_clock::now();
+    writeQueue_.Push(job);
+    std::chrono::duration<double> stall = std::chrono::steady_clock::now() - begin;
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    writeStats_.waitSeconds += stall.count();
 }
 
-void DataManager::SaveMaskVolume(float* pData, const Metadata &meta, const int timestep) {
-    char timestamp[21];  // up to 64-bit number
-    sprintf(timestamp, (meta.timeFormat()).c_str(), timestep);
-    string fpath = meta.path() + "/" + meta.prefix() + timestamp + ".mask";
-    ofstream outf(fpath.c_str(), ios::binary);
-    if (!outf) {
-        cerr << "cannot output to file: " << fpath.c_str() << endl;
+void DataManager::GetFeatureOutputSize(const string &tag, uint64_t &featuresBytes, uint64_t &indexBytes) {
+    flushWrites();
+    FeatureWriter &writer = featureWriters_[tag];
+    featuresBytes = writer.FeaturesBytes();
+    indexBytes = writer.IndexBytes();
+}
+
+void DataManager::ResumeFeatures(const Metadata &meta, const string &tag, uint64_t featuresBytes, uint64_t indexBytes) {
+    flushWrites();
+    string basePath = meta.path() + "/" + meta.prefix() + tag;
+    if (!featureWriters_[tag].Reopen(basePath, meta.volumeDim(), featuresBytes, indexBytes)) {
+        cerr << "cannot resume output to file: " << basePath << ".features" << endl;
         exit(EXIT_FAILURE);
     }
+}
 
-    outf.write(reinterpret_cast<char*>(pData), volumeSize_*sizeof(float));
-    outf.close();
+void DataManager::flushWrites() {
+    WriteJob *job = new WriteJob;
+    job->kind = WriteJob::FLUSH;
+    future<void> done = job->done.get_future();
+    writeQueue_.Push(job);
+    done.wait();
+}
 
-    cout << "mask volume created: " << fpath << endl;
+void DataManager::writerLoop() {
+    WriteJob *job = NULL;
+    while (writeQueue_.Pop(job)) {
+        if (job->kind == WriteJob::FLUSH) {
+            job->done.set_value();
+            delete job;
+            continue;
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        if (job->kind == WriteJob::MASK) {
+            ofstream outf(job->path.c_str(), ios::binary);
+            if (!outf) {
+                cerr << "cannot output to file: " << job->path << endl;
+                exit(EXIT_FAILURE);
+            }
+            vector<float> maskVolume(volumeSize_);
+            job->mask.ToDense(maskVolume.data(), volumeSize_);
+            outf.write(reinterpret_cast<char*>(maskVolume.data()), volumeSize_*sizeof(float));
+            outf.close();
+            cout << "mask volume created: " << job->path << endl;
+        } else {
+            FeatureWriter &writer = featureWriters_[job->tag];
+            if (!writer.IsOpen() && !writer.Open(job->path, blockDim_)) {
+                cerr << "cannot output to file: " << job->path << ".features" << endl;
+                exit(EXIT_FAILURE);
+            }
+            writer.Write(job->mask, job->edges, job->t);
+            cout << "features saved: " << job->path << ".features @ " << job->t << endl;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+        {
+            std::lock_guard<std::mutex> lock(statsMutex_);
+            writeStats_.busySeconds += elapsed.count();
+            if (job->kind == WriteJob::FEATURES) writeStats_.items++;
+        }
+        if (pProfile_ != NULL) {
+            pProfile_->AddTime(job->t, PT_WRITE, elapsed.count());
+        }
+        delete job;
+    }
 }
 
-void DataManager::LoadDataSequence(const Metadata &meta, const int currentT) {
-    blockDim_ = meta.volumeDim();
-    volumeSize_ = blockDim_.VolumeSize();
+void DataManager::LoadDataSequence(const Metadata &meta, const int currentT, const int direction) {
+    // behind the current step only the one before: stale followers are
+    // restored from it, and predictors read the motion of the features, not
+    // the data of earlier steps
+    int behind = 1;
+    int first = currentT - behind, last = currentT + meta.prefetch();
+    if (direction == FT_BACKWARD) {
+        first = currentT - meta.prefetch();
+        last = currentT + behind;
+    }
+    if (pLoadQueue_ == NULL) {
+        meta_ = meta;
+        blockDim_ = meta.volumeDim();
+        volumeSize_ = blockDim_.VolumeSize();
+        precision_ = meta.precision();
+        stepBytes_ = (meta.variables().size() + 1) * volumeSize_ * QuantizedVolume::ElementSize(precision_);
+        cache_.Configure(meta.cachePolicy(), meta.cacheBudget(), meta.pinnedSteps());
+        pLoadQueue_ = new BoundedQueue<LoadRequest*>(last - first + 1);
+        loader_ = std::thread(&DataManager::loaderLoop, this);
+    }
 
-    // delete if data is not within [t-2, t+2] of current timestep t
-    for (auto it = dataSequence_.begin(); it != dataSequence_.end(); ++it) {
-        if (it->first < currentT-2 || it->first > currentT+2) {
-            delete [] it->second;
-            dataSequence_.erase(it);
-            cout << " - " << it->first << endl;
+    // current time step first, then the ones ahead in tracking direction,
+    // then the ones behind
+    int step = direction == FT_BACKWARD ? -1 : 1;
+    vector<int> order;
+    for (int t = currentT; t >= first && t <= last; t += step) order.push_back(t);
+    for (int t = currentT-step; t >= first && t <= last; t -= step) order.push_back(t);
+
+    std::unique_lock<std::mutex> lock(cacheMutex_);
+    vector<int> missing;
+    for (size_t i = 0; i < order.size(); ++i) {
+        int t = order[i];
+        if (t >= meta.start() && t <= meta.end() && !cache_.Contains(t)) missing.push_back(t);
+    }
+    vector<pair<int, StepFuture> > evicted = cache_.Evict(first, last, missing.size() * stepBytes_);
+    lock.unlock();
+
+    for (size_t i = 0; i < evicted.size(); ++i) {
+        const vector<VolumeView> &volumes = evicted[i].second.get();     // waits if it is still being read
+        for (size_t v = 0; v < volumes.size(); ++v) {
+            unloadTimestep(volumes[v]);
         }
+        if (dynamicTF_) {
+            std::lock_guard<std::mutex> tfLock(tfMutex_);
+            stepTFs_.erase(evicted[i].first);
+            for (auto tf = tfCache_.begin(); tf != tfCache_.end(); ) {
+                tf = tf->second.use_count() == 1 ? tfCache_.erase(tf) : ++tf;   // no step or tracker left using it
+            }
+        }
+        cout << " - " << evicted[i].first << endl;
     }
 
-    for (int t = currentT-2; t <= currentT+2; ++t) {
-        if (t < meta.start() || t > meta.end() || dataSequence_[t] != NULL) {
+    // the current step is read in any case, the rest as far as the budget goes
+    lock.lock();
+    for (size_t i = 0; i < missing.size(); ++i) {
+        if (missing[i] != currentT && !cache_.Fits(stepBytes_)) {
+            cache_.CutPrefetch();
             continue;
         }
+        queueLoad(missing[i], false);
+    }
+}
 
-        char timestamp[21];  // up to 64-bit number
-        sprintf(timestamp, meta.timeFormat().c_str(), t);
-        string fpath = meta.path() + "/" + meta.prefix() + timestamp + "." + meta.suffix();
+StepFuture DataManager::queueLoad(int t, bool onDemand) {
+    LoadRequest *request = new LoadRequest;
+    request->t = t;
+    for (size_t v = 0; v <= meta_.variables().size(); ++v) {
+        request->fpaths.push_back(meta_.dataFile(t, (int)v));
+    }
+    StepFuture volumes = request->volumes.get_future().share();
+    cache_.Insert(t, volumes, stepBytes_, onDemand);
+    if (dynamicTF_) {
+        std::lock_guard<std::mutex> lock(tfMutex_);
+        stepTFs_[t] = loadTF(meta_.tfFile(t));
+    }
+    pLoadQueue_->Push(request);
+    return volumes;
+}
 
-        ifstream inf(fpath.c_str(), ios::binary);
-        if (!inf) {
-            cout << "cannot read file: " + fpath << endl;
-            exit(EXIT_FAILURE);
+void DataManager::PrintIOSummary() {
+    flushWrites();      // the last steps still count
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    double hidden = ioSeconds_ > 0 ? std::max(0.0, 1.0 - waitSeconds_ / ioSeconds_) : 0.0;
+    cout << "io: " << numLoaded_ << " time steps, read " << ioSeconds_ << "s, "
+         << "stalled " << waitSeconds_ << "s, overlapped " << hidden * 100 << "%" << endl;
+    {
+        std::lock_guard<std::mutex> cacheLock(cacheMutex_);
+        const TimestepCache::Stats &stats = cache_.GetStats();
+        cout << "cache: " << (cache_.Policy() == CP_LRU ? "lru" : "window") << ", " << stats.loads << " loads ("
+             << stats.reloads << " again), " << stats.hits << " hits, " << stats.waits << " waited, "
+             << stats.misses << " misses, " << stats.evictions << " evicted, peak " << stats.peakBytes / 1048576.0 << " MB";
+        if (cache_.Budget() > 0) {
+            cout << " of " << cache_.Budget() / 1048576.0 << " MB, " << stats.cutPrefetches << " prefetches cut";
         }
+        cout << endl;
+    }
+    writeStats_.Print("write", "stalled tracking");
+    if (precision_ != QuantizedVolume::FLOAT32) {
+        cout << "volumes kept as " << QuantizedVolume::TypeName(precision_) << ", "
+             << volumeSize_*QuantizedVolume::ElementSize(precision_) / 1048576.0 << " MB each" << endl;
+    }
+    if (dynamicTF_) {
+        std::lock_guard<std::mutex> tfLock(tfMutex_);
+        cout << "tf: " << numTFsRead_ << " read, " << numTFsShared_ << " reused" << endl;
+    }
+}
 
-        float* pData = new float[volumeSize_];
-        inf.read(reinterpret_cast<char*>(pData), volumeSize_*sizeof(float));
-        inf.close();
+void DataManager::loaderLoop() {
+    LoadRequest *request = NULL;
+    while (pLoadQueue_->Pop(request)) {
+        auto begin = std::chrono::steady_clock::now();
+        vector<VolumeView> volumes;
+        int64_t bytesRead = 0;
+        for (size_t v = 0; v < request->fpaths.size(); ++v) {
+            size_t bytes = 0;
+            volumes.push_back(loadTimestep(request->fpaths[v], bytes));
+            bytesRead += bytes;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+        {
+            std::lock_guard<std::mutex> lock(statsMutex_);
+            ioSeconds_ += elapsed.count();
+            numLoaded_++;
+        }
+        if (pProfile_ != NULL) {
+            pProfile_->AddTime(request->t, PT_LOAD, elapsed.count());
+            pProfile_->Add(request->t, PC_LOAD_BYTES, bytesRead);
+        }
 
-        preprocessData(pData);
-        dataSequence_[t] = pData;
+        cout << " + " << request->t << endl;
+        request->volumes.set_value(volumes);
+        delete request;
+    }
+}
 
-        cout << " + " << t << endl;
+VolumeView DataManager::loadTimestep(const string &fpath, size_t &bytesRead) {
+    bytesRead = 0;
+    if (BrickedVolume::IsBricked(fpath)) {
+        return loadBricked(fpath, bytesRead);
     }
+    const size_t bytes = volumeSize_*sizeof(float);
+
+    int fd = open(fpath.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < bytes) {
+        cout << "cannot read file: " + fpath << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // the tracker reads the pages in place, nothing is copied into the heap
+    void *pMapped = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pMapped == MAP_FAILED) {
+        cout << "cannot map file: " + fpath << endl;
+        exit(EXIT_FAILURE);
+    }
+    madvise(pMapped, bytes, MADV_WILLNEED);
+    bytesRead = bytes;
+
+    float min = 0.0f, max = 0.0f;
+    RangeKernels::MinMax(static_cast<const float*>(pMapped), volumeSize_, min, max);
+    return keepVolume(static_cast<const float*>(pMapped), min, max);
 }
 
-void DataManager::preprocessData(float *pData) {
-    float min = pData[0], max = pData[0];
-    for (int i = 1; i < volumeSize_; ++i) {
-        min = std::min(min, pData[i]);
-        max = std::max(max, pData[i]);
+VolumeView DataManager::loadBricked(const string &fpath, size_t &bytesRead) {
+    const size_t bytes = volumeSize_*sizeof(float);
+
+    BrickedVolume::Reader reader;
+    if (!reader.Open(fpath) || reader.dim().x != blockDim_.x || reader.dim().y != blockDim_.y ||
+        reader.dim().z != blockDim_.z) {
+        cout << "cannot read file: " + fpath << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // anonymous pages, so it is unloaded like a mapped raw file
+    void *pData = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pData == MAP_FAILED || !reader.ReadAll(static_cast<float*>(pData))) {
+        cout << "cannot read file: " + fpath << endl;
+        exit(EXIT_FAILURE);
     }
 
+    // constant bricks are in the table only
+    bytesRead = sizeof(BrickedVolume::Header) + reader.numBricks() * sizeof(BrickedVolume::BrickInfo);
+    for (int i = 0; i < reader.numBricks(); ++i) {
+        bytesRead += reader.brick(i).bytes;
+    }
+
+    // the range is in the header, no pass over the data
+    return keepVolume(static_cast<const float*>(pData), reader.min(), reader.max());
+}
+
+VolumeView DataManager::keepVolume(const float *data, float min, float max) {
     cout << min << ", " << max << endl;
 
-    for (int i = 0; i < volumeSize_; ++i) {
-        pData[i] = (pData[i] - min) / (max - min);
+    if (precision_ == QuantizedVolume::FLOAT32) {
+        // applied when the data is classified instead of rewriting the mapping
+        return VolumeView(data, QuantizedVolume::FLOAT32, min, max > min ? 1.0f / (max - min) : 0.0f);
     }
+
+    const size_t bytes = volumeSize_*QuantizedVolume::ElementSize(precision_);
+    void *pCompact = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pCompact == MAP_FAILED) {
+        cout << "cannot allocate " << bytes << " bytes for a time step" << endl;
+        exit(EXIT_FAILURE);
+    }
+    QuantizedVolume::Encode(data, volumeSize_, min, max, precision_, pCompact);
+    munmap(const_cast<float*>(data), volumeSize_*sizeof(float));
+    return VolumeView(pCompact, precision_, 0.0f, QuantizedVolume::Scale(precision_));
+}
+
+void DataManager::unloadTimestep(const VolumeView &volume) {
+    munmap(const_cast<void*>(volume.data), volumeSize_*QuantizedVolume::ElementSize(volume.type));
 }
@@ -3,6 +3,10 @@
 
 #include "Utils.h"
 #include "Metadata.h"
+#include "BoundedQueue.h"
+#include "FeatureWriter.h"
+#include "Profile.h"
+#include "TimestepCache.h"
 
 class DataManager {
 
@@ -10,24 +14,116 @@ public:
     DataManager();
    ~DataManager();
 
-    float* GetDataPtr(int t)    { return dataSequence_[t]; }
-    float* GetTFMap()           { return pTFMap_; }
-    int GetTFRes()              { return tfRes_ > 0 ? tfRes_ : DEFAULT_TF_RES; }
+    // Mapped raw data of time step t with its normalization, or its compact
+    // copy in a reduced precision, or a NULL view if t is not loaded. Blocks
+    // only if t is still being read.
+    VolumeView GetVolume(int t);
+    // The same for all variables of t, the primary one first, empty if not loaded
+    vector<VolumeView> GetVolumes(int t);
+    // Completes once t is read, for waiting on another thread. A step of the
+    // run that is not loaded is queued on demand, otherwise it is not valid.
+    shared_future<vector<VolumeView> > GetVolumesFuture(int t);
     vector3i GetBlockDim()      { return blockDim_; }
 
+    // Transfer function of time step t. With dynamicTF every step has its own
+    // file, read when the step is queued for loading; steps whose TFs have the
+    // same content share one instance. Otherwise all get the one of tfPath.
+    shared_ptr<const TransferFunction> GetTF(int t);
     void InitTF(const Metadata &meta);
-    void LoadDataSequence(const Metadata &meta, const int currentT);
-    void SaveMaskVolume(float *pData, const Metadata &meta, const int timestep);
+
+    // Keep the window [t-1, t+prefetch] of current time step t in memory,
+    // mirrored when tracking backward. Steps outside it are evicted according to the cache
+    // policy; missing ones are queued for the background loader as far as
+    // the byte budget allows. This call does not wait for the loads.
+    void LoadDataSequence(const Metadata &meta, const int currentT, const int direction = FT_FORWARD);
+
+    // Output is written by a background stage in call order. The mask is
+    // copied, the call only waits if the stage is more than a couple of
+    // steps behind.
+    void SaveMaskVolume(const SparseMask &mask, const Metadata &meta, const int timestep, const string &tag = "");
+    // Append the features of mask to <path>/<prefix><tag>.features and .fidx,
+    // each tag is a separate output
+    void SaveFeatures(const SparseMask &mask, const vector<FeatureEdge> &edges, const Metadata &meta,
+                      const int timestep, const string &tag = "");
+    // Sizes of the feature output so far, and continuing it from such sizes.
+    // Both wait until everything saved before is written.
+    void GetFeatureOutputSize(const string &tag, uint64_t &featuresBytes, uint64_t &indexBytes);
+    void ResumeFeatures(const Metadata &meta, const string &tag, uint64_t featuresBytes, uint64_t indexBytes);
+
+    // How much of the reading was hidden behind tracking, the cache and the
+    // read and write stage counters
+    void PrintIOSummary();
+
+    // Per time step timers and counters, shared by all stages of this run.
+    // NULL until enabled, which has to happen before the first load.
+    void EnableProfile()        { if (pProfile_ == NULL) pProfile_ = new Profile(); }
+    Profile* GetProfile()       { return pProfile_; }
+    int LoadQueueDepth()        { return pLoadQueue_ != NULL ? (int)pLoadQueue_->Size() : 0; }
+    int WriteQueueDepth()       { return (int)writeQueue_.Size(); }
 
 private:
-    void preprocessData(float *pData);
+    struct LoadRequest {
+        int              t;
+        vector<string>   fpaths;    // per variable
+        promise<vector<VolumeView> > volumes;
+    };
+
+    // Feature output, a dense mask volume, or a marker completed once
+    // everything before it is written
+    struct WriteJob {
+        enum Kind { FEATURES, MASK, FLUSH } kind;
+        int                 t;
+        string              tag;        // which feature output
+        string              path;       // base path of features, file of a mask
+        SparseMask          mask;
+        vector<FeatureEdge> edges;
+        promise<void>       done;
+    };
+
+    void loaderLoop();                      // background thread, serves pLoadQueue_
+    void writerLoop();                      // background thread, serves writeQueue_
+    void flushWrites();
+    StepFuture queueLoad(int t, bool onDemand);    // with cacheMutex_ held
+    // bytesRead is what came from disk, 0 if nothing was loaded
+    VolumeView loadTimestep(const string &fpath, size_t &bytesRead);
+    VolumeView loadBricked(const string &fpath, size_t &bytesRead);    // a BrickedVolume file, read into anonymous pages
+    // View of float data just read with its range, in the precision of the
+    // run. A compact copy replaces the float pages, only it stays loaded.
+    VolumeView keepVolume(const float *data, float min, float max);
+    void unloadTimestep(const VolumeView &volume);
+    shared_ptr<const TransferFunction> loadTF(const string &fpath);     // or the cached one of same content
 
-    DataSequence dataSequence_;
+    TimestepCache cache_;
+    std::mutex cacheMutex_;
+    size_t stepBytes_;      // in memory, of all variables of a loaded time step
+    Metadata meta_;         // file of each time step, for loads on demand
     vector3i blockDim_;
 
     int volumeSize_;
-    int tfRes_;
-    float *pTFMap_;
+    int precision_;         // QuantizedVolume::Type of the loaded volumes
+
+    bool dynamicTF_;
+    shared_ptr<const TransferFunction> staticTF_;
+    map<int, shared_ptr<const TransferFunction> > stepTFs_;         // of the loaded time steps
+    map<uint64_t, shared_ptr<const TransferFunction> > tfCache_;    // by content hash
+    std::mutex tfMutex_;
+    int numTFsRead_;
+    int numTFsShared_;      // read but the same as a cached one
+
+    map<string, FeatureWriter> featureWriters_;   // by output tag
+
+    BoundedQueue<LoadRequest*> *pLoadQueue_;
+    std::thread loader_;
+    BoundedQueue<WriteJob*> writeQueue_;
+    std::thread writer_;
+    StageStats writeStats_;                 // waited: tracking blocked on a full queue
+
+    std::mutex statsMutex_;
+    double ioSeconds_;      // spent reading and preprocessing on the loader thread
+    double waitSeconds_;    // spent blocked in GetVolume
+    int numLoaded_;
+
+    Profile *pProfile_;
 };
 
 #endif // DATAMANAGER_H
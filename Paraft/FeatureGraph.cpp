@@ -0,0 +1,181 @@
+#include "FeatureGraph.h"
+
+static inline uint64_t pairKey(int prevId, int id) {
+    return ((uint64_t)(uint32_t)prevId << 32) | (uint32_t)id;
+}
+
+void FeatureGraph::Update(const SparseMask &prevMask, const SparseMask &mask, int t) {
+    IndexMap<int> overlaps;                 // (prevId, id) -> shared voxels
+    IndexMap<int> prevIds, ids;             // labels present at either step
+
+    prevMask.ForEach([&](int, int prevId) {
+        if (prevIds.find(prevId) == NULL) prevIds.set(prevId, 0);
+    });
+    mask.ForEach([&](int index, int id) {
+        if (ids.find(id) == NULL) ids.set(id, 0);
+        int prevId = prevMask.Get(index);
+        if (prevId <= 0) return;
+        int *count = overlaps.find(pairKey(prevId, id));
+        if (count != NULL) {
+            (*count)++;
+        } else {
+            overlaps.set(pairKey(prevId, id), 1);
+        }
+    });
+
+    map<int, int> numSuccessors, numPredecessors;
+    prevIds.forEach([&](uint64_t prevId, int) { numSuccessors[(int)prevId] = 0; });
+    ids.forEach([&](uint64_t id, int) { numPredecessors[(int)id] = 0; });
+
+    Step &step = steps_[t];
+    step.edges.clear();
+    step.events.clear();
+    overlaps.forEach([&](uint64_t key, int count) {
+        FeatureEdge edge = { (int)(key >> 32), (int)(uint32_t)key, count };
+        step.edges.push_back(edge);
+        numSuccessors[edge.prevId]++;
+        numPredecessors[edge.id]++;
+    });
+    std::sort(step.edges.begin(), step.edges.end(), [](const FeatureEdge &a, const FeatureEdge &b) {
+        return a.prevId != b.prevId ? a.prevId < b.prevId : a.id < b.id;
+    });
+
+    // a feature can take part in a split and a merge at once, every edge is
+    // covered by at least one event
+    map<int, FeatureEvent> merges;          // by id
+    for (size_t i = 0; i < step.edges.size(); ) {
+        int prevId = step.edges[i].prevId;
+        FeatureEvent split;
+        split.type = FE_SPLIT;
+        split.prevIds.push_back(prevId);
+        for (; i < step.edges.size() && step.edges[i].prevId == prevId; ++i) {
+            const FeatureEdge &edge = step.edges[i];
+            split.ids.push_back(edge.id);
+            if (numPredecessors[edge.id] > 1) {
+                merges[edge.id].type = FE_MERGE;
+                merges[edge.id].prevIds.push_back(prevId);
+            } else if (numSuccessors[prevId] == 1) {
+                FeatureEvent continuation = { FE_CONTINUATION, vector<int>(1, prevId), vector<int>(1, edge.id) };
+                step.events.push_back(continuation);
+            }
+        }
+        if (split.ids.size() > 1) {
+            step.events.push_back(split);
+        }
+    }
+    for (auto it = merges.begin(); it != merges.end(); ++it) {
+        it->second.ids.push_back(it->first);
+        step.events.push_back(it->second);
+    }
+
+    for (auto it = numSuccessors.begin(); it != numSuccessors.end(); ++it) {
+        if (it->second > 0) continue;
+        FeatureEvent death = { FE_DEATH, vector<int>(1, it->first), vector<int>() };
+        step.events.push_back(death);
+    }
+    for (auto it = numPredecessors.begin(); it != numPredecessors.end(); ++it) {
+        if (it->second > 0) continue;
+        FeatureEvent birth = { FE_BIRTH, vector<int>(), vector<int>(1, it->first) };
+        step.events.push_back(birth);
+    }
+}
+
+const vector<FeatureEdge>& FeatureGraph::Edges(int t) const {
+    static const vector<FeatureEdge> none;
+    auto it = steps_.find(t);
+    return it == steps_.end() ? none : it->second.edges;
+}
+
+const vector<FeatureEvent>& FeatureGraph::Events(int t) const {
+    static const vector<FeatureEvent> none;
+    auto it = steps_.find(t);
+    return it == steps_.end() ? none : it->second.events;
+}
+
+vector<int> FeatureGraph::Predecessors(int t, int id) const {
+    vector<int> prevIds;
+    const vector<FeatureEdge> &edges = Edges(t);
+    for (size_t i = 0; i < edges.size(); ++i) {
+        if (edges[i].id == id) prevIds.push_back(edges[i].prevId);
+    }
+    return prevIds;
+}
+
+vector<int> FeatureGraph::Successors(int t, int id) const {
+    vector<int> ids;
+    const vector<FeatureEdge> &edges = Edges(t+1);
+    for (size_t i = 0; i < edges.size() && edges[i].prevId <= id; ++i) {
+        if (edges[i].prevId == id) ids.push_back(edges[i].id);
+    }
+    return ids;
+}
+
+map<int, int> FeatureGraph::MatchLabels(const SparseMask &mask, const SparseMask &otherMask) {
+    IndexMap<int> overlaps;                 // (other label, label) -> shared voxels
+    otherMask.ForEach([&](int index, int otherId) {
+        int id = mask.Get(index);
+        if (id <= 0) return;
+        int *count = overlaps.find(pairKey(otherId, id));
+        if (count != NULL) {
+            (*count)++;
+        } else {
+            overlaps.set(pairKey(otherId, id), 1);
+        }
+    });
+
+    map<int, pair<int, int> > best;         // other label -> (overlap, label)
+    overlaps.forEach([&](uint64_t key, int count) {
+        int otherId = (int)(key >> 32), id = (int)(uint32_t)key;
+        pair<int, int> &b = best[otherId];
+        if (count > b.first || (count == b.first && id < b.second)) {
+            b = make_pair(count, id);
+        }
+    });
+
+    map<int, int> matches;
+    for (auto it = best.begin(); it != best.end(); ++it) {
+        matches[it->first] = it->second.second;
+    }
+    return matches;
+}
+
+GraphAgreement FeatureGraph::Compare(int t, const FeatureGraph &other,
+                                     const SparseMask &prevMask, const SparseMask &mask,
+                                     const SparseMask &otherPrevMask, const SparseMask &otherMask) const {
+    map<int, int> prevMatches = MatchLabels(prevMask, otherPrevMask);
+    map<int, int> matches = MatchLabels(mask, otherMask);
+
+    set<pair<int, int> > matched;           // other edges translated to this graph's labels
+    GraphAgreement agreement;
+    const vector<FeatureEdge> &otherEdges = other.Edges(t);
+    for (size_t i = 0; i < otherEdges.size(); ++i) {
+        auto prevId = prevMatches.find(otherEdges[i].prevId);
+        auto id = matches.find(otherEdges[i].id);
+        if (prevId == prevMatches.end() || id == matches.end()) {
+            agreement.onlyOther.push_back(otherEdges[i]);
+        } else {
+            matched.insert(make_pair(prevId->second, id->second));
+        }
+    }
+
+    set<pair<int, int> > found;
+    const vector<FeatureEdge> &edges = Edges(t);
+    for (size_t i = 0; i < edges.size(); ++i) {
+        pair<int, int> key(edges[i].prevId, edges[i].id);
+        if (matched.count(key) > 0) {
+            agreement.confirmed.push_back(edges[i]);
+            found.insert(key);
+        } else {
+            agreement.onlyThis.push_back(edges[i]);
+        }
+    }
+    for (size_t i = 0; i < otherEdges.size(); ++i) {
+        auto prevId = prevMatches.find(otherEdges[i].prevId);
+        auto id = matches.find(otherEdges[i].id);
+        if (prevId != prevMatches.end() && id != matches.end() &&
+            found.count(make_pair(prevId->second, id->second)) == 0) {
+            agreement.onlyOther.push_back(otherEdges[i]);
+        }
+    }
+    return agreement;
+}
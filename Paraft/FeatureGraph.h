@@ -0,0 +1,70 @@
+#ifndef FEATUREGRAPH_H
+#define FEATUREGRAPH_H
+
+#include "Utils.h"
+
+const int FE_CONTINUATION = 0;
+const int FE_SPLIT = 1;
+const int FE_MERGE = 2;
+const int FE_BIRTH = 3;
+const int FE_DEATH = 4;
+
+struct FeatureEdge {
+    int prevId;             // Feature at the previous time step
+    int id;                 // Feature at this time step
+    int overlap;            // Number of shared voxels
+};
+
+struct FeatureEvent {
+    int         type;       // FE_*
+    vector<int> prevIds;    // Features at the previous time step involved
+    vector<int> ids;        // Features at this time step involved
+};
+
+// Agreement of one time step between two independently tracked graphs
+struct GraphAgreement {
+    vector<FeatureEdge> confirmed;  // found by both, in this graph's labels
+    vector<FeatureEdge> onlyThis;   // ... only by this graph
+    vector<FeatureEdge> onlyOther;  // ... only by the other graph, in its own labels
+};
+
+// Correspondence of features between consecutive time steps, derived from
+// the voxels their labels share. Each Update costs one hash lookup per
+// labeled voxel, which is small next to growing the regions.
+class FeatureGraph {
+public:
+    // Records the step from prevMask to mask as time step t. Features are
+    // identified by their labels, which tracking keeps across time steps.
+    // A split shows up only if each piece has its own label at t, as the
+    // tracker gives them.
+    void Update(const SparseMask &prevMask, const SparseMask &mask, int t);
+    void Clear()                                    { steps_.clear(); }
+
+    // Edges and events of time step t, empty if t was never updated
+    const vector<FeatureEdge>&  Edges(int t) const;
+    const vector<FeatureEvent>& Events(int t) const;
+
+    // Features at t-1 that feature id at t came from, and at t+1 that it went to
+    vector<int> Predecessors(int t, int id) const;
+    vector<int> Successors(int t, int id) const;
+
+    // Compares step t with the same step of a graph tracked on its own, for
+    // example in the other direction, whose labels differ. Its labels are
+    // matched to this graph's by largest overlap of the masks at t-1 and t.
+    GraphAgreement Compare(int t, const FeatureGraph &other,
+                           const SparseMask &prevMask, const SparseMask &mask,
+                           const SparseMask &otherPrevMask, const SparseMask &otherMask) const;
+
+    // Label of mask overlapping each label of otherMask the most
+    static map<int, int> MatchLabels(const SparseMask &mask, const SparseMask &otherMask);
+
+private:
+    struct Step {
+        vector<FeatureEdge>  edges;     // sorted by (prevId, id)
+        vector<FeatureEvent> events;
+    };
+
+    map<int, Step> steps_;
+};
+
+#endif // FEATUREGRAPH_H
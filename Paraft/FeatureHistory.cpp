@@ -0,0 +1,229 @@
+#include "FeatureHistory.h"
+
+#include <cstdio>
+
+using util::writeRaw;
+using util::readRaw;
+
+static void writeVoxels(ostream &out, const vector3i *voxels, int count) {
+    writeRaw(out, &count, 1);
+    writeRaw(out, voxels, count);
+}
+
+static bool readVoxels(istream &in, vector<vector3i> &voxels) {
+    int count = 0;
+    if (!readRaw(in, &count, 1) || count < 0) return false;
+    voxels.resize(count);
+    return readRaw(in, voxels.data(), count);
+}
+
+void WriteFeatures(ostream &out, const vector<Feature> &features) {
+    int count = (int)features.size();
+    writeRaw(out, &count, 1);
+    vector<vector3i> body;
+    for (size_t i = 0; i < features.size(); ++i) {
+        const Feature &f = features[i];
+        int header[2] = { f.id, f.maskValue };
+        writeRaw(out, header, 2);
+        writeRaw(out, &f.centroid, 1);
+        writeVoxels(out, f.edgeVoxels.data(), (int)f.edgeVoxels.size());
+        // body order matters to region shrinking, it is kept as is
+        body.assign(f.bodyVoxels.begin(), f.bodyVoxels.end());
+        writeVoxels(out, body.data(), (int)body.size());
+    }
+}
+
+bool ReadFeatures(istream &in, vector<Feature> &features) {
+    int count = 0;
+    if (!readRaw(in, &count, 1) || count < 0) return false;
+    features.resize(count);
+    vector<vector3i> body;
+    for (int i = 0; i < count; ++i) {
+        Feature &f = features[i];
+        int header[2];
+        if (!readRaw(in, header, 2) || !readRaw(in, &f.centroid, 1) ||
+            !readVoxels(in, f.edgeVoxels) || !readVoxels(in, body)) {
+            return false;
+        }
+        f.id = header[0];
+        f.maskValue = header[1];
+        f.bodyVoxels.clear();
+        f.bodyVoxels.reserve(body.size());
+        for (size_t j = 0; j < body.size(); ++j) {
+            f.bodyVoxels.insert(body[j]);
+        }
+    }
+    return true;
+}
+
+// A body voxel costs its coordinates plus a slot in the VoxelSet table,
+// which is kept at most half full.
+size_t FeatureBytes(const vector<Feature> &features) {
+    size_t bytes = features.capacity() * sizeof(Feature);
+    for (size_t i = 0; i < features.size(); ++i) {
+        bytes += features[i].edgeVoxels.capacity() * sizeof(vector3i);
+        bytes += features[i].bodyVoxels.size() * (sizeof(vector3i) + 2*(sizeof(uint64_t)+sizeof(uint32_t)));
+    }
+    return bytes;
+}
+
+FeatureHistory::~FeatureHistory() {
+    if (log_.is_open()) {
+        log_.close();
+        remove(spillPath_.c_str());
+    }
+}
+
+void FeatureHistory::SetBudget(size_t bytes, const string &spillPath) {
+    budget_ = bytes;
+    spillPath_ = spillPath;
+    evict();
+}
+
+void FeatureHistory::Put(int t, const vector<Feature> &features) {
+    Entry &e = touch(t);
+    e.features = features;
+    resize(e);
+    forget(t);
+    evict();
+}
+
+void FeatureHistory::Swap(int t, vector<Feature> &features) {
+    Entry &e = touch(t);
+    e.features.swap(features);
+    resize(e);
+    forget(t);
+    evict();
+}
+
+const vector<Feature>* FeatureHistory::Get(int t) {
+    bool inMemory = memory_.find(t) != memory_.end();
+    if (!inMemory && spilled_.count(t) == 0) return NULL;
+
+    Entry &e = touch(t);
+    if (!inMemory) {
+        pageIn(t, e);
+        resize(e);
+        evict();
+    }
+    return &e.features;
+}
+
+FeatureHistory::Entry& FeatureHistory::touch(int t) {
+    auto it = memory_.find(t);
+    if (it != memory_.end()) {
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        return it->second;
+    }
+    Entry &e = memory_[t];
+    e.bytes = 0;
+    lru_.push_front(t);
+    e.lru = lru_.begin();
+    return e;
+}
+
+void FeatureHistory::resize(Entry &e) {
+    memoryBytes_ -= e.bytes;
+    e.bytes = FeatureBytes(e.features);
+    memoryBytes_ += e.bytes;
+}
+
+void FeatureHistory::evict() {
+    // the most recently used step always stays, its caller is holding it
+    while (budget_ > 0 && memoryBytes_ > budget_ && lru_.size() > 1) {
+        int t = lru_.back();
+        auto it = memory_.find(t);
+        if (spilled_.count(t) == 0) {
+            spill(t, it->second);
+        }
+        memoryBytes_ -= it->second.bytes;
+        lru_.pop_back();
+        memory_.erase(it);
+    }
+}
+
+void FeatureHistory::spill(int t, const Entry &e) {
+    if (!log_.is_open()) {
+        log_.open(spillPath_.c_str(), ios::in | ios::out | ios::binary | ios::trunc);
+        if (!log_) {
+            cout << "cannot create spill file: " << spillPath_ << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    // records are only appended, a step stored again later leaves a dead one behind
+    log_.clear();
+    log_.seekp(logBytes_);
+    writeRaw(log_, &t, 1);
+    WriteFeatures(log_, e.features);
+    if (!log_) {
+        cout << "cannot write spill file: " << spillPath_ << endl;
+        exit(EXIT_FAILURE);
+    }
+    uint64_t end = (uint64_t)log_.tellp();
+    Record record = { logBytes_, end - logBytes_ };
+    spilled_[t] = record;
+    liveBytes_ += record.bytes;
+    logBytes_ = end;
+}
+
+void FeatureHistory::pageIn(int t, Entry &e) {
+    int recordT = INT_MIN;
+    log_.clear();
+    log_.seekg(spilled_[t].offset);
+    if (!readRaw(log_, &recordT, 1) || recordT != t || !ReadFeatures(log_, e.features)) {
+        cout << "cannot read spill file: " << spillPath_ << " @ " << t << endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+void FeatureHistory::forget(int t) {
+    auto it = spilled_.find(t);
+    if (it == spilled_.end()) return;
+    liveBytes_ -= it->second.bytes;
+    spilled_.erase(it);
+
+    if (spilled_.empty()) {
+        logBytes_ = 0;      // nothing live, the next spill starts over
+        log_.close();
+        remove(spillPath_.c_str());
+    } else if (logBytes_ - liveBytes_ > liveBytes_) {
+        compact();
+    }
+}
+
+void FeatureHistory::compact() {
+    string tmpPath = spillPath_ + ".tmp";
+    {
+        ofstream out(tmpPath.c_str(), ios::binary | ios::trunc);
+        vector<char> buffer;
+        uint64_t offset = 0;
+        for (auto it = spilled_.begin(); it != spilled_.end(); ++it) {
+            buffer.resize(it->second.bytes);
+            log_.clear();
+            log_.seekg(it->second.offset);
+            if (!readRaw(log_, buffer.data(), buffer.size())) {
+                cout << "cannot read spill file: " << spillPath_ << " @ " << it->first << endl;
+                exit(EXIT_FAILURE);
+            }
+            writeRaw(out, buffer.data(), buffer.size());
+            it->second.offset = offset;
+            offset += it->second.bytes;
+        }
+        out.flush();
+        if (!out) {
+            cout << "cannot write spill file: " << tmpPath << endl;
+            exit(EXIT_FAILURE);
+        }
+        logBytes_ = offset;
+    }
+    log_.close();
+    if (rename(tmpPath.c_str(), spillPath_.c_str()) != 0) {
+        cout << "cannot replace spill file: " << spillPath_ << endl;
+        exit(EXIT_FAILURE);
+    }
+    log_.open(spillPath_.c_str(), ios::in | ios::out | ios::binary);
+    if (!log_) {
+        cout << "cannot open spill file: " << spillPath_ << endl;
+        exit(EXIT_FAILURE);
+    }
+}
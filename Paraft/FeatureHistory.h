@@ -0,0 +1,70 @@
+#ifndef FEATUREHISTORY_H
+#define FEATUREHISTORY_H
+
+#include "Utils.h"
+
+// Binary record of a feature vector, shared by the spill log and checkpoints
+void WriteFeatures(ostream &out, const vector<Feature> &features);
+bool ReadFeatures(istream &in, vector<Feature> &features);
+// Heap footprint of a feature vector
+size_t FeatureBytes(const vector<Feature> &features);
+
+// Extracted features of one tracker per time step. Up to a byte budget they
+// are kept in memory; the least recently used steps beyond it are spilled to
+// a log and read back when asked for, so memory no longer grows with the
+// length of the run. Records are appended, the log is rewritten without the
+// dead ones once they take more room than the live ones.
+class FeatureHistory {
+public:
+    FeatureHistory() { }
+   ~FeatureHistory();   // removes the spill log
+
+    // 0 bytes keeps everything in memory. The log is only created once
+    // something has to be spilled.
+    void SetBudget(size_t bytes, const string &spillPath);
+    void SetBudget(size_t bytes)    { SetBudget(bytes, spillPath_); }
+
+    void Put(int t, const vector<Feature> &features);
+    void Swap(int t, vector<Feature> &features);    // takes over the content
+
+    // Features of time step t, NULL if it was never stored. Valid until
+    // the next call that stores or pages in another step.
+    const vector<Feature>* Get(int t);
+
+    size_t MemoryBytes() const  { return memoryBytes_; }
+    size_t NumSpilled() const   { return spilled_.size(); }
+    uint64_t LogBytes() const   { return logBytes_; }
+
+private:
+    struct Entry {
+        vector<Feature> features;
+        size_t          bytes;
+        list<int>::iterator lru;
+    };
+
+    Entry& touch(int t);        // find or add t as most recently used
+    void   resize(Entry &e);    // recount its bytes after the features changed
+    void   evict();             // spill least recently used steps down to the budget
+    void   spill(int t, const Entry &e);
+    void   pageIn(int t, Entry &e);
+    void   forget(int t);       // its record in the log is dead from now on
+    void   compact();           // rewrite the log with the live records only
+
+    struct Record {
+        uint64_t offset;
+        uint64_t bytes;
+    };
+
+    unordered_map<int, Entry> memory_;
+    list<int>           lru_;           // front is the most recently used
+    map<int, Record>    spilled_;       // time step -> its record in the log
+    uint64_t            liveBytes_ = 0; // of the records in spilled_
+    size_t              budget_ = 0;
+    size_t              memoryBytes_ = 0;
+
+    string              spillPath_;
+    fstream             log_;
+    uint64_t            logBytes_ = 0;
+};
+
+#endif // FEATUREHISTORY_H
@@ -2,185 +2,571 @@
 
 FeatureTracker::FeatureTracker(vector3i dim) : blockDim_(dim) {
     volumeSize_ = blockDim_.VolumeSize();
-    mask_ = vector<float>(volumeSize_);
-    maskPrev_ = vector<float>(volumeSize_);
 }
 
-FeatureTracker::~FeatureTracker() {
-    if (featureSequence_.size() > 0) {
-        for (auto it = featureSequence_.begin(); it != featureSequence_.end(); it++) {
-            vector<Feature> featureVector = it->second;
-            for (size_t i = 0; i < featureVector.size(); ++i) {
-                Feature f = featureVector[i];
-                f.edgeVoxels.clear();
-                f.bodyVoxels.clear();
+FeatureTracker::~FeatureTracker() {}
+
+void FeatureTracker::SetVolume(const vector<VolumeView>& volumes) {
+    volumes_ = volumes;
+    updateVisibility();
+}
+
+void FeatureTracker::classify() {
+    if (volumes_.empty() || !tf_) return;
+    visible_.Classify(volumes_, blockDim_, tf_->map, predicate_, numThreads_);
+}
+
+void FeatureTracker::updateVisibility() {
+    if (hasNextVisible_) {
+        visible_.Swap(nextVisible_);
+        hasNextVisible_ = false;
+    } else {
+        classify();
+    }
+}
+
+void FeatureTracker::ExtractAllFeatures() {
+    if (numThreads_ > 1) {
+        extractFeaturesParallel();
+    } else {
+        extractFeaturesSerial();
+    }
+}
+
+// Calls func(y, z) for the rows of slab [z0, z1) in scan order, skipping rows
+// of bricks without a visible voxel
+template<class Func>
+static void forEachVisibleRow(const VisibilityMask &visible, const vector3i &dim, int z0, int z1, Func func) {
+    const int brick = VisibilityMask::BRICK_SIZE;
+    for (int z = z0; z < z1; z++) {
+        for (int y0 = 0; y0 < dim.y; y0 += brick) {
+            int y1 = std::min(y0 + brick, dim.y);
+            if (!visible.AnyVisible(vector3i(0, y0, z), vector3i(dim.x-1, y1-1, z))) continue;
+            for (int y = y0; y < y1; y++) {
+                func(y, z);
             }
         }
     }
 }
 
-void FeatureTracker::ExtractAllFeatures() {
-    for (int z = 0; z < blockDim_.z; z++) {
-        for (int y = 0; y < blockDim_.y; y++) {
-            for (int x = 0; x < blockDim_.x; x++) {
-                int index = GetVoxelIndex(vector3i(x, y, z));
-                if (mask_[index] > 0) continue; // point already within a feature
-                int tfIndex = (int)(data_[index] * (tfRes_-1));
-                if (tfMap_[tfIndex] >= OPACITY_THRESHOLD) {
-                    FindNewFeature(vector3i(x,y,z));
+void FeatureTracker::extractFeaturesSerial() {
+    bool found = false;
+    vector<vector3i> rejected;      // labeled until the scan is done, so they are not seeded again
+    forEachVisibleRow(visible_, blockDim_, 0, blockDim_.z, [&](int y, int z) {
+        int row = GetVoxelIndex(vector3i(0, y, z));
+        util::forEachSetBit(visible_.Bits(), row, row + blockDim_.x, [&](int index) {
+            if (mask_.Get(index) > 0) return;   // already within a feature
+            found |= growFeature(vector3i(index - row, y, z), rejected);
+        });
+    });
+    for (size_t i = 0; i < rejected.size(); ++i) {
+        mask_.Set(GetVoxelIndex(rejected[i]), 0);
+    }
+    if (found) {
+        startMotion();
+    }
+}
+
+// Union-find over linear voxel indices. Roots are always linked towards the
+// smaller index, so the root of a component is its first voxel in scan order,
+// which is the seed the serial extraction would have started from.
+static inline int findRoot(vector<int> &parent, int i) {
+    int root = i;
+    while (parent[root] != root) { root = parent[root]; }
+    while (parent[i] != root) { int next = parent[i]; parent[i] = root; i = next; }
+    return root;
+}
+
+static inline int findRootConst(const vector<int> &parent, int i) {
+    while (parent[i] != i) { i = parent[i]; }
+    return i;
+}
+
+static inline void unite(vector<int> &parent, int a, int b) {
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if (a < b) { parent[b] = a; } else if (b < a) { parent[a] = b; }
+}
+
+struct Component {
+    vector<vector3i> voxels;
+    vector3i         sum;
+    int              maskValue;
+    bool             isFeature;
+    bool             hasInterior;
+    vector3i         interior;
+};
+
+void FeatureTracker::extractFeaturesParallel() {
+    const int sliceSize = blockDim_.x * blockDim_.y;
+
+    // 1. candidates are visible and not yet in a feature, only their parent
+    //    entries are ever read; label them per z-slab
+    vector<uint64_t> candidates(visible_.Bits(), visible_.Bits() + (volumeSize_+63)/64);
+    mask_.ForEach([&](int index, int) { candidates[index >> 6] &= ~(1ULL << (index & 63)); });
+    auto isCandidate = [&](int index) { return (candidates[index >> 6] >> (index & 63)) & 1; };
+
+    vector<int> &parent = parent_;
+    parent.resize(volumeSize_);
+    vector<int> slabStart(numThreads_, 0);
+    util::parallelFor(0, blockDim_.z, numThreads_, [&](int k, int z0, int z1) {
+        slabStart[k] = z0;
+        forEachVisibleRow(visible_, blockDim_, z0, z1, [&](int y, int z) {
+            int row = GetVoxelIndex(vector3i(0, y, z));
+            util::forEachSetBit(candidates.data(), row, row + blockDim_.x, [&](int index) {
+                parent[index] = index;
+                if (index > row && isCandidate(index-1))           { unite(parent, index, index-1); }
+                if (y > 0  && isCandidate(index-blockDim_.x))       { unite(parent, index, index-blockDim_.x); }
+                if (z > z0 && isCandidate(index-sliceSize))         { unite(parent, index, index-sliceSize); }
+            });
+        });
+    });
+
+    // 2. merge components across slab boundaries
+    for (size_t k = 1; k < slabStart.size(); ++k) {
+        if (slabStart[k] <= 0) continue;
+        int first = slabStart[k] * sliceSize;
+        util::forEachSetBit(candidates.data(), first, first + sliceSize, [&](int index) {
+            if (isCandidate(index-sliceSize)) {
+                unite(parent, index, index-sliceSize);
+            }
+        });
+    }
+
+    // 3. gather voxels of each component per slab, keyed by root (seed) index
+    vector<unordered_map<int, Component> > partials(numThreads_);
+    util::parallelFor(0, blockDim_.z, numThreads_, [&](int k, int z0, int z1) {
+        forEachVisibleRow(visible_, blockDim_, z0, z1, [&](int y, int z) {
+            int row = GetVoxelIndex(vector3i(0, y, z));
+            util::forEachSetBit(candidates.data(), row, row + blockDim_.x, [&](int index) {
+                Component &c = partials[k][findRootConst(parent, index)];
+                c.voxels.push_back(vector3i(index - row, y, z));
+                c.sum += vector3i(index - row, y, z);
+            });
+        });
+    });
+
+    map<int, Component> components;    // ordered by seed index, i.e. serial scan order
+    for (size_t k = 0; k < partials.size(); ++k) {
+        for (auto it = partials[k].begin(); it != partials[k].end(); ++it) {
+            Component &c = components[it->first];
+            c.voxels.insert(c.voxels.end(), it->second.voxels.begin(), it->second.voxels.end());
+            c.sum += it->second.sum;
+        }
+        partials[k].clear();
+    }
+
+    // 4. hand out mask values exactly as FindNewFeature does: components that
+    //    are too small give the value back and stay unlabeled, and a lone
+    //    voxel is never a feature since region growing only labels neighbors
+    vector<Component*> order;
+    for (auto it = components.begin(); it != components.end(); ++it) {
+        Component &c = it->second;
+        c.maskValue = globalMaskValue_ + 1;
+        c.isFeature = c.voxels.size() >= (size_t)minNumVoxels_ && c.voxels.size() > 1;
+        if (!c.isFeature) continue;
+        globalMaskValue_ = c.maskValue;
+
+        // every voxel is reached from an already labeled neighbor and stays on
+        // the edge list, except the seed's first grown neighbor: the seed is
+        // still unlabeled when it is visited, so it is interior unless one of
+        // its neighbors is invisible or belongs to another feature
+        vector3i seed = c.voxels.front(), first = seed;
+        if (seed.x+1 < blockDim_.x && isCandidate(it->first+1)) {
+            first.x++;
+        } else if (seed.y+1 < blockDim_.y && isCandidate(it->first+blockDim_.x)) {
+            first.y++;
+        } else {
+            first.z++;
+        }
+        c.interior = first;
+        c.hasInterior = !(isBlocked(candidates, first + vector3i(1,0,0)) || isBlocked(candidates, first - vector3i(1,0,0)) ||
+                          isBlocked(candidates, first + vector3i(0,1,0)) || isBlocked(candidates, first - vector3i(0,1,0)) ||
+                          isBlocked(candidates, first + vector3i(0,0,1)) || isBlocked(candidates, first - vector3i(0,0,1)));
+        order.push_back(&c);
+    }
+
+    // 5. build features, components are independent
+    vector<Feature> features(order.size());
+    util::parallelFor(0, (int)order.size(), numThreads_, [&](int, int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            const Component &c = *order[i];
+            Feature &f = features[i];
+            f.id        = 0;
+            f.centroid  = c.sum;
+            f.maskValue = c.maskValue;
+            f.bodyVoxels.reserve(c.voxels.size());
+            f.edgeVoxels.reserve(c.voxels.size());
+            for (size_t j = 0; j < c.voxels.size(); ++j) {
+                f.bodyVoxels.insert(c.voxels[j]);
+                if (!c.hasInterior || c.voxels[j] != c.interior) {
+                    f.edgeVoxels.push_back(c.voxels[j]);
                 }
             }
         }
+    });
+
+    // the sparse mask is not safe for concurrent inserts, label serially
+    for (size_t i = 0; i < order.size(); ++i) {
+        const Component &c = *order[i];
+        for (size_t j = 0; j < c.voxels.size(); ++j) {
+            mask_.Set(GetVoxelIndex(c.voxels[j]), c.maskValue);
+        }
+        currentFeatures_.push_back(std::move(features[i]));
+    }
+
+    if (!order.empty()) {
+        startMotion();
+    }
+}
+
+inline bool FeatureTracker::isBlocked(const vector<uint64_t> &candidates, const vector3i &v) {
+    if (v.x < 0 || v.y < 0 || v.z < 0 || v.x >= blockDim_.x || v.y >= blockDim_.y || v.z >= blockDim_.z) {
+        return false;
     }
+    int index = GetVoxelIndex(v);
+    return ((candidates[index >> 6] >> (index & 63)) & 1) == 0;
 }
 
 void FeatureTracker::FindNewFeature(vector3i seed) {
+    vector<vector3i> rejected;
+    if (growFeature(seed, rejected)) {
+        startMotion();
+    }
+    for (size_t i = 0; i < rejected.size(); ++i) {
+        mask_.Set(GetVoxelIndex(rejected[i]), 0);
+    }
+}
+
+bool FeatureTracker::growFeature(const vector3i &seed, vector<vector3i> &rejected) {
     Feature f; {
         f.id         = 0;
         f.centroid   = vector3i();
-        f.edgeVoxels = list<vector3i>();
-        f.bodyVoxels = list<vector3i>();
-        f.maskValue  = globalMaskValue_ += 1.0f;
+        f.edgeVoxels = vector<vector3i>();
+        f.bodyVoxels = VoxelSet();
+        f.maskValue  = ++globalMaskValue_;
     }
 
     f.edgeVoxels.push_back(seed);
     expandRegion(f);
 
-    if (f.bodyVoxels.size() < (size_t)MIN_NUM_VOXEL_IN_FEATURE) {
-        globalMaskValue_ -= 1.0f; return;
+    if (f.bodyVoxels.size() < (size_t)minNumVoxels_) {
+        rejected.insert(rejected.end(), f.bodyVoxels.begin(), f.bodyVoxels.end());
+        globalMaskValue_--; return false;
     }
 
-    currentFeatures_.push_back(f);
-    backup1Features_ = currentFeatures_;
-    backup2Features_ = currentFeatures_;
-    backup3Features_ = currentFeatures_;
+    currentFeatures_.push_back(std::move(f));
+    return true;
+}
+
+// New features are appended, everything before them already has a history
+void FeatureTracker::startMotion() {
+    size_t first = motion_.size();
+    motion_.resize(currentFeatures_.size());
+    for (size_t i = first; i < currentFeatures_.size(); ++i) {
+        motion_[i].Push(summarize(currentFeatures_[i]));
+    }
 }
 
-void FeatureTracker::TrackFeature(float* pData, int direction, int mode) {
-    if (tfMap_.size() == 0 || tfRes_ <= 0) {
+MotionSummary FeatureTracker::summarize(const Feature &f) {
+    MotionSummary s;
+    s.numVoxels = (int)f.bodyVoxels.size();
+    s.lo = blockDim_;
+    s.hi = vector3i(-1, -1, -1);
+    vector3f sum;
+    for (VoxelSet::const_iterator p = f.bodyVoxels.begin(); p != f.bodyVoxels.end(); ++p) {
+        sum += vector3f(p->x, p->y, p->z);
+        s.lo = vector3i(std::min(s.lo.x, p->x), std::min(s.lo.y, p->y), std::min(s.lo.z, p->z));
+        s.hi = vector3i(std::max(s.hi.x, p->x), std::max(s.hi.y, p->y), std::max(s.hi.z, p->z));
+    }
+    s.centroid = s.numVoxels > 0 ? sum / (float)s.numVoxels : sum;
+    return s;
+}
+
+void FeatureTracker::TrackFeature(const vector<VolumeView>& volumes, int direction, int mode) {
+    if (!tf_ || tf_->map.empty()) {
         cout << "Set TF pointer first." << endl; exit(3);
     }
 
-    data_.assign(pData, pData+volumeSize_);
+    volumes_ = volumes;
+    updateVisibility();
 
     // save current 0-1 matrix to previous, then clear current maxtrix
-    maskPrev_ = mask_;
-    std::fill(mask_.begin(), mask_.end(), 0.0f);
+    maskPrev_.Swap(mask_);
+    mask_.Clear();
+
+    // turning around, the motion so far points the wrong way
+    if (direction != lastDirection_) {
+        for (size_t i = 0; i < motion_.size(); ++i) {
+            motion_[i].Truncate(1);
+        }
+        lastDirection_ = direction;
+    }
 
+    set<int> vanished;
     for (size_t i = 0; i < currentFeatures_.size(); ++i) {
-        Feature f = currentFeatures_[i];
+        Feature &f = currentFeatures_[i];     // grown in place
 
-        vector3i offset = predictRegion(i, direction, mode);
+        vector3i offset = predictRegion(i, mode);
+
+        // the region is grown from the voxels of its predicted box only, with
+        // none of them visible the feature is gone without touching them
+        const MotionSummary &last = motion_[i].Back();
+        if (!visible_.AnyVisible(last.lo + offset, last.hi + offset)) {
+            vanished.insert(f.maskValue);
+            continue;
+        }
+
+        if (offset != vector3i()) {
+            shiftRegion(f, offset);
+        }
         fillRegion(f, offset);
-        shrinkRegion(f);
-        expandRegion(f);
+        counters_.voxelsShrunk += shrinkRegion(f);
+        counters_.voxelsExpanded += expandRegion(f);
 
         if (f.bodyVoxels.empty()) {
-            // todo f.numVoxels < MIN_NUM_VOXEL_IN_FEATURE
-            // currentFeaturesHolder.erase(currentFeaturesHolder.begin()+i);
+            vanished.insert(f.maskValue);   // nothing left to track it from
             continue;
         }
 
         f.centroid /= f.bodyVoxels.size();
         f.id = GetVoxelIndex(f.centroid);
-        currentFeatures_[i] = f;
     }
 
-    backupFeatureInfo(direction);
+    if (!vanished.empty()) {
+        DropFeatures(vanished);
+    }
+    splitFeatures();
+    backupFeatureInfo();
     ExtractAllFeatures();
 }
 
-inline vector3i FeatureTracker::predictRegion(int index, int direction, int mode) {
-    int timestepsAvailable = direction == FT_BACKWARD ? timeLeft2Backward_ : timeLeft2Forward_;
-
-    vector3i off;   // offset
-    Feature b1f = backup1Features_[index];
-    Feature b2f = backup2Features_[index];
-    Feature b3f = backup3Features_[index];
-
-    int tmp;
-    switch (mode) {
-        case FT_DIRECT: // PREDICT_DIRECT
-            break;
-        case FT_LINEAR: // PREDICT_LINEAR
-            if (timestepsAvailable > 1) {
-                if (direction == FT_BACKWARD) {
-                    off = b2f.centroid - b1f.centroid;
-                } else {  // Tracking forward as default
-                    off = b3f.centroid - b2f.centroid;
-                }
-                for (list<vector3i>::iterator p = b3f.edgeVoxels.begin(); p != b3f.edgeVoxels.end(); p++) {
-                    tmp = (*p).x + (int)floor(off.x); (*p).x = tmp <= 0 ? 0 : (tmp < blockDim_.x ? tmp : blockDim_.x-1);
-                    tmp = (*p).y + (int)floor(off.y); (*p).y = tmp <= 0 ? 0 : (tmp < blockDim_.y ? tmp : blockDim_.y-1);
-                    tmp = (*p).z + (int)floor(off.z); (*p).z = tmp <= 0 ? 0 : (tmp < blockDim_.z ? tmp : blockDim_.z-1);
-                }
+void FeatureTracker::SaveState(TrackerState &state) const {
+    state.currentFeatures   = currentFeatures_;
+    state.motion            = motion_;
+    state.mask              = mask_;
+    state.maskPrev          = maskPrev_;
+    state.globalMaskValue   = globalMaskValue_;
+    state.lastDirection     = lastDirection_;
+}
+
+void FeatureTracker::RestoreState(const TrackerState &state) {
+    currentFeatures_   = state.currentFeatures;
+    motion_            = state.motion;
+    mask_              = state.mask;
+    maskPrev_          = state.maskPrev;
+    globalMaskValue_   = state.globalMaskValue;
+    lastDirection_     = state.lastDirection;
+}
+
+void FeatureTracker::DropFeatures(const set<int> &maskValues) {
+    size_t kept = 0;
+    for (size_t i = 0; i < currentFeatures_.size(); ++i) {
+        const Feature &f = currentFeatures_[i];
+        if (maskValues.count(f.maskValue) > 0) {
+            for (VoxelSet::const_iterator p = f.bodyVoxels.begin(); p != f.bodyVoxels.end(); ++p) {
+                int index = GetVoxelIndex(*p);
+                if (mask_.Get(index) == f.maskValue) mask_.Set(index, 0);
             }
-        break;
-        case FT_POLYNO: // PREDICT_POLY
-            if (timestepsAvailable > 1) {
-                if (timestepsAvailable > 2) {
-                    off = b3f.centroid*2 - b2f.centroid*3 + b1f.centroid;
-                } else {    // [1,2)
-                    if (direction == FT_BACKWARD) {
-                        off = b2f.centroid - b1f.centroid;
-                    } else {  // Tracking forward as default
-                        off = b3f.centroid - b2f.centroid;
-                    }
+            continue;
+        }
+        if (kept != i) {
+            currentFeatures_[kept] = std::move(currentFeatures_[i]);
+            motion_[kept] = motion_[i];
+        }
+        kept++;
+    }
+    currentFeatures_.resize(kept);
+    motion_.resize(kept);
+}
+
+// Region growing keeps one label for a feature that broke apart, each piece
+// that does not touch the others is told apart here. The largest piece keeps
+// the feature, the others become new features if they are big enough and
+// are unlabeled if not.
+void FeatureTracker::splitFeatures() {
+    static const vector3i neighbors[6] = {
+        vector3i(1, 0, 0), vector3i(0, 1, 0), vector3i(0, 0, 1),
+        vector3i(-1, 0, 0), vector3i(0, -1, 0), vector3i(0, 0, -1)
+    };
+
+    vector<Feature> split;
+    IndexMap<int> pieceOf;              // voxel index -> piece of the feature
+    vector<vector<vector3i> > pieces;
+    for (size_t i = 0; i < currentFeatures_.size(); ++i) {
+        Feature &f = currentFeatures_[i];
+        pieceOf.clear();
+        pieces.clear();
+        for (VoxelSet::const_iterator p = f.bodyVoxels.begin(); p != f.bodyVoxels.end(); ++p) {
+            if (pieceOf.find(GetVoxelIndex(*p)) != NULL) continue;
+            int k = (int)pieces.size();
+            pieces.push_back(vector<vector3i>(1, *p));
+            pieceOf.set(GetVoxelIndex(*p), k);
+            vector<vector3i> &piece = pieces.back();
+            for (size_t j = 0; j < piece.size(); ++j) {
+                for (int n = 0; n < 6; ++n) {
+                    vector3i v = piece[j] + neighbors[n];
+                    if (v.x < 0 || v.y < 0 || v.z < 0 || v.x >= blockDim_.x || v.y >= blockDim_.y || v.z >= blockDim_.z) continue;
+                    int index = GetVoxelIndex(v);
+                    if (mask_.Get(index) != f.maskValue || pieceOf.find(index) != NULL) continue;
+                    pieceOf.set(index, k);
+                    piece.push_back(v);
                 }
-                for (list<vector3i>::iterator p = b3f.edgeVoxels.begin(); p != b3f.edgeVoxels.end(); p++) {
-                    tmp = (*p).x + (int)floor(off.x); (*p).x = tmp <= 0 ? 0 : (tmp < blockDim_.x ? tmp : blockDim_.x-1);
-                    tmp = (*p).y + (int)floor(off.y); (*p).y = tmp <= 0 ? 0 : (tmp < blockDim_.y ? tmp : blockDim_.y-1);
-                    tmp = (*p).z + (int)floor(off.z); (*p).z = tmp <= 0 ? 0 : (tmp < blockDim_.z ? tmp : blockDim_.z-1);
+            }
+        }
+        if (pieces.size() < 2) continue;
+
+        // the body is in growth order, which differs between the serial and
+        // the parallel extraction; put the pieces in scan order so both hand
+        // out the same mask values
+        auto before = [&](const vector3i &a, const vector3i &b) { return GetVoxelIndex(a) < GetVoxelIndex(b); };
+        for (size_t k = 0; k < pieces.size(); ++k) {
+            std::sort(pieces[k].begin(), pieces[k].end(), before);
+        }
+        std::sort(pieces.begin(), pieces.end(), [&](const vector<vector3i> &a, const vector<vector3i> &b) {
+            return before(a.front(), b.front());
+        });
+        for (size_t k = 0; k < pieces.size(); ++k) {
+            for (size_t j = 0; j < pieces[k].size(); ++j) {
+                pieceOf.set(GetVoxelIndex(pieces[k][j]), (int)k);
+            }
+        }
+
+        size_t largest = 0;
+        for (size_t k = 1; k < pieces.size(); ++k) {
+            if (pieces[k].size() > pieces[largest].size()) largest = k;
+        }
+
+        // new features in the order of their pieces, -1 for unlabeled ones
+        vector<int> target(pieces.size(), -1);
+        for (size_t k = 0; k < pieces.size(); ++k) {
+            if (k == largest || pieces[k].size() < (size_t)minNumVoxels_) continue;
+            target[k] = (int)split.size();
+            split.push_back(Feature());
+            Feature &piece = split.back();
+            piece.id        = 0;
+            piece.maskValue = ++globalMaskValue_;
+            piece.centroid  = vector3i();
+        }
+
+        vector<vector3i> edge;
+        for (size_t j = 0; j < f.edgeVoxels.size(); ++j) {
+            const int *k = pieceOf.find(GetVoxelIndex(f.edgeVoxels[j]));
+            if (k == NULL || *k == (int)largest) {
+                edge.push_back(f.edgeVoxels[j]);
+            } else if (target[*k] >= 0) {
+                split[target[*k]].edgeVoxels.push_back(f.edgeVoxels[j]);
+            }
+        }
+        f.edgeVoxels.swap(edge);
+
+        for (size_t k = 0; k < pieces.size(); ++k) {
+            Feature *owner = k == largest ? &f : target[k] >= 0 ? &split[target[k]] : NULL;
+            if (owner == NULL) {
+                for (size_t j = 0; j < pieces[k].size(); ++j) {
+                    mask_.Set(GetVoxelIndex(pieces[k][j]), 0);
                 }
+                continue;
             }
-        break;
+            VoxelSet body;
+            body.reserve(pieces[k].size());
+            vector3i sum;
+            for (size_t j = 0; j < pieces[k].size(); ++j) {
+                body.insert(pieces[k][j]);
+                sum += pieces[k][j];
+                if (owner != &f) mask_.Set(GetVoxelIndex(pieces[k][j]), owner->maskValue);
+            }
+            owner->bodyVoxels.swap(body);
+            owner->centroid = sum;
+            owner->centroid /= pieces[k].size();
+            owner->id = GetVoxelIndex(owner->centroid);
+        }
+    }
+
+    // pieces start their motion history with this step
+    for (size_t i = 0; i < split.size(); ++i) {
+        currentFeatures_.push_back(std::move(split[i]));
     }
+    motion_.resize(currentFeatures_.size());
+}
+
+inline vector3i FeatureTracker::predictRegion(int index, int mode) {
+    const FeatureMotion &motion = motion_[index];
+    const MotionSummary &last = motion.Back();
+    vector3f move = GetPredictor<MOTION_HISTORY_DEPTH>(mode).Predict(motion) - last.centroid;
+
+    // the whole bounding box stays inside the block, so no voxel is clamped
+    // onto another one at a face
+    vector3i off(util::round(move.x), util::round(move.y), util::round(move.z));
+    off.x = std::max(-last.lo.x, std::min(off.x, blockDim_.x-1 - last.hi.x));
+    off.y = std::max(-last.lo.y, std::min(off.y, blockDim_.y-1 - last.hi.y));
+    off.z = std::max(-last.lo.z, std::min(off.z, blockDim_.z-1 - last.hi.z));
     return off;
 }
 
+inline void FeatureTracker::shiftRegion(Feature &f, const vector3i &offset) {
+    for (vector<vector3i>::iterator p = f.edgeVoxels.begin(); p != f.edgeVoxels.end(); p++) {
+        *p += offset;
+    }
+    VoxelSet body;
+    body.reserve(f.bodyVoxels.size());
+    for (VoxelSet::const_iterator p = f.bodyVoxels.begin(); p != f.bodyVoxels.end(); ++p) {
+        body.insert(*p + offset);
+    }
+    f.bodyVoxels.swap(body);
+    f.centroid += offset * (float)f.bodyVoxels.size();
+}
+
 inline void FeatureTracker::fillRegion(Feature &f, const vector3i &offset) {
     // predicted to be on edge
-    for (list<vector3i>::iterator p = f.edgeVoxels.begin(); p != f.edgeVoxels.end(); p++) {
+    for (vector<vector3i>::iterator p = f.edgeVoxels.begin(); p != f.edgeVoxels.end(); p++) {
         int index = GetVoxelIndex(*p);
-        if (mask_[index] == 0) {
-            mask_[index] = f.maskValue;
+        if (mask_.Get(index) == 0) {
+            mask_.Set(index, f.maskValue);
+        }
+        if (f.bodyVoxels.insert(*p)) {
+            f.centroid += (*p);
         }
-        f.bodyVoxels.push_back(*p);
-        f.centroid += (*p);
     }
 
     // currently not on edge but previously on edge
-    for (list<vector3i>::iterator p = f.edgeVoxels.begin(); p != f.edgeVoxels.end(); p++) {
+    for (vector<vector3i>::iterator p = f.edgeVoxels.begin(); p != f.edgeVoxels.end(); p++) {
         int index = GetVoxelIndex(*p);
         int indexPrev = GetVoxelIndex((*p)-offset);
         while ((*p).x >= 0 && (*p).x <= blockDim_.x && (*p).x - offset.x >= 0 && (*p).x - offset.x <= blockDim_.x &&
                (*p).y >= 0 && (*p).y <= blockDim_.y && (*p).y - offset.y >= 0 && (*p).y - offset.y <= blockDim_.y &&
                (*p).z >= 0 && (*p).z <= blockDim_.z && (*p).z - offset.z >= 0 && (*p).z - offset.z <= blockDim_.z &&
-               mask_[index] == 0 && maskPrev_[indexPrev] == f.maskValue) {
+               mask_.Get(index) == 0 && maskPrev_.Get(indexPrev) == f.maskValue) {
 
             // Mark all points: 1. currently = 1; 2. currently = 0 but previously = 1;
-            mask_[index] = f.maskValue;
-            f.bodyVoxels.push_back(*p);
-            f.centroid += (*p);
+            mask_.Set(index, f.maskValue);
+            if (f.bodyVoxels.insert(*p)) {
+                f.centroid += (*p);
+            }
         }
     }
 }
 
-inline void FeatureTracker::shrinkRegion(Feature &f) {
-    // mark all edge points as 0
-    while (f.edgeVoxels.empty() == false) {
-        vector3i seed = f.edgeVoxels.front();
-        f.edgeVoxels.pop_front();
-        shrinkEdge(f, seed);
+inline int FeatureTracker::shrinkRegion(Feature &f) {
+    // mark all edge points as 0, they stay in the body set and are re-evaluated below
+    for (vector<vector3i>::iterator p = f.edgeVoxels.begin(); p != f.edgeVoxels.end(); p++) {
+        int index = GetVoxelIndex(*p);
+        if (mask_.Get(index) == f.maskValue) {
+            mask_.Set(index, 0);
+            f.centroid -= (*p);
+        }
     }
+    f.edgeVoxels.clear();
 
+    int visited = 0;
     while (!f.bodyVoxels.empty()) {
-        vector3i seed = f.bodyVoxels.front();
-        f.bodyVoxels.pop_front();
+        visited++;
+        vector3i seed = f.bodyVoxels.back();
+        f.bodyVoxels.pop_back();
 
         int index = GetVoxelIndex(seed);
         bool seedOnEdge = false;
-        if (getOpacity(data_[index]) < OPACITY_THRESHOLD) {
+        if (!isVisible(index)) {
             seedOnEdge = false;
             // if point is invisible, mark its adjacent points as 0
             shrinkEdge(f, seed);                                            // center
@@ -190,37 +576,38 @@ inline void FeatureTracker::shrinkRegion(Feature &f) {
             if (--seed.x >= 0)          { shrinkEdge(f, seed); } seed.x++;   // left
             if (--seed.y >= 0)          { shrinkEdge(f, seed); } seed.y++;   // bottom
             if (--seed.z >= 0)          { shrinkEdge(f, seed); } seed.z++;   // front
-        } else if (mask_[index] == 0.0f) { seedOnEdge = true; }
+        } else if (mask_.Get(index) == 0) { seedOnEdge = true; }
 
         if (seedOnEdge) { f.edgeVoxels.push_back(seed); }
     }
 
-    for (list<vector3i>::iterator p = f.edgeVoxels.begin(); p != f.edgeVoxels.end(); p++) {
+    for (vector<vector3i>::iterator p = f.edgeVoxels.begin(); p != f.edgeVoxels.end(); p++) {
         int index = GetVoxelIndex(*p);
-        if (mask_[index] != f.maskValue) {
-            mask_[index] = f.maskValue;
-            f.bodyVoxels.push_back(*p);
-            f.centroid += (*p);
+        if (mask_.Get(index) != f.maskValue) {
+            mask_.Set(index, f.maskValue);
+            if (f.bodyVoxels.insert(*p)) {
+                f.centroid += (*p);
+            }
         }
     }
+    return visited;
 }
 
 inline void FeatureTracker::shrinkEdge(Feature &f, const vector3i &seed) {
     int index = GetVoxelIndex(seed);
-    if (mask_[index] == f.maskValue) {
-        mask_[index] = 0;  // shrink
-        list<vector3i>::iterator p = find(f.bodyVoxels.begin(), f.bodyVoxels.end(), seed);
-        f.bodyVoxels.erase(p);
+    if (mask_.Get(index) == f.maskValue) {
+        mask_.Set(index, 0);  // shrink
+        f.bodyVoxels.erase(seed);   // O(1), may already be drained by shrinkRegion
         f.edgeVoxels.push_back(seed);
         f.centroid -= seed;
     }
 }
 
-inline void FeatureTracker::expandRegion(Feature &f) {
-    list<vector3i> tempVoxels;    // to store updated edge voxels
-    while (!f.edgeVoxels.empty()) {
-        vector3i seed = f.edgeVoxels.front();
-        f.edgeVoxels.pop_front();
+inline int FeatureTracker::expandRegion(Feature &f) {
+    vector<vector3i> tempVoxels;  // to store updated edge voxels
+    // expandEdge appends newly grown voxels, so the edge list is walked as a queue
+    for (size_t i = 0; i < f.edgeVoxels.size(); ++i) {
+        vector3i seed = f.edgeVoxels[i];
         bool seedOnEdge = false;
         if (++seed.x < blockDim_.x) { seedOnEdge |= expandEdge(f, seed); } seed.x--;  // right
         if (++seed.y < blockDim_.y) { seedOnEdge |= expandEdge(f, seed); } seed.y--;  // top
@@ -234,7 +621,9 @@ inline void FeatureTracker::expandRegion(Feature &f) {
         if (seedOnEdge)            { tempVoxels.push_back(seed); }
     }
 
+    int visited = (int)f.edgeVoxels.size();
     f.edgeVoxels.swap(tempVoxels);
+    return visited;
 }
 
 inline bool FeatureTracker::expandEdge(Feature &f, const vector3i &seed) {
@@ -242,29 +631,21 @@ inline bool FeatureTracker::expandEdge(Feature &f, const vector3i &seed) {
 
     // this neighbor voxel is already labeled, or the opacity is not large enough to
     // to be labeled as within the feature, so the original seed is still on edge.
-    if (mask_[index] > 0 || getOpacity(data_[index]) < OPACITY_THRESHOLD) {
+    if (!isVisible(index) || mask_.Get(index) > 0) {
         return true;
     }
 
-    mask_[index] = f.maskValue;
+    mask_.Set(index, f.maskValue);
     f.edgeVoxels.push_back(seed);
-    f.bodyVoxels.push_back(seed);
+    f.bodyVoxels.insert(seed);
     f.centroid += seed;
 
     // the original seed is no longer on edge for this neighboring direction
     return false;
 }
 
-void FeatureTracker::backupFeatureInfo(int direction) {
-    backup1Features_ = backup2Features_;
-    backup2Features_ = backup3Features_;
-    backup3Features_ = currentFeatures_;
-
-    if (direction == FT_FORWARD) {
-        if (timeLeft2Forward_  < 3) timeLeft2Forward_++;
-        if (timeLeft2Backward_ > 0) timeLeft2Backward_--;
-    } else {    // direction is either FORWARD or BACKWARD
-        if (timeLeft2Forward_  > 0) timeLeft2Forward_--;
-        if (timeLeft2Backward_ < 3) timeLeft2Backward_++;
+void FeatureTracker::backupFeatureInfo() {
+    for (size_t i = 0; i < currentFeatures_.size(); ++i) {
+        motion_[i].Push(summarize(currentFeatures_[i]));
     }
 }
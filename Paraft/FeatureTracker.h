@@ -2,15 +2,35 @@
 #define FEATURETRACKER_H
 
 #include "Utils.h"
+#include "VisibilityMask.h"
+#include "FeatureHistory.h"
+#include "MotionHistory.h"
+#include "Profile.h"
 
 using namespace std;
 
+typedef MotionRing<MOTION_HISTORY_DEPTH> FeatureMotion;
+
+// Everything tracking carries over from one time step to the next. The
+// visibility mask is left out, it is rebuilt from the data of that step.
+struct TrackerState {
+    vector<Feature> currentFeatures;
+    vector<FeatureMotion> motion;
+    SparseMask      mask;
+    SparseMask      maskPrev;
+    int             globalMaskValue;
+    int             lastDirection;
+};
+
 class FeatureTracker {
 
 public:
     FeatureTracker(vector3i dim);
    ~FeatureTracker();
 
+    // Extract features from all visible voxels not yet covered by a feature.
+    // With more than one thread, components are labeled slab-parallel and
+    // produce the same features and mask values as the serial scan.
     void ExtractAllFeatures();
 
     // Set seed at current time step. FindNewFeature will do three things :
@@ -19,49 +39,102 @@ public:
     // 3. Adding edge points into the edge list
     void FindNewFeature(vector3i seed);
 
-    // Track forward based on the center points of the features at the last time step
-    void TrackFeature(float* pData, int direction, int mode);
-    void SaveExtractedFeatures(int index)       { featureSequence_[index] = currentFeatures_; }
-    void SetDataPtr(float* pData)               { data_.assign(pData, pData+volumeSize_); }
-    void SetTFRes(int res)                      { tfRes_ = res; }
-    void SetTFMap(float* map)                   { tfMap_.assign(map, map+tfRes_); }
-    float* GetMaskPtr()                         { return mask_.data(); }
-    int GetTFResolution()                       { return tfRes_; }
+    // Track forward based on the center points of the features at the last time step.
+    // mode picks the predictor moving each feature before its region is grown:
+    // FT_DIRECT, FT_LINEAR, FT_POLYNO, FT_LEASTSQ or FT_KALMAN
+    // volumes holds the primary variable first, then the extra ones of the predicate.
+    void TrackFeature(const vector<VolumeView>& volumes, int direction, int mode);
+    // Stop tracking the features with the given mask values and clear their
+    // labels, so the mask only holds features that are tracked
+    void DropFeatures(const set<int>& maskValues);
+
+    void SaveExtractedFeatures(int index)       { featureSequence_.Put(index, currentFeatures_); }
+    void RestoreExtractedFeatures(int index, vector<Feature>& features) { featureSequence_.Swap(index, features); }
+    // Keep at most bytes of extracted features in memory, older time steps
+    // go to spillPath and are read back by GetFeatureVectorPointer. Without
+    // a path the spill file stays as set before.
+    void SetHistoryBudget(size_t bytes, const string& spillPath) { featureSequence_.SetBudget(bytes, spillPath); }
+    void SetHistoryBudget(size_t bytes)                           { featureSequence_.SetBudget(bytes); }
+    void SetVolume(const vector<VolumeView>& volumes);
+    // Visibility of the volumes passed next to SetVolume or TrackFeature, filled
+    // by the caller, e.g. together with other predicates in one pass. They take
+    // it over instead of classifying on their own.
+    VisibilityMask& NextVisibility()            { hasNextVisible_ = true; return nextVisible_; }
+    void SetPredicate(const FeaturePredicate& p) { predicate_ = p; }
+    // TF for classifying the volumes passed from now on. The visibility of the
+    // current volumes was built with the TF of their own time step and stays.
+    void SetTF(const shared_ptr<const TransferFunction>& tf) { tf_ = tf; }
+    void SetNumThreads(int n)                   { numThreads_ = n > 0 ? n : 1; }
+    void SetMinNumVoxels(int n)                 { minNumVoxels_ = n; }
+    const SparseMask& GetMask()                 { return mask_; }
+    const SparseMask& GetPrevMask()             { return maskPrev_; }
+    int GetTFResolution()                       { return tf_ ? (int)tf_->map.size() : 0; }
     int GetVoxelIndex(const vector3i &v)        { return blockDim_.x*blockDim_.y*v.z+blockDim_.x*v.y+v.x; }
+    bool IsVisible(const vector3i &v)           { return isVisible(GetVoxelIndex(v)); }
+
+    // Snapshot of the tracking state, restored to resume from that time step
+    void SaveState(TrackerState& state) const;
+    void RestoreState(const TrackerState& state);
+
+    // Get all features information of the given time step, NULL if it was
+    // never saved. Valid until features of another step are saved or asked for
+    const vector<Feature>* GetFeatureVectorPointer(int index) { return featureSequence_.Get(index); }
+
+    // Features at the current time step, before SaveExtractedFeatures too
+    const vector<Feature>& GetCurrentFeatures() { return currentFeatures_; }
 
-    // Get all features information of current time step
-    vector<Feature>* GetFeatureVectorPointer(int index) { return &featureSequence_[index]; }
+    // Centroid, bounding box and size of the current features at their latest
+    // step, in the order of the features saved by SaveExtractedFeatures
+    const vector<FeatureMotion>& GetMotion()    { return motion_; }
+
+    // What was counted since the last call, the counters start over
+    TrackerCounters TakeCounters()              { TrackerCounters c = counters_; counters_ = TrackerCounters(); return c; }
 
 private:
-    vector3i predictRegion(int index, int direction, int mode); // Predict region t based on direction, returns offset
+    vector3i predictRegion(int index, int mode);                // Predicted move of a feature in voxels, keeps it inside the block
+    void shiftRegion(Feature& f, const vector3i& offset);       // Moves edge and body by the predicted offset
     void fillRegion(Feature& f, const vector3i& offset);        // Scanline algorithm - fills everything inside edge
-    void expandRegion(Feature& f);                              // Grows edge where possible
-    void shrinkRegion(Feature& f);                              // Shrinks edge where nescessary
+    int  expandRegion(Feature& f);                              // Grows edge where possible, returns edge voxels visited
+    int  shrinkRegion(Feature& f);                              // Shrinks edge where nescessary, returns body voxels visited
     bool expandEdge(Feature& f, const vector3i& seed);          // Sub-func inside expandRegion
     void shrinkEdge(Feature& f, const vector3i& seed);          // Sub-func inside shrinkRegion
-    void backupFeatureInfo(int direction);                      // Update the feature vectors information after tracking
-
-    float getOpacity(float value) { return tfMap_[(int)(value * (tfRes_-1))]; }
-
-    vector<float> data_;        // Raw volume intensity value
-    vector<float> mask_;        // Mask volume, same size with a time step data
-    vector<float> maskPrev_;    // Mask volume, same size with a time step data
-    vector<float> tfMap_;       // Tranfer function setting
-
-    float globalMaskValue_ = 0.0f;  // Global mask value for newly detected features
-    int tfRes_ = 1024;              // Default transfer function resolution
+    bool growFeature(const vector3i& seed, vector<vector3i>& rejected); // FindNewFeature without starting its motion history,
+                                                                // the voxels of a too small region go to rejected
+    void splitFeatures();                                       // New features for pieces that broke off after tracking
+    void backupFeatureInfo();                                   // Push a motion summary per feature after tracking
+    void startMotion();                                         // History of newly found features, starting now
+    MotionSummary summarize(const Feature& f);
+    void extractFeaturesSerial();                               // Seed scan + region growing on one thread
+    void extractFeaturesParallel();                             // Slab-parallel union-find labeling
+    bool isBlocked(const vector<uint64_t>& candidates, const vector3i& v); // In bounds but not a labeling candidate
+
+    void classify();                                            // Rebuild visible_ from volumes_ and tf_
+    void updateVisibility();                                    // Take nextVisible_ if the caller filled it, else classify
+    bool isVisible(int index) { return visible_.Test(index); }
+
+    vector<VolumeView> volumes_;    // Raw values per variable, not owned
+    SparseMask mask_;           // Feature label per voxel at current time step
+    SparseMask maskPrev_;       // Feature label per voxel at previous time step
+    shared_ptr<const TransferFunction> tf_;    // Transfer function setting, shared with the data manager
+    FeaturePredicate predicate_;    // Which voxels belong to features
+    VisibilityMask visible_;    // predicate_ per voxel, rebuilt when data or TF changes
+    VisibilityMask nextVisible_;    // Classified ahead by the caller
+    bool hasNextVisible_ = false;
+    vector<int> parent_;        // Union-find of parallel extraction, kept to reuse its allocation
+
+    int globalMaskValue_ = 0;       // Global mask value for newly detected features
+    int numThreads_ = 1;            // Threads used by ExtractAllFeatures
+    int minNumVoxels_ = MIN_NUM_VOXEL_IN_FEATURE;   // Smaller components are not kept as features
     int volumeSize_;
-    int timeLeft2Forward_;
-    int timeLeft2Backward_;
+    int lastDirection_ = FT_FORWARD;    // Motion history is in this direction
 
     vector3i blockDim_;
 
     vector<Feature> currentFeatures_; // Features info in current time step
-    vector<Feature> backup1Features_; // ... in the 1st backup time step
-    vector<Feature> backup2Features_; // ... in the 2nd backup time step
-    vector<Feature> backup3Features_; // ... in the 3rd backup time step
+    vector<FeatureMotion> motion_;    // Recent motion, same order as currentFeatures_
 
-    std::unordered_map<int, vector<Feature> > featureSequence_;
+    FeatureHistory  featureSequence_;   // Extracted features per time step
+    TrackerCounters counters_;          // Work done since TakeCounters
 };
 
 #endif // FEATURETRACKER_H
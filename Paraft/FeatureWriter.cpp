@@ -0,0 +1,170 @@
+#include "FeatureWriter.h"
+
+#include <unistd.h>
+
+static const char INDEX_MAGIC[4] = { 'P', 'F', 'T', 'X' };
+static const int INDEX_VERSION = 1;
+
+using util::writeRaw;
+using util::readRaw;
+
+FeatureWriter::FeatureWriter() : offset_(0), indexOffset_(0) {}
+
+FeatureWriter::~FeatureWriter() {
+    Close();
+}
+
+bool FeatureWriter::Open(const string &basePath, const vector3i &dim) {
+    Close();
+    features_.open((basePath + ".features").c_str(), ios::binary | ios::trunc);
+    index_.open((basePath + ".fidx").c_str(), ios::binary | ios::trunc);
+    if (!features_ || !index_) {
+        Close();
+        return false;
+    }
+
+    dim_ = dim;
+    offset_ = 0;
+
+    writeRaw(index_, INDEX_MAGIC, 4);
+    writeRaw(index_, &INDEX_VERSION, 1);
+    writeRaw(index_, &dim_.x, 1);
+    writeRaw(index_, &dim_.y, 1);
+    writeRaw(index_, &dim_.z, 1);
+    index_.flush();
+    indexOffset_ = (uint64_t)index_.tellp();
+    return true;
+}
+
+bool FeatureWriter::Reopen(const string &basePath, const vector3i &dim, uint64_t featuresBytes, uint64_t indexBytes) {
+    Close();
+    string featuresPath = basePath + ".features", indexPath = basePath + ".fidx";
+    if (truncate(featuresPath.c_str(), featuresBytes) != 0 || truncate(indexPath.c_str(), indexBytes) != 0) {
+        return false;
+    }
+
+    features_.open(featuresPath.c_str(), ios::binary | ios::app);
+    index_.open(indexPath.c_str(), ios::binary | ios::app);
+    if (!features_ || !index_) {
+        Close();
+        return false;
+    }
+
+    dim_ = dim;
+    offset_ = featuresBytes;
+    indexOffset_ = indexBytes;
+    return true;
+}
+
+void FeatureWriter::Close() {
+    if (features_.is_open()) features_.close();
+    if (index_.is_open()) index_.close();
+}
+
+void FeatureWriter::Write(const SparseMask &mask, const vector<FeatureEdge> &edges, int t) {
+    // group voxels by label, in index order so runs come out sorted
+    vector<pair<int, int> > labeled;    // (label, voxel index)
+    labeled.reserve(mask.NumLabeled());
+    mask.ForEach([&](int index, int label) { labeled.push_back(make_pair(label, index)); });
+    std::sort(labeled.begin(), labeled.end());
+
+    vector<FeatureEntry> entries;
+    vector<FeatureRun> runs;
+
+    const int sliceSize = dim_.x * dim_.y;
+    for (size_t i = 0; i < labeled.size(); ) {
+        FeatureEntry entry;
+        entry.id = labeled[i].first;
+        entry.numVoxels = 0;
+        entry.numRuns = 0;
+        entry.offset = offset_;
+        double sum[3] = { 0.0, 0.0, 0.0 };
+
+        runs.clear();
+        for (; i < labeled.size() && labeled[i].first == entry.id; ++i) {
+            int index = labeled[i].second;
+            if (!runs.empty() && runs.back().start + runs.back().length == index) {
+                runs.back().length++;
+            } else {
+                FeatureRun run = { index, 1 };
+                runs.push_back(run);
+            }
+
+            sum[0] += index % dim_.x;
+            sum[1] += (index % sliceSize) / dim_.x;
+            sum[2] += index / sliceSize;
+            entry.numVoxels++;
+        }
+
+        for (int k = 0; k < 3; ++k) {
+            entry.centroid[k] = (float)(sum[k] / entry.numVoxels);
+        }
+        entry.numRuns = (int)runs.size();
+        writeRaw(features_, runs.data(), runs.size());
+        offset_ += runs.size() * sizeof(FeatureRun);
+        entries.push_back(entry);
+    }
+
+    // runs reach the disk before any of the index that points at them, since
+    // the index stream may write out part of a large step before flush
+    features_.flush();
+
+    int header[3] = { t, (int)entries.size(), (int)edges.size() };
+    writeRaw(index_, header, 3);
+    writeRaw(index_, entries.data(), entries.size());
+    writeRaw(index_, edges.data(), edges.size());
+    indexOffset_ += sizeof(header) + entries.size()*sizeof(FeatureEntry) + edges.size()*sizeof(FeatureEdge);
+    index_.flush();
+}
+
+bool FeatureReader::Open(const string &basePath) {
+    basePath_ = basePath;
+    features_.clear();
+    edges_.clear();
+
+    ifstream in((basePath + ".fidx").c_str(), ios::binary);
+    char magic[4];
+    int version = 0;
+    if (!in || !readRaw(in, magic, 4) || !equal(magic, magic+4, INDEX_MAGIC) ||
+        !readRaw(in, &version, 1) || version != INDEX_VERSION) {
+        return false;
+    }
+    if (!readRaw(in, &dim_.x, 1) || !readRaw(in, &dim_.y, 1) || !readRaw(in, &dim_.z, 1)) {
+        return false;
+    }
+
+    int header[3];
+    while (readRaw(in, header, 3)) {
+        vector<FeatureEntry> entries(header[1]);
+        vector<FeatureEdge> edges(header[2]);
+        if (!readRaw(in, entries.data(), entries.size()) || !readRaw(in, edges.data(), edges.size())) {
+            break;  // time step still being written
+        }
+        features_[header[0]].swap(entries);
+        edges_[header[0]].swap(edges);
+    }
+    return true;
+}
+
+vector<pair<int, FeatureEntry> > FeatureReader::History(int id) const {
+    vector<pair<int, FeatureEntry> > history;
+    for (auto it = features_.begin(); it != features_.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); ++i) {
+            if (it->second[i].id == id) {
+                history.push_back(make_pair(it->first, it->second[i]));
+                break;
+            }
+        }
+    }
+    return history;
+}
+
+vector<FeatureRun> FeatureReader::ReadRuns(const FeatureEntry &entry) {
+    vector<FeatureRun> runs(entry.numRuns);
+    ifstream in((basePath_ + ".features").c_str(), ios::binary);
+    in.seekg(entry.offset);
+    if (!readRaw(in, runs.data(), runs.size())) {
+        runs.clear();
+    }
+    return runs;
+}
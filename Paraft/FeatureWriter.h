@@ -0,0 +1,85 @@
+#ifndef FEATUREWRITER_H
+#define FEATUREWRITER_H
+
+#include "Utils.h"
+#include "FeatureGraph.h"
+
+// Compact on-disk form of the tracking result, two files per run:
+//
+//   <prefix>.features  voxels of every feature at every time step, stored as
+//                      runs of consecutive voxel indices {int start, length}
+//   <prefix>.fidx      small index, read whole by downstream tools:
+//                      header  {char magic[4] = "PFTX", int version, int dim[3]}
+//                      then per time step
+//                          {int t, int numFeatures, int numEdges}
+//                          numFeatures x FeatureEntry
+//                          numEdges    x FeatureEdge
+//
+// Edges are those of the FeatureGraph: they connect the features of a time
+// step to those of the step before it, weighted by the number of voxels they
+// share. Read forward they give successors, read backward predecessors; one
+// feature with several edges on one side is a split or a merge.
+
+struct FeatureEntry {
+    int      id;            // Global feature ID, the mask value
+    int      numVoxels;
+    float    centroid[3];
+    int      numRuns;
+    uint64_t offset;        // Byte offset of the first run in .features
+};
+
+struct FeatureRun {
+    int start;              // Voxel index of the first voxel
+    int length;             // Number of consecutive voxel indices
+};
+
+class FeatureWriter {
+public:
+    FeatureWriter();
+   ~FeatureWriter();
+
+    // Creates (truncates) <basePath>.features and <basePath>.fidx
+    bool Open(const string &basePath, const vector3i &dim);
+    // Continues existing files, cut back to the given sizes, e.g. when
+    // resuming from a checkpoint taken at that point
+    bool Reopen(const string &basePath, const vector3i &dim, uint64_t featuresBytes, uint64_t indexBytes);
+    void Close();
+    bool IsOpen() const { return features_.is_open(); }
+    uint64_t FeaturesBytes() const  { return offset_; }
+    uint64_t IndexBytes() const     { return indexOffset_; }
+
+    // Appends all features labeled in mask at time step t, and their edges to
+    // the previous time step. Both files are flushed so readers can follow a
+    // run that is still in progress.
+    void Write(const SparseMask &mask, const vector<FeatureEdge> &edges, int t);
+
+private:
+    ofstream features_;
+    ofstream index_;
+    uint64_t offset_;       // Current end of .features
+    uint64_t indexOffset_;  // ... of .fidx
+    vector3i dim_;
+};
+
+class FeatureReader {
+public:
+    bool Open(const string &basePath);
+
+    vector3i Dim() const                        { return dim_; }
+    const map<int, vector<FeatureEntry> >& Features() const { return features_; }
+    const map<int, vector<FeatureEdge> >& Edges() const     { return edges_; }
+
+    // Index entries of feature id at every time step it exists, in time order
+    vector<pair<int, FeatureEntry> > History(int id) const;
+
+    // Voxel runs of one feature, read from .features without touching others
+    vector<FeatureRun> ReadRuns(const FeatureEntry &entry);
+
+private:
+    string basePath_;
+    vector3i dim_;
+    map<int, vector<FeatureEntry> > features_;  // time step -> features
+    map<int, vector<FeatureEdge> > edges_;      // time step -> edges to previous step
+};
+
+#endif // FEATUREWRITER_H
@@ -0,0 +1,127 @@
+#ifndef INDEXMAP_H
+#define INDEXMAP_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+// Open-addressing hash map from non-negative 64-bit keys to small POD values.
+// All entries live in one contiguous table (linear probing, backward-shift
+// deletion), so lookups and removals are O(1) without a heap node per entry.
+template<class V>
+class IndexMap {
+public:
+    IndexMap() : size_(0) { }
+
+    size_t size() const  { return size_; }
+    bool   empty() const { return size_ == 0; }
+
+    void clear() {
+        if (size_ == 0) return;
+        std::fill(keys_.begin(), keys_.end(), EMPTY);
+        size_ = 0;
+    }
+
+    void reserve(size_t n) {
+        size_t cap = 16;
+        while (cap < n * 2) cap <<= 1;
+        if (cap > keys_.size()) rehash(cap);
+    }
+
+    void swap(IndexMap &rhs) {
+        keys_.swap(rhs.keys_);
+        values_.swap(rhs.values_);
+        std::swap(size_, rhs.size_);
+    }
+
+    // Returns a pointer to the stored value, or NULL if key is absent.
+    V* find(uint64_t key) {
+        if (size_ == 0) return NULL;
+        size_t i = probe(key);
+        return keys_[i] == key ? &values_[i] : NULL;
+    }
+
+    const V* find(uint64_t key) const {
+        return const_cast<IndexMap*>(this)->find(key);
+    }
+
+    // Inserts or overwrites; returns true if the key was not present before.
+    bool set(uint64_t key, const V &value) {
+        if ((size_ + 1) * 2 > keys_.size()) {
+            rehash(keys_.empty() ? 16 : keys_.size() * 2);
+        }
+        size_t i = probe(key);
+        values_[i] = value;
+        if (keys_[i] == key) return false;
+        keys_[i] = key;
+        size_++;
+        return true;
+    }
+
+    bool erase(uint64_t key) {
+        if (size_ == 0) return false;
+        size_t mask = keys_.size() - 1;
+        size_t i = probe(key);
+        if (keys_[i] != key) return false;
+
+        // shift following entries of the same cluster back into the hole
+        size_t j = i;
+        while (true) {
+            j = (j + 1) & mask;
+            if (keys_[j] == EMPTY) break;
+            size_t home = hash(keys_[j]) & mask;
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                keys_[i] = keys_[j];
+                values_[i] = values_[j];
+                i = j;
+            }
+        }
+        keys_[i] = EMPTY;
+        size_--;
+        return true;
+    }
+
+    // Visits every (key, value) pair in table order.
+    template<class Func>
+    void forEach(Func func) const {
+        for (size_t i = 0; i < keys_.size(); ++i) {
+            if (keys_[i] != EMPTY) func(keys_[i], values_[i]);
+        }
+    }
+
+private:
+    static const uint64_t EMPTY = ~0ULL;
+
+    static size_t hash(uint64_t key) {
+        key *= 0x9E3779B97F4A7C15ULL;
+        return (size_t)(key ^ (key >> 29));
+    }
+
+    size_t probe(uint64_t key) const {
+        size_t mask = keys_.size() - 1;
+        size_t i = hash(key) & mask;
+        while (keys_[i] != EMPTY && keys_[i] != key) {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<uint64_t> keys(capacity, EMPTY);
+        std::vector<V> values(capacity);
+        keys_.swap(keys);
+        values_.swap(values);
+        size_ = 0;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (keys[i] != EMPTY) set(keys[i], values[i]);
+        }
+    }
+
+    std::vector<uint64_t> keys_;
+    std::vector<V>        values_;
+    size_t                size_;
+};
+
+template<class V> const uint64_t IndexMap<V>::EMPTY;
+
+#endif // INDEXMAP_H
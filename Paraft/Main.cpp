@@ -1,15 +1,50 @@
 #include "BlockController.h"
 #include "Metadata.h"
 
+#include <cstdio>
+#include <cstdlib>
+
 using namespace std;
 
-int main () {
-    Metadata meta("/Users/Yang/Develop/Paraft/Paraft/vorts.config");
-    int currentT = meta.start();
+// By FT_DIRECT ... FT_KALMAN, as in the configs
+static const char* PREDICTORS[] = { "direct", "linear", "poly", "leastsq", "kalman" };
+static const int NUM_PREDICTORS = sizeof(PREDICTORS)/sizeof(PREDICTORS[0]);
 
-    BlockController blockController;
-    blockController.SetCurrentTimestep(currentT);
-    blockController.InitParameters(meta);
+// One configuration of a sweep. Each has a controller of its own, all of
+// them following one leader, so a time step is read and classified once.
+struct SweepPoint {
+    int    predicate;       // into meta.predicates()
+    int    predictor;
+    string tag;             // of its output files
+};
+
+// A line of the summary table
+struct SummaryRow {
+    string                   dataset;
+    string                   direction;
+    FeaturePredicate         predicate;
+    int                      predictor;
+    BlockController::Summary summary;
+};
+
+// What the command line asks for
+struct Options {
+    vector<string>                  configs;
+    vector<pair<string, string> >   overrides;      // key, value in command line order
+    vector<string>                  thresholds;     // thresholdSet values
+    vector<int>                     predictors;
+    string                          summaryPath;    // CSV, none if empty
+};
+
+static void trackForward(BlockController &blockController, const Metadata &meta) {
+    int currentT = meta.start();
+    int resumedT = meta.resume() ? blockController.Resume(meta) : INT_MIN;
+    if (resumedT != INT_MIN) {
+        currentT = resumedT + 1;
+    } else {
+        blockController.SetCurrentTimestep(currentT);
+        blockController.InitParameters(meta);
+    }
 
     while (currentT < meta.end()) {
         blockController.SetCurrentTimestep(currentT);
@@ -17,6 +52,270 @@ int main () {
         currentT++;
         cout << "-- " << currentT << " done --" << endl;
     }
+}
+
+static void trackBackward(BlockController &blockController, const Metadata &meta) {
+    int currentT = meta.end()-1;
+    blockController.SetCurrentTimestep(currentT);
+    blockController.InitParameters(meta);
 
+    while (currentT >= meta.start()) {
+        blockController.SetCurrentTimestep(currentT);
+        blockController.TrackBackward(meta);
+        cout << "-- " << currentT << " done (backward) --" << endl;
+        currentT--;
+    }
+}
+
+// The controller tracking point, its output tagged tag + point.tag
+static void configure(BlockController &controller, const Metadata &meta, const SweepPoint &point, const string &tag) {
+    controller.SetPredicateIndex(point.predicate);
+    controller.SetPredictor(point.predictor);
+    controller.SetOutputTag(tag + point.tag);
+    controller.KeepMasks(meta.direction() == FT_BIDIRECTIONAL);    // both sweeps are compared at the end
+}
+
+// Every point after the first is tracked by a follower of leader
+static vector<BlockController*> addFollowers(BlockController &leader, const Metadata &meta,
+                                             const vector<SweepPoint> &points, const string &tag) {
+    vector<BlockController*> followers;
+    for (size_t p = 1; p < points.size(); ++p) {
+        BlockController *follower = new BlockController();
+        configure(*follower, meta, points[p], tag);
+        leader.AddFollower(follower);
+        followers.push_back(follower);
+    }
+    return followers;
+}
+
+// A summary row per point, tracked by leader and its followers in order
+static void addRows(const Metadata &meta, const vector<SweepPoint> &points, BlockController &leader,
+                    const vector<BlockController*> &followers, const string &direction, vector<SummaryRow> &rows) {
+    for (size_t p = 0; p < points.size(); ++p) {
+        SummaryRow row;
+        row.dataset = meta.name().empty() ? meta.prefix() : meta.name();
+        row.direction = direction;
+        row.predicate = meta.predicates()[points[p].predicate];
+        row.predictor = points[p].predictor;
+        row.summary = (p == 0 ? &leader : followers[p-1])->GetSummary();
+        rows.push_back(row);
+    }
+}
+
+// Sweep forward and backward on separate threads, then report per time step
+// which correspondences both directions agree on.
+static void trackBidirectional(BlockController &forward, const vector<BlockController*> &forwardFollowers,
+                               const Metadata &meta, const vector<SweepPoint> &points, vector<SummaryRow> &rows) {
+    BlockController backward;
+    configure(backward, meta, points[0], ".backward");
+    vector<BlockController*> backwardFollowers = addFollowers(backward, meta, points, ".backward");
+
+    std::thread backwardSweep([&] { trackBackward(backward, meta); });
+    trackForward(forward, meta);
+    backwardSweep.join();
+
+    vector<BlockController*> forwards(1, &forward), backwards(1, &backward);
+    forwards.insert(forwards.end(), forwardFollowers.begin(), forwardFollowers.end());
+    backwards.insert(backwards.end(), backwardFollowers.begin(), backwardFollowers.end());
+    for (size_t p = 0; p < forwards.size(); ++p) {
+        if (forwards.size() > 1) cout << "configuration " << p << ":" << endl;
+        for (int t = meta.start()+1; t < meta.end(); ++t) {
+            BlockController &f = *forwards[p], &b = *backwards[p];
+            if (f.GetTrackedMask(t-1) == NULL) continue;     // before a resumed run
+            GraphAgreement agreement = f.GetFeatureGraph().Compare(t, b.GetFeatureGraph(FT_BACKWARD),
+                *f.GetTrackedMask(t-1), *f.GetTrackedMask(t),
+                *b.GetTrackedMask(t-1), *b.GetTrackedMask(t));
+            cout << "t = " << t << ": " << agreement.confirmed.size() << " confirmed, "
+                 << agreement.onlyThis.size() << " forward only, "
+                 << agreement.onlyOther.size() << " backward only" << endl;
+        }
+    }
+    backward.PrintIOSummary();
+    addRows(meta, points, backward, backwardFollowers, "backward", rows);
+
+    for (size_t i = 0; i < backwardFollowers.size(); ++i) {
+        delete backwardFollowers[i];
+    }
+}
+
+// Every predicate of meta with every predictor asked for, the config's if
+// none, over data read and classified once
+static vector<SweepPoint> sweepPoints(const Metadata &meta, const vector<int> &predictors) {
+    vector<int> modes = predictors.empty() ? vector<int>(1, meta.predictor()) : predictors;
+    vector<SweepPoint> points;
+    for (size_t p = 0; p < meta.predicates().size(); ++p) {
+        for (size_t m = 0; m < modes.size(); ++m) {
+            SweepPoint point;
+            point.predicate = (int)p;
+            point.predictor = modes[m];
+            if (p > 0) point.tag += ".p" + to_string(p);
+            if (modes.size() > 1) point.tag += string(".") + PREDICTORS[modes[m]];
+            points.push_back(point);
+        }
+    }
+    return points;
+}
+
+static void track(const Metadata &meta, const vector<int> &predictors, vector<SummaryRow> &rows) {
+    vector<SweepPoint> points = sweepPoints(meta, predictors);
+    auto begin = std::chrono::steady_clock::now();
+
+    BlockController blockController;
+    configure(blockController, meta, points[0], "");
+    vector<BlockController*> followers = addFollowers(blockController, meta, points, "");
+    if (meta.direction() == FT_BACKWARD) {
+        trackBackward(blockController, meta);
+    } else if (meta.direction() == FT_BIDIRECTIONAL) {
+        trackBidirectional(blockController, followers, meta, points, rows);
+    } else {
+        trackForward(blockController, meta);
+    }
+    blockController.PrintIOSummary();
+    addRows(meta, points, blockController, followers, meta.direction() == FT_BACKWARD ? "backward" : "forward", rows);
+
+    for (size_t i = 0; i < followers.size(); ++i) {
+        delete followers[i];
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    cout << points.size() << " configuration(s) tracked in " << elapsed.count() << "s" << endl;
+}
+
+static void printSummary(const vector<SummaryRow> &rows) {
+    printf("%-12s %-9s %8s %9s %-9s %6s %10s %6s %6s %6s %9s\n", "dataset", "direction", "opacity",
+           "minVoxels", "predictor", "steps", "features", "max", "found", "lost", "track s");
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const SummaryRow &r = rows[i];
+        const BlockController::Summary &s = r.summary;
+        printf("%-12s %-9s %8g %9d %-9s %6d %10.1f %6d %6d %6d %9.3f\n", r.dataset.c_str(), r.direction.c_str(),
+               r.predicate.opacity, r.predicate.minVoxels, PREDICTORS[r.predictor], s.steps,
+               s.steps > 0 ? (double)s.features / s.steps : 0.0, s.maxFeatures, s.found, s.lost, s.seconds);
+    }
+}
+
+static bool writeSummary(const vector<SummaryRow> &rows, const string &fpath) {
+    ofstream out(fpath.c_str());
+    if (!out) return false;
+    out << "dataset,direction,opacity,minVoxels,predictor,steps,featuresPerStep,maxFeatures,found,lost,trackSeconds\n";
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const SummaryRow &r = rows[i];
+        const BlockController::Summary &s = r.summary;
+        out << r.dataset << "," << r.direction << "," << r.predicate.opacity << "," << r.predicate.minVoxels << ","
+            << PREDICTORS[r.predictor] << "," << s.steps << "," << (s.steps > 0 ? (double)s.features / s.steps : 0.0)
+            << "," << s.maxFeatures << "," << s.found << "," << s.lost << "," << s.seconds << "\n";
+    }
+    return (bool)out;
+}
+
+static void usage() {
+    cout << "usage: Paraft [options] config..." << endl
+         << "  --start T, --end T      time range of every dataset" << endl
+         << "  --threshold SET         a feature definition to sweep, as a thresholdSet value:" << endl
+         << "                          \"(opacity, minVoxels[, lo, hi per variable])\", repeatable," << endl
+         << "                          in place of the config's" << endl
+         << "  --predictor NAME[,...]  motion predictors to sweep: direct, linear, poly, leastsq, kalman" << endl
+         << "  --set KEY=VALUE         any config key, written as in the config, repeatable" << endl
+         << "  --summary FILE          also write the sweep table as CSV" << endl
+         << "Every combination of feature definition and predictor is tracked over the same" << endl
+         << "data, read and classified once per time step." << endl;
+}
+
+static bool parseArguments(int argc, char **argv, Options &options, string &error) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            options.configs.push_back(arg);
+            continue;
+        }
+        if (i+1 == argc) {
+            error = arg + " needs a value";
+            return false;
+        }
+        string value = argv[++i];
+        if (arg == "--start" || arg == "--end") {
+            options.overrides.push_back(make_pair(arg.substr(2), value));
+        } else if (arg == "--threshold") {
+            options.thresholds.push_back(value[0] == '(' ? value : "(" + value + ")");
+        } else if (arg == "--predictor") {
+            size_t pos = 0;
+            do {
+                size_t comma = value.find(',', pos);
+                string name = value.substr(pos, comma == value.npos ? comma : comma - pos);
+                int mode = 0;
+                while (mode < NUM_PREDICTORS && name != PREDICTORS[mode]) ++mode;
+                if (mode == NUM_PREDICTORS) {
+                    error = "unknown predictor " + name;
+                    return false;
+                }
+                options.predictors.push_back(mode);
+                pos = comma == value.npos ? comma : comma + 1;
+            } while (pos != value.npos);
+        } else if (arg == "--set") {
+            size_t pos = value.find('=');
+            if (pos == value.npos) {
+                error = "--set expects key=value, not " + value;
+                return false;
+            }
+            options.overrides.push_back(make_pair(util::trim(value.substr(0, pos)), util::trim(value.substr(pos+1))));
+        } else if (arg == "--summary") {
+            options.summaryPath = value;
+        } else {
+            error = "unknown option " + arg;
+            return false;
+        }
+    }
+    if (options.configs.empty()) {
+        error = "no config given";
+        return false;
+    }
+    return true;
+}
+
+// The datasets of all configs with the command line applied
+static bool loadDatasets(const Options &options, vector<Metadata> &datasets, string &error) {
+    for (size_t c = 0; c < options.configs.size(); ++c) {
+        vector<Metadata> loaded;
+        if (!Metadata::LoadAll(options.configs[c], loaded, error)) return false;
+        for (size_t d = 0; d < loaded.size(); ++d) {
+            Metadata &meta = loaded[d];
+            if (!meta.Override(options.overrides, error) || !meta.SetThresholdSets(options.thresholds, error)) {
+                error = options.configs[c] + ": " + error;
+                return false;
+            }
+        }
+        datasets.insert(datasets.end(), loaded.begin(), loaded.end());
+    }
+    return true;
+}
+
+int main (int argc, char **argv) {
+    Options options;
+    vector<Metadata> datasets;
+    string error;
+    if (!parseArguments(argc, argv, options, error)) {
+        cout << error << endl;
+        usage();
+        return EXIT_FAILURE;
+    }
+    if (!loadDatasets(options, datasets, error)) {
+        cout << error << endl;
+        return EXIT_FAILURE;
+    }
+
+    // each dataset is tracked on its own, one after the other, its sweep
+    // points together
+    vector<SummaryRow> rows;
+    for (size_t d = 0; d < datasets.size(); ++d) {
+        if (datasets.size() > 1) cout << "== dataset " << datasets[d].name() << " ==" << endl;
+        track(datasets[d], options.predictors, rows);
+    }
+
+    printSummary(rows);
+    if (!options.summaryPath.empty()) {
+        if (!writeSummary(rows, options.summaryPath)) {
+            cerr << "cannot output to file: " << options.summaryPath << endl;
+            return EXIT_FAILURE;
+        }
+        cout << "summary saved: " << options.summaryPath << endl;
+    }
     return EXIT_SUCCESS;
 }
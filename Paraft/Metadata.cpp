@@ -1,53 +1,416 @@
 #include "Metadata.h"
+#include "TimestepCache.h"
 
-Metadata::Metadata(const string &fpath) {
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+// Keys every dataset has to set
+static const char* REQUIRED_KEYS[] = {
+    "start", "end", "prefix", "suffix", "path", "tfPath", "timeFormat", "volumeDim"
+};
+
+// s without surrounding spaces, tabs and line ends
+static string strip(const string &s) {
+    size_t first = s.find_first_not_of(" \t\r\n");
+    if (first == s.npos) return "";
+    return s.substr(first, s.find_last_not_of(" \t\r\n") - first + 1);
+}
+
+// line up to a # or // that is not inside quotes
+static string dropComment(const string &line) {
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        if (line[i] == '"') quoted = !quoted;
+        if (quoted) continue;
+        if (line[i] == '#' || (line[i] == '/' && i+1 < line.size() && line[i+1] == '/')) {
+            return line.substr(0, i);
+        }
+    }
+    return line;
+}
+
+static bool parseInt(const string &value, int &out) {
+    char *end = NULL;
+    long n = strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || n < INT_MIN || n > INT_MAX) return false;
+    out = (int)n;
+    return true;
+}
+
+static bool parseFloat(const string &value, float &out) {
+    char *end = NULL;
+    out = strtof(value.c_str(), &end);
+    return !value.empty() && *end == '\0';
+}
+
+static bool parseBool(const string &value, bool &out) {
+    if (value != "true" && value != "false") return false;
+    out = value == "true";
+    return true;
+}
+
+static bool parseString(const string &value, string &out) {
+    if (value.size() < 2 || value[0] != '"' || value[value.size()-1] != '"') return false;
+    out = value.substr(1, value.size()-2);
+    return out.find('"') == out.npos;
+}
+
+// (a, "b", ...), items stripped and unquoted. Commas inside quotes belong
+// to the item.
+static bool parseTuple(const string &value, vector<string> &items) {
+    if (value.size() < 2 || value[0] != '(' || value[value.size()-1] != ')') return false;
+    items.clear();
+    string inner = value.substr(1, value.size()-2);
+    size_t begin = 0;
+    bool quoted = false;
+    for (size_t i = 0; i <= inner.size(); ++i) {
+        if (i < inner.size() && inner[i] == '"') quoted = !quoted;
+        if (i < inner.size() && (quoted || inner[i] != ',')) continue;
+        string item = strip(inner.substr(begin, i - begin));
+        if (item.empty()) return false;
+        if (item[0] == '"' && !parseString(item, item)) return false;
+        items.push_back(item);
+        begin = i + 1;
+    }
+    return !quoted;
+}
+
+static bool parseVector3i(const string &value, vector3i &out) {
+    vector<string> items;
+    if (!parseTuple(value, items) || items.size() != 3) return false;
+    return parseInt(items[0], out.x) && parseInt(items[1], out.y) && parseInt(items[2], out.z);
+}
+
+// Integer conversions in pattern, -1 if it has any other kind, so formatting
+// it with a time step is safe when the count is at most 1
+static int countIntFormats(const string &pattern) {
+    int conversions = 0;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] != '%') continue;
+        if (++i < pattern.size() && pattern[i] == '%') continue;
+        while (i < pattern.size() && strchr("-+ #0123456789.", pattern[i]) != NULL) ++i;
+        if (i == pattern.size() || strchr("diuxXo", pattern[i]) == NULL) return -1;
+        conversions++;
+    }
+    return conversions;
+}
+
+Metadata::Metadata() : start_(0), end_(0), volumeDim_(0, 0, 0), numThreads_(1), prefetch_(3),
+    saveMask_(false), direction_(FT_FORWARD), checkpointInterval_(0), resume_(false), historyBudget_(0),
+    predictor_(FT_DIRECT), dynamicTF_(false), precision_(QuantizedVolume::FLOAT32), cachePolicy_(CP_WINDOW),
+    cacheBudget_(0), opacityThreshold_(OPACITY_THRESHOLD), minVoxels_(MIN_NUM_VOXEL_IN_FEATURE) { }
+
+Metadata::Metadata(const string &fpath) : Metadata() {
+    vector<Metadata> datasets;
+    if (LoadAll(fpath, datasets, error_)) {
+        *this = datasets[0];
+    }
+}
+
+Metadata::~Metadata() {}
+
+bool Metadata::LoadAll(const string &fpath, vector<Metadata> &datasets, string &error) {
+    datasets.clear();
     ifstream meta(fpath.c_str());
     if (!meta) {
-        cout << "cannot read meta file: " << fpath << endl;
-        exit(EXIT_FAILURE);
+        error = "cannot read meta file: " + fpath;
+        return false;
     }
 
+    Metadata current;
+    std::set<string> seen;     // keys of the current block
+    bool inBlock = false;
     string line;
-    while (getline(meta, line)) {
-        size_t pos = line.find('=');
-        if (pos == line.npos) { continue; }
-
-        string value = util::trim(line.substr(pos+1));
-        if (line.find("start") != line.npos) {
-            start_ = atoi(value.c_str());
-        } else if (line.find("end") != line.npos) {
-            end_ = atoi(value.c_str());
-        } else {
-            // remove leading & trailing chars () or ""
-            value = value.substr(1, value.size()-2);
-
-            if (line.find("prefix") != line.npos) {
-                prefix_ = value;
-            } else if (line.find("suffix") != line.npos) {
-                suffix_ = value;
-            } else if (line.find("path") != line.npos) {
-                path_ = value;
-            } else if (line.find("tfPath") != line.npos) {
-                tfPath_ = value;
-            } else if (line.find("timeFormat") != line.npos) {
-                timeFormat_ = value;
-            } else if (line.find("volumeDim") != line.npos) {
-                vector<int> dim;
-                size_t pos = 0;
-                while ((pos = value.find(',')) != value.npos) {
-                    dim.push_back(atoi(util::trim(value.substr(0, pos)).c_str()));
-                    value.erase(0, pos+1);
-                }
-                dim.push_back(atoi(util::trim(value).c_str()));
+    for (int lineNumber = 1; getline(meta, line); ++lineNumber) {
+        ostringstream at;
+        at << fpath << ":" << lineNumber << ": ";
+        line = strip(dropComment(line));
+        if (line.empty()) continue;
 
-                if (dim.size() != 3) {
-                    cout << "incorrect volumeDim format" << endl;
-                    exit(EXIT_FAILURE);
+        if (line[line.size()-1] == '{') {
+            istringstream header(line.substr(0, line.size()-1));
+            string kind, name, rest;
+            header >> kind >> name >> rest;
+            if (inBlock || kind != "Metadata" || !rest.empty()) {
+                error = at.str() + (inBlock ? "missing }" : "expected Metadata [name] {");
+                return false;
+            }
+            current = Metadata();
+            current.name_ = name;
+            seen.clear();
+            inBlock = true;
+        } else if (line == "}") {
+            if (!inBlock) {
+                error = at.str() + "} without a block";
+                return false;
+            }
+            for (size_t k = 0; k < sizeof(REQUIRED_KEYS)/sizeof(REQUIRED_KEYS[0]); ++k) {
+                if (seen.count(REQUIRED_KEYS[k]) == 0) {
+                    error = at.str() + "missing " + REQUIRED_KEYS[k];
+                    return false;
                 }
-                volumeDim_ = vector3i(dim[0], dim[1], dim[2]);
             }
+            string reason;
+            if (!current.finish(reason)) {
+                error = at.str() + reason;
+                return false;
+            }
+            datasets.push_back(current);
+            inBlock = false;
+        } else {
+            size_t pos = line.find('=');
+            if (!inBlock || pos == line.npos) {
+                error = at.str() + (inBlock ? "expected key = value" : "expected Metadata [name] {");
+                return false;
+            }
+            string key = strip(line.substr(0, pos)), value = strip(line.substr(pos+1));
+            bool repeatable = key == "variable" || key == "thresholdSet";
+            if (!repeatable && seen.count(key) > 0) {
+                error = at.str() + key + " set twice";
+                return false;
+            }
+            string reason;
+            if (!current.set(key, value, reason)) {
+                error = at.str() + key + ": " + reason;
+                return false;
+            }
+            seen.insert(key);
         }
     }
+
+    if (inBlock) {
+        error = fpath + ": missing } at the end";
+        return false;
+    }
+    if (datasets.empty()) {
+        error = fpath + ": no Metadata block";
+        return false;
+    }
+    return true;
 }
 
-Metadata::~Metadata() {}
+bool Metadata::Override(const vector<pair<string, string> > &values, string &error) {
+    string reason;
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (!set(values[i].first, values[i].second, reason)) {
+            error = values[i].first + ": " + reason;
+            return false;
+        }
+    }
+    if (!finish(reason)) {
+        error = reason;
+        return false;
+    }
+    return true;
+}
+
+bool Metadata::SetThresholdSets(const vector<string> &values, string &error) {
+    if (values.empty()) return true;
+    thresholdSets_.clear();
+    for (size_t i = 0; i < values.size(); ++i) {
+        string reason;
+        if (!set("thresholdSet", values[i], reason)) {
+            error = "thresholdSet " + values[i] + ": " + reason;
+            return false;
+        }
+    }
+    const FeaturePredicate first = thresholdSets_[0];
+    if (first.ranges.size() > variables_.size()) {
+        error = "thresholdSet " + values[0] + ": ranges for more variables than there are";
+        return false;
+    }
+    opacityThreshold_ = first.opacity;
+    minVoxels_ = first.minVoxels;
+    for (size_t k = 0; k < first.ranges.size(); ++k) {
+        variables_[k].range = first.ranges[k];
+    }
+    thresholdSets_.erase(thresholdSets_.begin());
+
+    string reason;
+    if (!finish(reason)) {
+        error = reason;
+        return false;
+    }
+    return true;
+}
+
+bool Metadata::set(const string &key, const string &value, string &error) {
+    int n = 0;
+    string text;
+    vector<string> items;
+
+    if (key == "start" || key == "end") {
+        if (!parseInt(value, key == "start" ? start_ : end_)) { error = "expected an integer"; return false; }
+    } else if (key == "numThreads" || key == "prefetch" || key == "checkpointInterval" ||
+               key == "historyBudget" || key == "cacheBudget" || key == "minVoxels") {
+        int minimum = key == "numThreads" || key == "minVoxels" ? 1 : 0;
+        if (!parseInt(value, n) || n < minimum) {
+            error = minimum == 1 ? "expected a positive integer" : "expected an integer of at least 0";
+            return false;
+        }
+        if (key == "numThreads")              numThreads_ = n;
+        else if (key == "prefetch")           prefetch_ = n;
+        else if (key == "checkpointInterval") checkpointInterval_ = n;
+        else if (key == "historyBudget")      historyBudget_ = (size_t)n << 20;     // in MB
+        else if (key == "cacheBudget")        cacheBudget_ = (size_t)n << 20;
+        else                                  minVoxels_ = n;
+    } else if (key == "opacityThreshold") {
+        if (!parseFloat(value, opacityThreshold_)) { error = "expected a number"; return false; }
+    } else if (key == "saveMask" || key == "resume" || key == "dynamicTF") {
+        bool &flag = key == "saveMask" ? saveMask_ : key == "resume" ? resume_ : dynamicTF_;
+        if (!parseBool(value, flag)) { error = "expected true or false"; return false; }
+    } else if (key == "prefix" || key == "suffix" || key == "path" || key == "tfPath" || key == "timeFormat") {
+        string &field = key == "prefix" ? prefix_ : key == "suffix" ? suffix_ : key == "path" ? path_ :
+                        key == "tfPath" ? tfPath_ : timeFormat_;
+        if (!parseString(value, field)) { error = "expected a quoted string"; return false; }
+    } else if (key == "volumeDim") {
+        if (!parseVector3i(value, volumeDim_) || volumeDim_.x < 1 || volumeDim_.y < 1 || volumeDim_.z < 1) {
+            error = "expected (x, y, z) of positive integers";
+            return false;
+        }
+    } else if (key == "direction") {
+        if (!parseString(value, text)) { error = "expected a quoted string"; return false; }
+        if (text == "forward")       direction_ = FT_FORWARD;
+        else if (text == "backward") direction_ = FT_BACKWARD;
+        else if (text == "both")     direction_ = FT_BIDIRECTIONAL;
+        else { error = "unknown direction " + text; return false; }
+    } else if (key == "predictor") {
+        if (!parseString(value, text)) { error = "expected a quoted string"; return false; }
+        if (text == "direct")       predictor_ = FT_DIRECT;
+        else if (text == "linear")  predictor_ = FT_LINEAR;
+        else if (text == "poly")    predictor_ = FT_POLYNO;
+        else if (text == "leastsq") predictor_ = FT_LEASTSQ;
+        else if (text == "kalman")  predictor_ = FT_KALMAN;
+        else { error = "unknown predictor " + text; return false; }
+    } else if (key == "profile") {
+        if (!parseString(value, text)) { error = "expected a quoted string"; return false; }
+        if (text != "csv" && text != "json" && text != "none") { error = "unknown profile format " + text; return false; }
+        profile_ = text == "none" ? "" : text;
+    } else if (key == "precision") {
+        if (!parseString(value, text)) { error = "expected a quoted string"; return false; }
+        precision_ = QuantizedVolume::ParseType(text);
+        if (precision_ < 0) { error = "unknown precision " + text; return false; }
+    } else if (key == "cachePolicy") {
+        if (!parseString(value, text)) { error = "expected a quoted string"; return false; }
+        if (text == "window")   cachePolicy_ = CP_WINDOW;
+        else if (text == "lru") cachePolicy_ = CP_LRU;
+        else { error = "unknown cache policy " + text; return false; }
+    } else if (key == "pinnedSteps") {     // (t, ...)
+        if (!parseTuple(value, items)) { error = "expected (t, ...)"; return false; }
+        pinnedSteps_.resize(items.size());
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (!parseInt(items[i], pinnedSteps_[i])) { error = "not a time step: " + items[i]; return false; }
+        }
+    } else if (key == "variable") {         // ("prefix", "suffix"[, lo, hi])
+        VariableSource v;
+        if (!parseTuple(value, items) || (items.size() != 2 && items.size() != 4) ||
+            (items.size() == 4 && (!parseFloat(items[2], v.range.lo) || !parseFloat(items[3], v.range.hi)))) {
+            error = "expected (\"prefix\", \"suffix\"[, lo, hi])";
+            return false;
+        }
+        v.prefix = items[0];
+        v.suffix = items[1];
+        variables_.push_back(v);
+    } else if (key == "thresholdSet") {     // (opacity, minVoxels[, lo, hi per variable])
+        FeaturePredicate p;
+        if (!parseTuple(value, items) || items.size() < 2 || items.size() % 2 != 0) {
+            error = "expected (opacity, minVoxels[, lo, hi per variable])";
+            return false;
+        }
+        if (!parseFloat(items[0], p.opacity)) { error = "not a number: " + items[0]; return false; }
+        if (!parseInt(items[1], p.minVoxels) || p.minVoxels < 1) {
+            error = "minVoxels is not a positive integer: " + items[1];
+            return false;
+        }
+        p.ranges.resize(items.size()/2 - 1);
+        for (size_t i = 2; i < items.size(); ++i) {
+            float &bound = i % 2 == 0 ? p.ranges[i/2-1].lo : p.ranges[i/2-1].hi;
+            if (!parseFloat(items[i], bound)) { error = "not a number: " + items[i]; return false; }
+        }
+        thresholdSets_.push_back(p);
+    } else {
+        error = "unknown key";
+        return false;
+    }
+    return true;
+}
+
+bool Metadata::finish(string &error) {
+    if (end_ < start_) {
+        error = "end is before start";
+        return false;
+    }
+    if (countIntFormats(timeFormat_) != 1) {
+        error = "timeFormat has to format one integer, like %d";
+        return false;
+    }
+    if (dynamicTF_ && (countIntFormats(tfPath_) < 0 || countIntFormats(tfPath_) > 1)) {
+        error = "with dynamicTF, tfPath may only format the time step, like %d";
+        return false;
+    }
+
+    FeaturePredicate base;
+    base.opacity = opacityThreshold_;
+    base.minVoxels = minVoxels_;
+    for (size_t i = 0; i < variables_.size(); ++i) {
+        base.ranges.push_back(variables_[i].range);
+    }
+    predicates_.assign(1, base);
+
+    // ranges left out stay as in base
+    for (size_t i = 0; i < thresholdSets_.size(); ++i) {
+        const FeaturePredicate &given = thresholdSets_[i];
+        if (given.ranges.size() > variables_.size()) {
+            error = "a thresholdSet has ranges for more variables than there are";
+            return false;
+        }
+        FeaturePredicate p = base;
+        p.opacity = given.opacity;
+        p.minVoxels = given.minVoxels;
+        for (size_t k = 0; k < given.ranges.size(); ++k) {
+            p.ranges[k] = given.ranges[k];
+        }
+        predicates_.push_back(p);
+    }
+
+    // the loaders look paths up instead of formatting them every step
+    const int numSteps = end_ - start_ + 1;
+    timestamps_.resize(numSteps);
+    dataFiles_.assign(variables_.size() + 1, vector<string>(numSteps));
+    tfFiles_.assign(dynamicTF_ ? numSteps : 0, string());
+    for (int i = 0; i < numSteps; ++i) {
+        timestamps_[i] = format(timeFormat_, start_ + i);
+        dataFiles_[0][i] = path_ + "/" + prefix_ + timestamps_[i] + "." + suffix_;
+        for (size_t v = 0; v < variables_.size(); ++v) {
+            dataFiles_[v+1][i] = path_ + "/" + variables_[v].prefix + timestamps_[i] + "." + variables_[v].suffix;
+        }
+        if (dynamicTF_) tfFiles_[i] = format(tfPath_, start_ + i);
+    }
+    return true;
+}
+
+string Metadata::format(const string &pattern, int t) const {
+    vector<char> buffer(pattern.size() + 24);     // room for any int
+    snprintf(buffer.data(), buffer.size(), pattern.c_str(), t);
+    return buffer.data();
+}
+
+string Metadata::timestamp(int t) const {
+    if (t >= start_ && t <= end_) return timestamps_[t - start_];
+    return format(timeFormat_, t);
+}
+
+string Metadata::dataFile(int t, int variable) const {
+    if (t >= start_ && t <= end_) return dataFiles_[variable][t - start_];
+    const string &prefix = variable == 0 ? prefix_ : variables_[variable-1].prefix;
+    const string &suffix = variable == 0 ? suffix_ : variables_[variable-1].suffix;
+    return path_ + "/" + prefix + timestamp(t) + "." + suffix;
+}
+
+string Metadata::tfFile(int t) const {
+    if (!dynamicTF_) return tfPath_;
+    if (t >= start_ && t <= end_) return tfFiles_[t - start_];
+    return format(tfPath_, t);
+}
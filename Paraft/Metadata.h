@@ -3,8 +3,28 @@
 
 #include "Utils.h"
 
+// An extra variable read next to the primary one for the feature predicate,
+// from <path>/<prefix><time step>.<suffix>
+struct VariableSource {
+    string        prefix;
+    string        suffix;
+    VariableRange range;
+};
+
+// One dataset of a .config file:
+//
+//   Metadata [name] {
+//       key = value        # or // comment
+//       ...
+//   }
+//
+// A file may hold several such blocks, one dataset each. Values are typed:
+// integers, numbers, true/false, "strings" and (tuples). Unknown or repeated
+// keys, values of the wrong type and missing required keys are errors
+// naming the file and line, nothing exits the program.
 class Metadata {
 public:
+    string   name()       const { return name_; }
     int      start()      const { return start_; }
     int      end()        const { return end_; }
     string   prefix()     const { return prefix_; }
@@ -13,11 +33,60 @@ public:
     string   tfPath()     const { return tfPath_; }
     string   timeFormat() const { return timeFormat_; }
     vector3i volumeDim()  const { return volumeDim_; }
+    int      numThreads() const { return numThreads_; }
+    int      prefetch()   const { return prefetch_; }
+    bool     saveMask()   const { return saveMask_; }
+    int      direction()  const { return direction_; }
+    int      checkpointInterval() const { return checkpointInterval_; }
+    bool     resume()     const { return resume_; }
+    size_t   historyBudget() const { return historyBudget_; }
+    int      predictor()  const { return predictor_; }
+    bool     dynamicTF()  const { return dynamicTF_; }
+    string   profile()    const { return profile_; }
+    int      precision()  const { return precision_; }
+    int      cachePolicy() const { return cachePolicy_; }
+    size_t   cacheBudget() const { return cacheBudget_; }
+    const vector<int>&              pinnedSteps() const { return pinnedSteps_; }
+    const vector<VariableSource>&   variables()  const { return variables_; }
+    // Feature definitions tracked over the same data, the first one from
+    // opacityThreshold, minVoxels and the variable ranges, then one per
+    // thresholdSet line
+    const vector<FeaturePredicate>& predicates() const { return predicates_; }
 
-    Metadata(const string &fpath);
+    // Paths of time step t, formatted once for all of [start, end] when the
+    // config is read. Variable 0 is the primary one, then variables() in
+    // order. Other time steps are formatted on the call.
+    string   timestamp(int t) const;
+    string   dataFile(int t, int variable = 0) const;
+    string   tfFile(int t) const;       // tfPath itself unless dynamicTF
+
+    // The first dataset of the config at fpath. If the config is not valid
+    // error() tells why and where.
+    explicit Metadata(const string &fpath);
+    Metadata();
    ~Metadata();
 
+    bool          valid() const { return error_.empty(); }
+    const string& error() const { return error_; }
+
+    // Every dataset of the config at fpath in file order, or false with the
+    // first error
+    static bool LoadAll(const string &fpath, vector<Metadata> &datasets, string &error);
+
+    // (key, value) pairs on top of what the config says, each checked as if
+    // it were a line of it, e.g. from the command line. Repeatable keys add
+    // to the config's. Paths and predicates are formatted again.
+    bool Override(const vector<pair<string, string> > &values, string &error);
+    // Feature definitions in place of the config's, as thresholdSet values.
+    // The first one replaces opacityThreshold, minVoxels and the ranges.
+    bool SetThresholdSets(const vector<string> &values, string &error);
+
 private:
+    bool set(const string &key, const string &value, string &error);
+    bool finish(string &error);     // check the dataset and format its paths
+    string format(const string &pattern, int t) const;
+
+    string   name_;
     int      start_;
     int      end_;
     string   prefix_;
@@ -26,6 +95,30 @@ private:
     string   tfPath_;
     string   timeFormat_;
     vector3i volumeDim_;
+    int      numThreads_;
+    int      prefetch_;
+    bool     saveMask_;     // also write dense .mask volumes
+    int      direction_;    // FT_FORWARD, FT_BACKWARD or FT_BIDIRECTIONAL
+    int      checkpointInterval_;   // write a checkpoint every N time steps, 0: never
+    bool     resume_;       // continue from the latest checkpoint
+    size_t   historyBudget_;    // bytes of feature history and checkpoints kept in memory, 0: all
+    int      predictor_;    // FT_DIRECT, FT_LINEAR, FT_POLYNO, FT_LEASTSQ or FT_KALMAN
+    bool     dynamicTF_;    // a TF file per time step, tfPath formatted with the time step
+    string   profile_;      // per time step timings to <path>/<prefix>.profile.<csv|json>, empty: none
+    int      precision_;    // QuantizedVolume::Type the volumes are kept as in memory
+    int      cachePolicy_;  // CP_WINDOW or CP_LRU for loaded time steps outside the window
+    size_t   cacheBudget_;  // bytes of loaded time steps, 0: no limit
+    vector<int> pinnedSteps_;   // time steps never unloaded once loaded
+    float    opacityThreshold_;
+    int      minVoxels_;
+    vector<VariableSource>   variables_;
+    vector<FeaturePredicate> thresholdSets_;   // as given, ranges of the first variables only
+    vector<FeaturePredicate> predicates_;
+
+    vector<string>           timestamps_;   // of [start, end]
+    vector<vector<string> >  dataFiles_;    // per variable, of [start, end]
+    vector<string>           tfFiles_;      // of [start, end] with dynamicTF
+    string                   error_;
 };
 
 #endif // METADATA_H
@@ -0,0 +1,157 @@
+#ifndef MOTIONHISTORY_H
+#define MOTIONHISTORY_H
+
+#include "Utils.h"
+
+// Compact summary of one feature at one tracked time step
+struct MotionSummary {
+    vector3f centroid;      // mean voxel position
+    vector3i lo, hi;        // bounding box, inclusive
+    int      numVoxels;
+};
+
+// The last N summaries of one feature, in tracking order. Trivially
+// copyable, so a vector of them is checkpointed as raw bytes.
+template<int N>
+class MotionRing {
+public:
+    MotionRing() : head_(0), size_(0) { }
+
+    void Push(const MotionSummary &s)   { head_ = (head_+1) % N; slots_[head_] = s; size_ = std::min(size_+1, N); }
+    void Truncate(int n)                { size_ = std::min(size_, n); }
+    void Clear()                        { size_ = 0; }
+
+    int  Size() const                   { return size_; }
+    bool Empty() const                  { return size_ == 0; }
+    // stepsBack = 0 is the latest, Size()-1 the oldest kept
+    const MotionSummary& Back(int stepsBack = 0) const { return slots_[(head_+N-stepsBack) % N]; }
+
+private:
+    MotionSummary slots_[N];
+    int head_;
+    int size_;
+};
+
+// Extrapolates where a feature will be at the next time step in the tracking
+// direction. Returns the predicted centroid, the latest one if the history
+// is too short to tell.
+template<int N>
+class MotionPredictor {
+public:
+    virtual ~MotionPredictor() { }
+    virtual vector3f Predict(const MotionRing<N> &history) const = 0;
+};
+
+// Stays where it was last seen
+template<int N>
+class DirectPredictor : public MotionPredictor<N> {
+public:
+    vector3f Predict(const MotionRing<N> &history) const { return history.Back().centroid; }
+};
+
+// Keeps the velocity of the last step
+template<int N>
+class LinearPredictor : public MotionPredictor<N> {
+public:
+    vector3f Predict(const MotionRing<N> &history) const {
+        if (history.Size() < 2) return history.Back().centroid;
+        return history.Back(0).centroid*2 - history.Back(1).centroid;
+    }
+};
+
+// Quadratic through the last three centroids
+template<int N>
+class PolynomialPredictor : public MotionPredictor<N> {
+public:
+    vector3f Predict(const MotionRing<N> &history) const {
+        if (history.Size() < 3) return LinearPredictor<N>().Predict(history);
+        return history.Back(0).centroid*3 - history.Back(1).centroid*3 + history.Back(2).centroid;
+    }
+};
+
+// Straight line fitted to the whole history by least squares, less sensitive
+// to a centroid jittering as the feature changes shape
+template<int N>
+class LeastSquaresPredictor : public MotionPredictor<N> {
+public:
+    vector3f Predict(const MotionRing<N> &history) const {
+        int n = history.Size();
+        if (n < 2) return history.Back().centroid;
+
+        float meanS = (n-1) / 2.0f;     // oldest at s = 0, next step at s = n
+        vector3f meanC;
+        for (int s = 0; s < n; ++s) { meanC += history.Back(n-1-s).centroid; }
+        meanC /= (float)n;
+
+        vector3f slope;
+        float var = 0;
+        for (int s = 0; s < n; ++s) {
+            slope += (history.Back(n-1-s).centroid - meanC) * (s - meanS);
+            var += (s - meanS) * (s - meanS);
+        }
+        slope /= var;
+        return meanC + slope * (n - meanS);
+    }
+};
+
+// Constant velocity Kalman filter per axis, run over the history. Process
+// noise is a random acceleration, measurement noise the centroid jitter from
+// voxels joining or leaving the feature; both are in voxels.
+template<int N>
+class KalmanPredictor : public MotionPredictor<N> {
+public:
+    KalmanPredictor(float accelNoise = 0.25f, float centroidNoise = 1.0f)
+        : q_(accelNoise*accelNoise), r_(centroidNoise*centroidNoise) { }
+
+    vector3f Predict(const MotionRing<N> &history) const {
+        int n = history.Size();
+        vector3f predicted;
+        for (int axis = 0; axis < 3; ++axis) {
+            float z0 = component(history.Back(n-1).centroid, axis);
+            float x = z0, v = 0;
+            float p00 = r_, p01 = 0, p11 = 1e4f;    // velocity unknown at first
+            for (int s = n-2; s >= 0; --s) {
+                // predict one step, white noise acceleration with dt = 1
+                x += v;
+                p00 += 2*p01 + p11 + q_/4;
+                p01 += p11 + q_/2;
+                p11 += q_;
+                // correct with the measured centroid
+                float y = component(history.Back(s).centroid, axis) - x;
+                float k0 = p00 / (p00 + r_), k1 = p01 / (p00 + r_);
+                x += k0 * y;
+                v += k1 * y;
+                p11 -= k1 * p01;    // P = (I - KH) P, each line reads the old values
+                p01 -= k1 * p00;
+                p00 -= k0 * p00;
+            }
+            component(predicted, axis) = x + v;
+        }
+        return predicted;
+    }
+
+private:
+    static float  component(const vector3f &v, int axis) { return axis == 0 ? v.x : (axis == 1 ? v.y : v.z); }
+    static float& component(vector3f &v, int axis)       { return axis == 0 ? v.x : (axis == 1 ? v.y : v.z); }
+
+    float q_, r_;
+};
+
+// Built-in predictor for FT_DIRECT, FT_LINEAR, FT_POLYNO, FT_LEASTSQ or FT_KALMAN
+template<int N>
+const MotionPredictor<N>& GetPredictor(int mode) {
+    static DirectPredictor<N>       direct;
+    static LinearPredictor<N>       linear;
+    static PolynomialPredictor<N>   polynomial;
+    static LeastSquaresPredictor<N> leastSquares;
+    static KalmanPredictor<N>       kalman;
+    switch (mode) {
+        case FT_LINEAR:  return linear;
+        case FT_POLYNO:  return polynomial;
+        case FT_LEASTSQ: return leastSquares;
+        case FT_KALMAN:  return kalman;
+        default:         return direct;
+    }
+}
+
+#endif // MOTIONHISTORY_H
@@ -1,7 +1,8 @@
 QMAKE_CXX       =  g++-4.8
-QMAKE_CXXFLAGS  = -std=c++11
+QMAKE_CXXFLAGS  = -std=c++11 -pthread
 INCLUDEPATH     = -I/usr/local/include
-LIBS            = -L/usr/local/lib -lm
+INCLUDEPATH    += ../RenderSystem/lib/VisKit/util
+LIBS            = -L/usr/local/lib -lm -lpthread
 
 QMAKE_LINK       = $$QMAKE_CXX
 
@@ -10,14 +11,34 @@ SOURCES += \
     DataManager.cpp \
     FeatureTracker.cpp \
     BlockController.cpp \
-    Metadata.cpp
+    Metadata.cpp \
+    VisibilityMask.cpp \
+    FeatureWriter.cpp \
+    FeatureGraph.cpp \
+    Checkpoint.cpp \
+    FeatureHistory.cpp \
+    Profile.cpp \
+    TimestepCache.cpp
 
 HEADERS += \
     DataManager.h \
     FeatureTracker.h \
     BlockController.h \
     Utils.h \
-    Metadata.h
+    IndexMap.h \
+    BoundedQueue.h \
+    Metadata.h \
+    VisibilityMask.h \
+    FeatureWriter.h \
+    FeatureGraph.h \
+    Checkpoint.h \
+    FeatureHistory.h \
+    MotionHistory.h \
+    Profile.h \
+    TimestepCache.h \
+    ../RenderSystem/lib/VisKit/util/RangeKernels.h \
+    ../RenderSystem/lib/VisKit/util/BrickedVolume.h \
+    ../RenderSystem/lib/VisKit/util/QuantizedVolume.h
 
 OTHER_FILES += \
     vorts.config \
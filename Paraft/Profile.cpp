@@ -0,0 +1,71 @@
+#include "Profile.h"
+
+static const char* TIMER_NAMES[PT_NUM_TIMERS] = {
+    "t_load", "t_classify", "t_extract", "t_create", "t_write"
+};
+
+static const char* COUNTER_NAMES[PC_NUM_COUNTERS] = {
+    "load_bytes", "voxels_expanded", "voxels_shrunk", "features",
+    "features_found", "features_lost", "load_queue", "write_queue"
+};
+
+void Profile::AddTime(int t, ProfileTimer timer, double seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rows_[t].seconds[timer] += seconds;
+}
+
+void Profile::Add(int t, ProfileCounter counter, int64_t value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rows_[t].counts[counter] += value;
+}
+
+void Profile::Add(int t, const TrackerCounters &counters) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Row &row = rows_[t];
+    row.counts[PC_VOXELS_EXPANDED] += counters.voxelsExpanded;
+    row.counts[PC_VOXELS_SHRUNK] += counters.voxelsShrunk;
+}
+
+void Profile::Set(int t, ProfileCounter counter, int64_t value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rows_[t].counts[counter] = value;
+}
+
+bool Profile::WriteCSV(const string &fpath) {
+    ofstream out(fpath.c_str(), ios::trunc);
+    if (!out) return false;
+
+    out << "t";
+    for (int i = 0; i < PT_NUM_TIMERS; ++i)   out << "," << TIMER_NAMES[i];
+    for (int i = 0; i < PC_NUM_COUNTERS; ++i) out << "," << COUNTER_NAMES[i];
+    out << endl;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = rows_.begin(); it != rows_.end(); ++it) {
+        out << it->first;
+        for (int i = 0; i < PT_NUM_TIMERS; ++i)   out << "," << it->second.seconds[i];
+        for (int i = 0; i < PC_NUM_COUNTERS; ++i) out << "," << it->second.counts[i];
+        out << endl;
+    }
+    return (bool)out;
+}
+
+bool Profile::WriteJSON(const string &fpath) {
+    ofstream out(fpath.c_str(), ios::trunc);
+    if (!out) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    out << "[" << endl;
+    for (auto it = rows_.begin(); it != rows_.end(); ++it) {
+        out << "  {\"t\": " << it->first;
+        for (int i = 0; i < PT_NUM_TIMERS; ++i) {
+            out << ", \"" << TIMER_NAMES[i] << "\": " << it->second.seconds[i];
+        }
+        for (int i = 0; i < PC_NUM_COUNTERS; ++i) {
+            out << ", \"" << COUNTER_NAMES[i] << "\": " << it->second.counts[i];
+        }
+        out << "}" << (std::next(it) != rows_.end() ? "," : "") << endl;
+    }
+    out << "]" << endl;
+    return (bool)out;
+}
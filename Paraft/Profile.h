@@ -0,0 +1,80 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "Utils.h"
+
+// Stage timers, wall time per time step
+enum ProfileTimer {
+    PT_LOAD,        // read and normalize all variables, on the loader thread
+    PT_CLASSIFY,    // classify every predicate
+    PT_EXTRACT,     // region growing, t_extract of the paper
+    PT_CREATE,      // updating the feature graph, t_create
+    PT_WRITE,       // feature records and mask volumes, on the writer thread
+    PT_NUM_TIMERS
+};
+
+// Counters per time step
+enum ProfileCounter {
+    PC_LOAD_BYTES,          // read from disk, the compressed size of bricked files
+    PC_VOXELS_EXPANDED,     // edge voxels visited growing tracked features
+    PC_VOXELS_SHRUNK,       // body voxels visited shrinking them
+    PC_FEATURES,            // in the whole volume after the step
+    PC_FEATURES_FOUND,      // new since the step before in tracking order, extracted or split off
+    PC_FEATURES_LOST,       // tracked from the step before but gone
+    PC_LOAD_QUEUE,          // steps waiting to be read when the step is tracked
+    PC_WRITE_QUEUE,         // jobs waiting to be written then
+    PC_NUM_COUNTERS
+};
+
+// What one tracker counts while it works on a time step. Plain integers on
+// the hot path, the owner hands them to the Profile once per step.
+struct TrackerCounters {
+    int64_t voxelsExpanded;
+    int64_t voxelsShrunk;
+    TrackerCounters() : voxelsExpanded(0), voxelsShrunk(0) { }
+};
+
+// Timers and counters of a run, a row per time step, filled from any stage
+// thread and written out as CSV or JSON at the end. Each call takes a lock,
+// so stages report once per step rather than per voxel.
+class Profile {
+public:
+    void AddTime(int t, ProfileTimer timer, double seconds);
+    void Add(int t, ProfileCounter counter, int64_t value);
+    void Add(int t, const TrackerCounters &counters);
+    void Set(int t, ProfileCounter counter, int64_t value);
+
+    bool WriteCSV(const string &fpath);
+    bool WriteJSON(const string &fpath);
+
+private:
+    struct Row {
+        double  seconds[PT_NUM_TIMERS];
+        int64_t counts[PC_NUM_COUNTERS];
+        Row() { fill(seconds, seconds+PT_NUM_TIMERS, 0.0); fill(counts, counts+PC_NUM_COUNTERS, 0); }
+    };
+
+    std::mutex     mutex_;
+    map<int, Row>  rows_;     // by time step
+};
+
+// Adds the time until it goes out of scope to a timer of the profile,
+// nothing if the profile is NULL
+class ScopedTimer {
+public:
+    ScopedTimer(Profile *pProfile, int t, ProfileTimer timer)
+        : pProfile_(pProfile), t_(t), timer_(timer), begin_(std::chrono::steady_clock::now()) { }
+   ~ScopedTimer() {
+        if (pProfile_ == NULL) return;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin_;
+        pProfile_->AddTime(t_, timer_, elapsed.count());
+    }
+
+private:
+    Profile *pProfile_;
+    int t_;
+    ProfileTimer timer_;
+    std::chrono::steady_clock::time_point begin_;
+};
+
+#endif // PROFILE_H
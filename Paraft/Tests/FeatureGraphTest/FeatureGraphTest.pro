@@ -0,0 +1,19 @@
+QMAKE_CXX       =  g++-4.8
+QMAKE_CXXFLAGS  = -std=c++11 -pthread -O2
+INCLUDEPATH    += ../.. ../../Benchmarks ../../../RenderSystem/lib/VisKit/util
+LIBS            = -lm -lpthread
+
+QMAKE_LINK       = $$QMAKE_CXX
+
+CONFIG          -= qt app_bundle
+
+SOURCES += \
+    main.cpp \
+    ../../FeatureTracker.cpp \
+    ../../VisibilityMask.cpp \
+    ../../FeatureGraph.cpp \
+    ../../FeatureHistory.cpp
+
+HEADERS += \
+    ../../Benchmarks/SyntheticData.h \
+    ../../FeatureGraph.h
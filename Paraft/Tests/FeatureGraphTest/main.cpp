@@ -0,0 +1,134 @@
+// Checks the events of the feature graph: first on labels scripted by hand
+// with a split, a merge, a birth and a death, then on a feature tracked
+// through a step in which it breaks in two.
+//
+//   FeatureGraphTest
+//
+// Exits with a failure if an event is missing or one is found that should
+// not be.
+
+#include "SyntheticData.h"
+#include "FeatureGraph.h"
+
+#include <cstdlib>
+#include <sstream>
+
+using namespace std;
+
+static const vector3i VOLUME_DIM(32, 16, 16);
+
+static int voxelIndex(const vector3i &v) {
+    return (v.z * VOLUME_DIM.y + v.y) * VOLUME_DIM.x + v.x;
+}
+
+// Calls func(index) for the voxels of box [lo, hi)
+template<class Func>
+static void forEachVoxel(const vector3i &lo, const vector3i &hi, Func func) {
+    for (int z = lo.z; z < hi.z; ++z) {
+        for (int y = lo.y; y < hi.y; ++y) {
+            for (int x = lo.x; x < hi.x; ++x) {
+                func(voxelIndex(vector3i(x, y, z)));
+            }
+        }
+    }
+}
+
+static void label(SparseMask &mask, const vector3i &lo, const vector3i &hi, int id) {
+    forEachVoxel(lo, hi, [&](int index) { mask.Set(index, id); });
+}
+
+static string describe(const FeatureEvent &e) {
+    static const char *names[] = { "continuation", "split", "merge", "birth", "death" };
+    ostringstream out;
+    out << names[e.type] << " (";
+    for (size_t i = 0; i < e.prevIds.size(); ++i) out << (i > 0 ? " " : "") << e.prevIds[i];
+    out << ") -> (";
+    for (size_t i = 0; i < e.ids.size(); ++i) out << (i > 0 ? " " : "") << e.ids[i];
+    out << ")";
+    return out.str();
+}
+
+// Events of step t are exactly the expected ones, in any order
+static bool sameEvents(const FeatureGraph &graph, int t, const vector<string> &expected) {
+    vector<string> found;
+    const vector<FeatureEvent> &events = graph.Events(t);
+    for (size_t i = 0; i < events.size(); ++i) {
+        found.push_back(describe(events[i]));
+    }
+    vector<string> sortedExpected(expected);
+    std::sort(found.begin(), found.end());
+    std::sort(sortedExpected.begin(), sortedExpected.end());
+    if (found == sortedExpected) return true;
+
+    for (size_t i = 0; i < found.size(); ++i) cout << "  found    " << found[i] << endl;
+    for (size_t i = 0; i < sortedExpected.size(); ++i) cout << "  expected " << sortedExpected[i] << endl;
+    return false;
+}
+
+// 1 splits into 1 and 5, 2 and 3 merge into 2, 4 dies, 6 is born
+static bool checkScripted() {
+    SparseMask prev, mask;
+    label(prev, vector3i(0, 0, 0),   vector3i(8, 4, 4),    1);
+    label(prev, vector3i(12, 0, 0),  vector3i(16, 4, 4),   2);
+    label(prev, vector3i(16, 0, 0),  vector3i(20, 4, 4),   3);
+    label(prev, vector3i(0, 10, 10), vector3i(4, 14, 14),  4);
+
+    label(mask, vector3i(0, 0, 0),   vector3i(3, 4, 4),    1);
+    label(mask, vector3i(5, 0, 0),   vector3i(8, 4, 4),    5);
+    label(mask, vector3i(13, 0, 0),  vector3i(19, 4, 4),   2);
+    label(mask, vector3i(24, 10, 10), vector3i(28, 14, 14), 6);
+
+    FeatureGraph graph;
+    graph.Update(prev, mask, 1);
+    vector<string> expected;
+    expected.push_back("split (1) -> (1 5)");
+    expected.push_back("merge (2 3) -> (2)");
+    expected.push_back("death (4) -> ()");
+    expected.push_back("birth () -> (6)");
+    bool ok = sameEvents(graph, 1, expected);
+    ok = ok && graph.Successors(0, 1) == vector<int>({ 1, 5 }) && graph.Predecessors(1, 2) == vector<int>({ 2, 3 });
+    cout << "scripted events: " << (ok ? "ok" : "wrong") << endl;
+    return ok;
+}
+
+// Two boxes joined by a bar, which is gone at the next step. The larger box
+// keeps the label of the feature, the other one is split off as a new one.
+static bool checkTrackedSplit() {
+    const vector3i bigLo(4, 4, 4), bigHi(10, 10, 10), smallLo(18, 4, 4), smallHi(23, 10, 10);
+    vector<float> volume((size_t)VOLUME_DIM.x * VOLUME_DIM.y * VOLUME_DIM.z, 0.0f);
+    auto fill = [&](const vector3i &lo, const vector3i &hi, float value) {
+        forEachVoxel(lo, hi, [&](int index) { volume[index] = value; });
+    };
+
+    FeatureTracker tracker(VOLUME_DIM);
+    tracker.SetTF(SyntheticData::RampTF());
+    fill(bigLo, bigHi, 1.0f);
+    fill(smallLo, smallHi, 1.0f);
+    fill(vector3i(10, 6, 6), vector3i(18, 8, 8), 1.0f);
+    tracker.SetVolume(vector<VolumeView>(1, SyntheticData::View(volume)));
+    tracker.ExtractAllFeatures();
+    tracker.SaveExtractedFeatures(0);
+
+    fill(vector3i(10, 6, 6), vector3i(18, 8, 8), 0.0f);
+    tracker.TrackFeature(vector<VolumeView>(1, SyntheticData::View(volume)), FT_FORWARD, FT_DIRECT);
+    tracker.SaveExtractedFeatures(1);
+
+    FeatureGraph graph;
+    graph.Update(tracker.GetPrevMask(), tracker.GetMask(), 1);
+    int before = tracker.GetPrevMask().Get(voxelIndex(bigLo));
+    int big = tracker.GetMask().Get(voxelIndex(bigLo)), small = tracker.GetMask().Get(voxelIndex(smallLo));
+    ostringstream split;
+    split << "split (" << before << ") -> (" << big << " " << small << ")";
+
+    bool ok = sameEvents(graph, 1, vector<string>(1, split.str())) && big == before && small > big;
+    ok = ok && tracker.GetFeatureVectorPointer(1)->size() == 2;
+    forEachVoxel(smallLo, smallHi, [&](int index) { ok = ok && tracker.GetMask().Get(index) == small; });
+    cout << "tracked split: " << (ok ? "ok" : "wrong") << endl;
+    return ok;
+}
+
+int main() {
+    bool scripted = checkScripted();
+    bool tracked = checkTrackedSplit();
+    return scripted && tracked ? EXIT_SUCCESS : EXIT_FAILURE;
+}
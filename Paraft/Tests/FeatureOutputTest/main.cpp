@@ -0,0 +1,123 @@
+// Tracks synthetic time steps, writes every step with FeatureWriter and reads
+// it back: the written features have to be exactly the tracked ones, each
+// with the runs of its body voxels. Most blobs are below the size limit, so
+// labels of components that were not kept would show up as extra features
+// or extra voxels.
+//
+//   FeatureOutputTest [work directory]
+//
+// The feature files are written to the work directory, /tmp by default.
+// Exits with a failure at the first difference.
+
+#include "SyntheticData.h"
+#include "FeatureWriter.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+static const vector3i VOLUME_DIM(64, 48, 40);
+static const int NUM_STEPS = 8;
+static const int MIN_VOXELS = 300;      // about a blob of radius 4
+
+// Voxel indices per feature id, sorted
+typedef map<int, vector<int> > Labels;
+
+static Labels trackedLabels(FeatureTracker &tracker, const vector<Feature> &features) {
+    Labels labels;
+    for (size_t i = 0; i < features.size(); ++i) {
+        vector<int> &voxels = labels[features[i].maskValue];
+        for (VoxelSet::const_iterator p = features[i].bodyVoxels.begin(); p != features[i].bodyVoxels.end(); ++p) {
+            voxels.push_back(tracker.GetVoxelIndex(*p));
+        }
+        std::sort(voxels.begin(), voxels.end());
+    }
+    return labels;
+}
+
+static Labels writtenLabels(FeatureReader &reader, const vector<FeatureEntry> &entries) {
+    Labels labels;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        vector<int> &voxels = labels[entries[i].id];
+        vector<FeatureRun> runs = reader.ReadRuns(entries[i]);
+        for (size_t r = 0; r < runs.size(); ++r) {
+            for (int k = 0; k < runs[r].length; ++k) {
+                voxels.push_back(runs[r].start + k);
+            }
+        }
+        if ((int)voxels.size() != entries[i].numVoxels) voxels.clear();     // never equal to a body
+    }
+    return labels;
+}
+
+// First feature id whose voxels differ, 0 if there is none
+static int firstDifference(const Labels &a, const Labels &b) {
+    for (Labels::const_iterator it = a.begin(); it != a.end(); ++it) {
+        Labels::const_iterator other = b.find(it->first);
+        if (other == b.end() || other->second != it->second) return it->first;
+    }
+    for (Labels::const_iterator it = b.begin(); it != b.end(); ++it) {
+        if (a.count(it->first) == 0) return it->first;
+    }
+    return 0;
+}
+
+static bool check(const string &dir, int numThreads) {
+    char name[32];
+    sprintf(name, "/output%d", numThreads);
+    string basePath = dir + name;
+
+    SyntheticData data(VOLUME_DIM, 40, 2.0f, 8.0f);
+    FeatureTracker tracker(VOLUME_DIM);
+    tracker.SetTF(SyntheticData::RampTF());
+    tracker.SetNumThreads(numThreads);
+    tracker.SetMinNumVoxels(MIN_VOXELS);
+
+    FeatureWriter writer;
+    if (!writer.Open(basePath, VOLUME_DIM)) {
+        cout << "cannot write " << basePath << endl;
+        return false;
+    }
+    map<int, Labels> tracked;
+    vector<float> volume;
+    for (int t = 0; t < NUM_STEPS; ++t) {
+        data.Step(t, volume);
+        vector<VolumeView> views(1, SyntheticData::View(volume));
+        if (t == 0) {
+            tracker.SetVolume(views);
+            tracker.ExtractAllFeatures();
+        } else {
+            tracker.TrackFeature(views, FT_FORWARD, FT_LINEAR);
+        }
+        tracker.SaveExtractedFeatures(t);
+        tracked[t] = trackedLabels(tracker, *tracker.GetFeatureVectorPointer(t));
+        writer.Write(tracker.GetMask(), vector<FeatureEdge>(), t);
+    }
+    writer.Close();
+
+    FeatureReader reader;
+    if (!reader.Open(basePath)) {
+        cout << "cannot read " << basePath << endl;
+        return false;
+    }
+    cout << numThreads << " thread(s): ";
+    for (int t = 0; t < NUM_STEPS; ++t) {
+        map<int, vector<FeatureEntry> >::const_iterator entries = reader.Features().find(t);
+        Labels written = entries != reader.Features().end() ? writtenLabels(reader, entries->second) : Labels();
+        int id = firstDifference(tracked[t], written);
+        if (id != 0) {
+            cout << "feature " << id << " differs @ " << t << endl;
+            return false;
+        }
+    }
+    cout << "written as tracked over " << NUM_STEPS << " steps" << endl;
+    return true;
+}
+
+int main(int argc, char **argv) {
+    string dir = argc > 1 ? argv[1] : "/tmp";
+    bool serial = check(dir, 1);
+    bool parallel = check(dir, 4);
+    return serial && parallel ? EXIT_SUCCESS : EXIT_FAILURE;
+}
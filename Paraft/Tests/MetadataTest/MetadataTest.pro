@@ -0,0 +1,15 @@
+QMAKE_CXX       =  g++-4.8
+QMAKE_CXXFLAGS  = -std=c++11 -pthread -O2
+INCLUDEPATH    += ../.. ../../../RenderSystem/lib/VisKit/util
+LIBS            = -lm -lpthread
+
+QMAKE_LINK       = $$QMAKE_CXX
+
+CONFIG          -= qt app_bundle
+
+SOURCES += \
+    main.cpp \
+    ../../Metadata.cpp
+
+HEADERS += \
+    ../../Metadata.h
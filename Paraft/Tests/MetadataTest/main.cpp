@@ -0,0 +1,327 @@
+// Feeds the .config parser valid and broken datasets and checks what it
+// makes of them: the values and paths of valid ones, and for broken ones
+// the error with the file and line it names. Covers several datasets per
+// file, Override and SetThresholdSets.
+//
+//   MetadataTest [work directory]
+//
+// The configs are written to the work directory, /tmp by default. Prints
+// every failed check and exits with a failure if there was one.
+
+#include "Metadata.h"
+
+#include <cstdlib>
+#include <sstream>
+
+using namespace std;
+
+static string configPath;
+static int numChecks = 0, numFailed = 0;
+
+static void check(bool ok, const string &what) {
+    numChecks++;
+    if (ok) return;
+    numFailed++;
+    cout << "FAIL " << what << endl;
+}
+
+static bool writeConfig(const string &text) {
+    ofstream out(configPath.c_str(), ios::trunc);
+    out << text;
+    return (bool)out;
+}
+
+// A valid dataset: the header, the required keys with a comment in place of
+// the one to leave out, then extra and }. extra starts on line 10.
+static string dataset(const string &extra, const string &skip = "", const string &name = "a") {
+    const char *lines[][2] = {
+        { "start",      "1" },
+        { "end",        "4" },
+        { "prefix",     "\"v\"" },
+        { "suffix",     "\"raw\"" },
+        { "path",       "\"/data\"" },
+        { "tfPath",     "\"/data/tf.tfe\"" },
+        { "timeFormat", "\"%02d\"" },
+        { "volumeDim",  "(8, 6, 4)" },
+    };
+    ostringstream out;
+    out << "Metadata " << name << " {\n";
+    for (size_t i = 0; i < sizeof(lines)/sizeof(lines[0]); ++i) {
+        if (skip == lines[i][0]) {
+            out << "    # no " << skip << "\n";
+        } else {
+            out << "    " << lines[i][0] << " = " << lines[i][1] << "\n";
+        }
+    }
+    out << extra;
+    out << "}\n";
+    return out.str();
+}
+
+// text is rejected with an error ending in expected, after "<file>:"
+static void expectError(const string &text, const string &expected) {
+    string what = "error \"" + expected + "\"";
+    if (!writeConfig(text)) { check(false, what + ", cannot write " + configPath); return; }
+    Metadata meta(configPath);
+    if (meta.valid()) { check(false, what + ", accepted"); return; }
+    const string &error = meta.error();
+    bool ok = error.compare(0, configPath.size() + 1, configPath + ":") == 0 &&
+              error.size() >= expected.size() && error.compare(error.size() - expected.size(), expected.size(), expected) == 0;
+    check(ok, what + ", got \"" + error + "\"");
+}
+
+static bool load(const string &text, Metadata &meta) {
+    if (!writeConfig(text)) return false;
+    meta = Metadata(configPath);
+    if (!meta.valid()) cout << meta.error() << endl;
+    return meta.valid();
+}
+
+static void checkStructure() {
+    expectError("", ": no Metadata block");
+    expectError("start = 1\n", ":1: expected Metadata [name] {");
+    expectError("Dataset a {\n}\n", ":1: expected Metadata [name] {");
+    expectError("Metadata a b {\n}\n", ":1: expected Metadata [name] {");
+    expectError("}\n", ":1: } without a block");
+    expectError("Metadata a {\n    start = 1\nMetadata b {\n", ":3: missing }");
+    expectError("Metadata a {\n    start = 1\n", ": missing } at the end");
+    expectError(dataset("    numThreads\n"), ":10: expected key = value");
+    expectError(dataset("", "prefix"), ":10: missing prefix");
+    expectError(dataset("", "volumeDim"), ":10: missing volumeDim");
+}
+
+static void checkKeys() {
+    expectError(dataset("    colour = 3\n"), ":10: colour: unknown key");
+    expectError(dataset("    blockGrid = (1, 1, 1)\n"), ":10: blockGrid: unknown key");
+    expectError(dataset("    start = 2\n"), ":10: start set twice");
+    expectError(dataset("    numThreads = 2\n    numThreads = 2\n"), ":11: numThreads set twice");
+    expectError(dataset("    start = 1.5\n", "start"), ":10: start: expected an integer");
+    expectError(dataset("    numThreads = two\n"), ":10: numThreads: expected a positive integer");
+    expectError(dataset("    numThreads = 0\n"), ":10: numThreads: expected a positive integer");
+    expectError(dataset("    minVoxels = 99999999999\n"), ":10: minVoxels: expected a positive integer");
+    expectError(dataset("    prefetch = -1\n"), ":10: prefetch: expected an integer of at least 0");
+    expectError(dataset("    opacityThreshold = 0.1x\n"), ":10: opacityThreshold: expected a number");
+    expectError(dataset("    saveMask = yes\n"), ":10: saveMask: expected true or false");
+    expectError(dataset("    prefix = v\n", "prefix"), ":10: prefix: expected a quoted string");
+    expectError(dataset("    prefix = \"v\"w\"\n", "prefix"), ":10: prefix: expected a quoted string");
+    expectError(dataset("    direction = forward\n"), ":10: direction: expected a quoted string");
+    expectError(dataset("    direction = \"sideways\"\n"), ":10: direction: unknown direction sideways");
+    expectError(dataset("    predictor = \"cubic\"\n"), ":10: predictor: unknown predictor cubic");
+    expectError(dataset("    profile = \"xml\"\n"), ":10: profile: unknown profile format xml");
+    expectError(dataset("    precision = \"int64\"\n"), ":10: precision: unknown precision int64");
+    expectError(dataset("    cachePolicy = \"fifo\"\n"), ":10: cachePolicy: unknown cache policy fifo");
+    expectError(dataset("", "end"), ":10: missing end");
+    expectError(dataset("    end = 0\n", "end"), ":11: end is before start");
+}
+
+static void checkTuples() {
+    const string dims = ":10: volumeDim: expected (x, y, z) of positive integers";
+    expectError(dataset("    volumeDim = (8, 6)\n", "volumeDim"), dims);
+    expectError(dataset("    volumeDim = (8, 6, 4, 2)\n", "volumeDim"), dims);
+    expectError(dataset("    volumeDim = (8, 0, 4)\n", "volumeDim"), dims);
+    expectError(dataset("    volumeDim = (8, 6, 4\n", "volumeDim"), dims);
+    expectError(dataset("    volumeDim = 8, 6, 4\n", "volumeDim"), dims);
+    expectError(dataset("    volumeDim = (8, , 4)\n", "volumeDim"), dims);
+    expectError(dataset("    volumeDim = (8, 6.5, 4)\n", "volumeDim"), dims);
+    expectError(dataset("    pinnedSteps = 1, 2\n"), ":10: pinnedSteps: expected (t, ...)");
+    expectError(dataset("    pinnedSteps = (1, x)\n"), ":10: pinnedSteps: not a time step: x");
+
+    const string variable = ":10: variable: expected (\"prefix\", \"suffix\"[, lo, hi])";
+    expectError(dataset("    variable = (\"u\")\n"), variable);
+    expectError(dataset("    variable = (\"u\", \"raw\", 0.1)\n"), variable);
+    expectError(dataset("    variable = (\"u\", \"raw\", 0.1, high)\n"), variable);
+    expectError(dataset("    variable = (\"u, \"raw\")\n"), variable);
+
+    Metadata meta;
+    if (load(dataset("    variable = (\"u,w\", \"raw\", 0.25, 0.75)\n    variable = (\"p\", \"dat\")\n"
+                     "    pinnedSteps = (2, 4)\n"), meta)) {
+        check(meta.variables().size() == 2, "two variables");
+        check(meta.variables()[0].prefix == "u,w" && meta.variables()[0].suffix == "raw", "comma inside quotes");
+        check(meta.variables()[0].range.lo == 0.25f && meta.variables()[0].range.hi == 0.75f, "variable range");
+        check(meta.dataFile(2, 2) == "/data/p02.dat", "path of the second variable");
+        check(meta.pinnedSteps().size() == 2 && meta.pinnedSteps()[1] == 4, "pinned steps");
+    } else {
+        check(false, "variables and pinned steps");
+    }
+}
+
+static void checkThresholdSets() {
+    const string shape = ":10: thresholdSet: expected (opacity, minVoxels[, lo, hi per variable])";
+    expectError(dataset("    thresholdSet = (0.2)\n"), shape);
+    expectError(dataset("    thresholdSet = (0.2, 10, 0.5)\n"), shape);
+    expectError(dataset("    thresholdSet = 0.2, 10\n"), shape);
+    expectError(dataset("    thresholdSet = (x, 10)\n"), ":10: thresholdSet: not a number: x");
+    expectError(dataset("    thresholdSet = (0.2, 0)\n"), ":10: thresholdSet: minVoxels is not a positive integer: 0");
+    expectError(dataset("    thresholdSet = (0.2, 10, 0.1, y)\n"), ":10: thresholdSet: not a number: y");
+    expectError(dataset("    thresholdSet = (0.2, 10, 0.1, 0.9)\n"),
+                ":11: a thresholdSet has ranges for more variables than there are");
+
+    Metadata meta;
+    if (load(dataset("    variable = (\"u\", \"raw\", 0.25, 0.75)\n    opacityThreshold = 0.1\n    minVoxels = 5\n"
+                     "    thresholdSet = (0.3, 20)\n    thresholdSet = (0.5, 40, 0, 0.5)\n"), meta)) {
+        const vector<FeaturePredicate> &p = meta.predicates();
+        check(p.size() == 3, "a predicate per thresholdSet after the base one");
+        check(p.size() == 3 && p[0].opacity == 0.1f && p[0].minVoxels == 5 && p[0].ranges[0].lo == 0.25f, "base predicate");
+        check(p.size() == 3 && p[1].opacity == 0.3f && p[1].minVoxels == 20 && p[1].ranges[0].hi == 0.75f,
+              "thresholdSet without ranges keeps the variable's");
+        check(p.size() == 3 && p[2].opacity == 0.5f && p[2].minVoxels == 40 && p[2].ranges[0].lo == 0.0f &&
+              p[2].ranges[0].hi == 0.5f, "thresholdSet with a range");
+    } else {
+        check(false, "thresholdSets");
+    }
+}
+
+static void checkTimeFormats() {
+    const string one = ":11: timeFormat has to format one integer, like %d";
+    expectError(dataset("    timeFormat = \"%d%d\"\n", "timeFormat"), one);
+    expectError(dataset("    timeFormat = \"step\"\n", "timeFormat"), one);
+    expectError(dataset("    timeFormat = \"%s\"\n", "timeFormat"), one);
+    expectError(dataset("    timeFormat = \"%03f\"\n", "timeFormat"), one);
+    expectError(dataset("    timeFormat = \"%%\"\n", "timeFormat"), one);
+    expectError(dataset("    dynamicTF = true\n    tfPath = \"/data/tf%s.tfe\"\n", "tfPath"),
+                ":12: with dynamicTF, tfPath may only format the time step, like %d");
+    expectError(dataset("    dynamicTF = true\n    tfPath = \"/data/%d/tf%d.tfe\"\n", "tfPath"),
+                ":12: with dynamicTF, tfPath may only format the time step, like %d");
+
+    Metadata meta;
+    if (load(dataset("    timeFormat = \"%%_%04d\"\n", "timeFormat"), meta)) {
+        check(meta.timestamp(3) == "%_0003" && meta.timestamp(12) == "%_0012", "timestamp inside and outside [start, end]");
+        check(meta.dataFile(3) == "/data/v%_0003.raw", "path of a time step");
+        check(meta.tfFile(3) == "/data/tf.tfe", "tfPath without dynamicTF");
+    } else {
+        check(false, "escaped % in timeFormat");
+    }
+    if (load(dataset("    dynamicTF = true\n    tfPath = \"/data/tf%d.tfe\"\n", "tfPath"), meta)) {
+        check(meta.tfFile(3) == "/data/tf3.tfe" && meta.tfFile(9) == "/data/tf9.tfe", "tfPath per time step");
+    } else {
+        check(false, "dynamicTF");
+    }
+}
+
+static void checkValues() {
+    Metadata meta;
+    string extra = "    numThreads = 4   // comment\n"
+                   "    prefetch = 0\n"
+                   "    saveMask = true  # comment\n"
+                   "    direction = \"both\"\n"
+                   "    predictor = \"kalman\"\n"
+                   "    profile = \"none\"\n"
+                   "    historyBudget = 3\n"
+                   "    suffix = \"raw#1//2\"\n";
+    if (!load(dataset(extra, "suffix", "jet"), meta)) {
+        check(false, "valid dataset");
+        return;
+    }
+    check(meta.name() == "jet", "dataset name");
+    check(meta.start() == 1 && meta.end() == 4, "start and end");
+    check(meta.volumeDim() == vector3i(8, 6, 4), "volumeDim");
+    check(meta.numThreads() == 4 && meta.prefetch() == 0, "integers after a comment");
+    check(meta.saveMask() && meta.direction() == FT_BIDIRECTIONAL && meta.predictor() == FT_KALMAN, "flags and names");
+    check(meta.profile().empty(), "profile none");
+    check(meta.historyBudget() == (size_t)3 << 20, "historyBudget in MB");
+    check(meta.suffix() == "raw#1//2", "comment markers inside quotes");
+    check(meta.dataFile(1) == "/data/v01.raw#1//2", "path of the first time step");
+    check(meta.predicates().size() == 1 && meta.predicates()[0].opacity == OPACITY_THRESHOLD &&
+          meta.predicates()[0].minVoxels == MIN_NUM_VOXEL_IN_FEATURE, "default predicate");
+}
+
+static void checkDatasets() {
+    string text = dataset("    numThreads = 2\n", "", "first") + "\n# second one\n" +
+                  dataset("    prefix = \"w\"\n", "prefix", "second");
+    vector<Metadata> datasets;
+    string error;
+    if (!writeConfig(text) || !Metadata::LoadAll(configPath, datasets, error)) {
+        check(false, "two datasets: " + error);
+        return;
+    }
+    check(datasets.size() == 2, "a Metadata per dataset");
+    check(datasets.size() == 2 && datasets[0].name() == "first" && datasets[1].name() == "second", "datasets in file order");
+    check(datasets.size() == 2 && datasets[1].numThreads() == 1, "keys do not carry over to the next dataset");
+    check(datasets.size() == 2 && datasets[1].dataFile(2) == "/data/w02.raw", "paths of the second dataset");
+    check(Metadata(configPath).name() == "first", "a single Metadata is the first dataset");
+
+    // an error in a later dataset names its line in the file
+    text = dataset("") + dataset("    volumeDim = (1, 2)\n", "volumeDim", "b");
+    if (writeConfig(text)) {
+        check(!Metadata::LoadAll(configPath, datasets, error), "an error in the second dataset");
+        check(error == configPath + ":20: volumeDim: expected (x, y, z) of positive integers", "line of the second dataset");
+    }
+    check(!Metadata::LoadAll(configPath + ".missing", datasets, error) &&
+          error == "cannot read meta file: " + configPath + ".missing", "missing file");
+}
+
+static void checkOverride() {
+    Metadata base;
+    if (!load(dataset("    thresholdSet = (0.3, 20)\n"), base)) {
+        check(false, "override base");
+        return;
+    }
+
+    Metadata meta = base;
+    vector<pair<string, string> > values;
+    values.push_back(make_pair(string("numThreads"), string("8")));
+    values.push_back(make_pair(string("prefix"), string("\"w\"")));
+    values.push_back(make_pair(string("thresholdSet"), string("(0.6, 30)")));
+    string error;
+    check(meta.Override(values, error), "valid override: " + error);
+    check(meta.numThreads() == 8, "overridden value");
+    check(meta.dataFile(2) == "/data/w02.raw", "paths formatted again");
+    check(meta.predicates().size() == 3 && meta.predicates()[2].opacity == 0.6f, "repeatable key adds to the config's");
+
+    meta = base;
+    values.assign(1, make_pair(string("numThreads"), string("0")));
+    check(!meta.Override(values, error) && error == "numThreads: expected a positive integer", "bad override value: " + error);
+    values.assign(1, make_pair(string("colour"), string("3")));
+    check(!meta.Override(values, error) && error == "colour: unknown key", "unknown override key: " + error);
+    values.assign(1, make_pair(string("end"), string("0")));
+    check(!meta.Override(values, error) && error == "end is before start", "override checked as a dataset: " + error);
+}
+
+static void checkSetThresholdSets() {
+    Metadata base;
+    if (!load(dataset("    variable = (\"u\", \"raw\", 0.25, 0.75)\n    thresholdSet = (0.9, 90)\n"), base)) {
+        check(false, "thresholdSet base");
+        return;
+    }
+
+    Metadata meta = base;
+    string error;
+    vector<string> sets;
+    check(meta.SetThresholdSets(sets, error) && meta.predicates().size() == 2, "no sets keep the config's");
+
+    sets.push_back("(0.3, 20, 0, 0.5)");
+    sets.push_back("(0.5, 40)");
+    check(meta.SetThresholdSets(sets, error), "valid sets: " + error);
+    const vector<FeaturePredicate> &p = meta.predicates();
+    check(p.size() == 2, "the sets replace the config's");
+    check(p.size() == 2 && p[0].opacity == 0.3f && p[0].minVoxels == 20 && p[0].ranges[0].hi == 0.5f,
+          "the first set replaces the base predicate");
+    check(p.size() == 2 && p[1].opacity == 0.5f && p[1].minVoxels == 40 && p[1].ranges[0].hi == 0.5f,
+          "later sets start from the first");
+
+    meta = base;
+    sets.assign(1, "(0.3)");
+    check(!meta.SetThresholdSets(sets, error) &&
+          error == "thresholdSet (0.3): expected (opacity, minVoxels[, lo, hi per variable])", "bad set: " + error);
+    sets.assign(1, "(0.3, 20, 0, 1, 0, 1)");
+    check(!meta.SetThresholdSets(sets, error) &&
+          error == "thresholdSet (0.3, 20, 0, 1, 0, 1): ranges for more variables than there are", "too many ranges: " + error);
+}
+
+int main(int argc, char **argv) {
+    string dir = argc > 1 ? argv[1] : "/tmp";
+    configPath = dir + "/metadata.config";
+
+    checkStructure();
+    checkKeys();
+    checkTuples();
+    checkThresholdSets();
+    checkTimeFormats();
+    checkValues();
+    checkDatasets();
+    checkOverride();
+    checkSetThresholdSets();
+
+    cout << numChecks << " checks, " << numFailed << " failed" << endl;
+    return numFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
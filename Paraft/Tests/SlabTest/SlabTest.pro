@@ -0,0 +1,26 @@
+QMAKE_CXX       =  g++-4.8
+QMAKE_CXXFLAGS  = -std=c++11 -pthread -O2
+INCLUDEPATH    += ../.. ../../Benchmarks ../../../RenderSystem/lib/VisKit/util
+LIBS            = -lm -lpthread
+
+QMAKE_LINK       = $$QMAKE_CXX
+
+CONFIG          -= qt app_bundle
+
+SOURCES += \
+    main.cpp \
+    ../../DataManager.cpp \
+    ../../FeatureTracker.cpp \
+    ../../BlockController.cpp \
+    ../../Metadata.cpp \
+    ../../VisibilityMask.cpp \
+    ../../FeatureWriter.cpp \
+    ../../FeatureGraph.cpp \
+    ../../Checkpoint.cpp \
+    ../../FeatureHistory.cpp \
+    ../../Profile.cpp \
+    ../../TimestepCache.cpp
+
+HEADERS += \
+    ../../Benchmarks/SyntheticData.h \
+    ../../BlockController.h
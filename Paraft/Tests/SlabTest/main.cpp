@@ -0,0 +1,146 @@
+// Tracks the same synthetic time steps with one and with several extraction
+// threads and checks that every step comes out as on a single thread: the
+// same labels for the same voxels and the same feature graph edges.
+//
+//   SlabTest [work directory]
+//
+// The volumes, TF and config are written to the work directory, /tmp by
+// default, along with the feature output of every run. Exits with a failure
+// at the first difference.
+
+#include "SyntheticData.h"
+#include "BlockController.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+static const vector3i VOLUME_DIM(61, 50, 43);   // slabs of uneven depth below
+static const int NUM_STEPS = 10;   // written, the last one is only read ahead
+
+static bool writeInputs(const string &dir, const string &configPath) {
+    SyntheticData data(VOLUME_DIM, 40, 3.0f, 9.0f);
+    vector<float> volume;
+    for (int t = 0; t < NUM_STEPS; ++t) {
+        data.Step(t, volume);
+        char name[32];
+        sprintf(name, "/slabs%02d.raw", t);
+        ofstream out((dir + name).c_str(), ios::binary);
+        util::writeRaw(out, volume.data(), volume.size());
+        if (!out) return false;
+    }
+
+    shared_ptr<const TransferFunction> tf = SyntheticData::RampTF();
+    ofstream tfOut((dir + "/slabs.tfe").c_str(), ios::binary);
+    float resolution = (float)tf->map.size();
+    util::writeRaw(tfOut, &resolution, 1);
+    util::writeRaw(tfOut, tf->map.data(), tf->map.size());
+    if (!tfOut) return false;
+
+    ofstream config(configPath.c_str());
+    config << "Metadata slabs {\n"
+           << "    start      = 0\n"
+           << "    end        = " << NUM_STEPS-1 << "\n"     // read, but not tracked
+
+           << "    prefix     = \"slabs\"\n"
+           << "    suffix     = \"raw\"\n"
+           << "    path       = \"" << dir << "\"\n"
+           << "    tfPath     = \"" << dir << "/slabs.tfe\"\n"
+           << "    timeFormat = \"%02d\"\n"
+           << "    volumeDim  = (" << VOLUME_DIM.x << ", " << VOLUME_DIM.y << ", " << VOLUME_DIM.z << ")\n"
+           << "    dynamicTF  = false\n"
+           << "    opacityThreshold = 0.2\n"
+           << "    minVoxels  = 10\n"
+           << "    predictor  = \"linear\"\n"
+           << "}\n";
+    return (bool)config;
+}
+
+// Labels and graph edges of every step of a forward run
+struct Run {
+    map<int, SparseMask>          masks;
+    map<int, vector<FeatureEdge> > edges;
+};
+
+static void track(const Metadata &meta, const string &tag, Run &run) {
+    BlockController controller;
+    controller.SetOutputTag(tag);
+    controller.KeepMasks(true);
+    controller.SetCurrentTimestep(meta.start());
+    controller.InitParameters(meta);
+    for (int t = meta.start()+1; t < meta.end(); ++t) {
+        controller.SetCurrentTimestep(t);
+        controller.TrackForward(meta);
+        run.masks[t] = *controller.GetTrackedMask(t);
+        run.edges[t] = controller.GetFeatureGraph().Edges(t);
+    }
+}
+
+// First voxel labeled differently, -1 if there is none
+static int firstDifference(const SparseMask &a, const SparseMask &b) {
+    int first = -1;
+    auto check = [&](const SparseMask &x, const SparseMask &y) {
+        x.ForEach([&](int index, int label) {
+            if (y.Get(index) != label && (first < 0 || index < first)) first = index;
+        });
+    };
+    check(a, b);
+    check(b, a);
+    return first;
+}
+
+static bool sameEdges(const vector<FeatureEdge> &a, const vector<FeatureEdge> &b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].prevId != b[i].prevId || a[i].id != b[i].id || a[i].overlap != b[i].overlap) return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    string dir = argc > 1 ? argv[1] : "/tmp";
+    string configPath = dir + "/slabs.config";
+    if (!writeInputs(dir, configPath)) {
+        cout << "cannot write the test data to " << dir << endl;
+        return EXIT_FAILURE;
+    }
+    Metadata meta(configPath);
+    if (!meta.valid()) {
+        cout << meta.error() << endl;
+        return EXIT_FAILURE;
+    }
+
+    Run single;
+    track(meta, ".single", single);
+
+    const char *threads[] = { "2", "3", "4", "7" };
+    int failed = 0;
+    for (size_t n = 0; n < sizeof(threads)/sizeof(threads[0]); ++n) {
+        Metadata slabs = meta;
+        vector<pair<string, string> > values(1, make_pair(string("numThreads"), string(threads[n])));
+        string error;
+        if (!slabs.Override(values, error)) {
+            cout << error << endl;
+            return EXIT_FAILURE;
+        }
+
+        Run run;
+        track(slabs, ".slabs", run);
+        int differentT = INT_MIN, voxel = -1;
+        for (int t = meta.start()+1; t < meta.end() && differentT == INT_MIN; ++t) {
+            voxel = firstDifference(single.masks[t], run.masks[t]);
+            if (voxel >= 0 || !sameEdges(single.edges[t], run.edges[t])) differentT = t;
+        }
+        cout << threads[n] << " threads: ";
+        if (differentT == INT_MIN) {
+            cout << "same as a single thread over " << meta.end()-meta.start()-1 << " steps" << endl;
+        } else {
+            cout << "differs @ " << differentT;
+            if (voxel >= 0) cout << ", voxel " << voxel;
+            cout << endl;
+            failed++;
+        }
+    }
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
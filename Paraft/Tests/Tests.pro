@@ -0,0 +1,7 @@
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    SlabTest \
+    FeatureOutputTest \
+    FeatureGraphTest \
+    MetadataTest
@@ -0,0 +1,76 @@
+#include "TimestepCache.h"
+
+void TimestepCache::Configure(int policy, size_t budget, const vector<int> &pinned) {
+    policy_ = policy;
+    budget_ = budget;
+    pinned_.clear();
+    pinned_.insert(pinned.begin(), pinned.end());
+}
+
+void TimestepCache::Insert(int t, const StepFuture &volumes, size_t bytes, bool onDemand) {
+    Entry &e = steps_[t];
+    e.volumes = volumes;
+    e.bytes = bytes;
+    e.used = onDemand;
+    lru_.push_front(t);
+    e.lru = lru_.begin();
+
+    bytes_ += bytes;
+    stats_.peakBytes = std::max(stats_.peakBytes, bytes_);
+    stats_.loads++;
+    if (evicted_.erase(t) > 0) stats_.reloads++;
+    if (onDemand) stats_.misses++;
+}
+
+StepFuture TimestepCache::Use(int t) {
+    auto it = steps_.find(t);
+    if (it == steps_.end()) return StepFuture();
+
+    Entry &e = it->second;
+    lru_.splice(lru_.begin(), lru_, e.lru);
+    if (!e.used) {
+        e.used = true;
+        if (e.volumes.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            stats_.hits++;
+        } else {
+            stats_.waits++;
+        }
+    }
+    return e.volumes;
+}
+
+vector<pair<int, StepFuture> > TimestepCache::Evict(int first, int last, size_t incoming) {
+    vector<pair<int, StepFuture> > victims;
+    // least recently used first, so LRU can stop once the rest fits
+    auto it = lru_.end();
+    while (it != lru_.begin()) {
+        int t = *--it;
+        if ((t >= first && t <= last) || pinned_.count(t) > 0) continue;
+        if (policy_ == CP_LRU && (budget_ == 0 || bytes_ + incoming <= budget_)) break;
+
+        victims.push_back(make_pair(t, steps_[t].volumes));
+        ++it;           // stays valid, t's node goes
+        remove(t);
+        evicted_.insert(t);
+        stats_.evictions++;
+    }
+    return victims;
+}
+
+vector<StepFuture> TimestepCache::Clear() {
+    vector<StepFuture> all;
+    for (auto it = steps_.begin(); it != steps_.end(); ++it) {
+        all.push_back(it->second.volumes);
+    }
+    steps_.clear();
+    lru_.clear();
+    bytes_ = 0;
+    return all;
+}
+
+void TimestepCache::remove(int t) {
+    auto it = steps_.find(t);
+    bytes_ -= it->second.bytes;
+    lru_.erase(it->second.lru);
+    steps_.erase(it);
+}
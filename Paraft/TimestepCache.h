@@ -0,0 +1,78 @@
+#ifndef TIMESTEPCACHE_H
+#define TIMESTEPCACHE_H
+
+#include "Utils.h"
+
+// What happens to a loaded time step once it leaves the tracking window
+enum CachePolicy {
+    CP_WINDOW,      // unloaded right away
+    CP_LRU          // kept, the least recently used ones go when the byte budget is reached
+};
+
+// All variables of a time step, the primary one first. Completes once the
+// step is loaded.
+typedef shared_future<vector<VolumeView> > StepFuture;
+
+// Loaded and loading time steps of a DataManager. Steps inside the window
+// and pinned ones are never evicted, the others according to the policy.
+// Also counts whether a step was already there when it was first used.
+// Not thread safe, the owner locks around it.
+class TimestepCache {
+public:
+    struct Stats {
+        int    hits;            // loaded when first used
+        int    waits;           // still being read then
+        int    misses;          // not even queued, read on demand
+        int    loads;
+        int    reloads;         // read again after being evicted
+        int    evictions;
+        int    cutPrefetches;   // window steps not read ahead to stay in the budget
+        size_t peakBytes;
+        Stats() : hits(0), waits(0), misses(0), loads(0), reloads(0), evictions(0), cutPrefetches(0), peakBytes(0) { }
+    };
+
+    // 0 bytes is no budget: the window policy then keeps just the window,
+    // LRU keeps everything
+    void Configure(int policy, size_t budget, const vector<int> &pinned);
+
+    bool Contains(int t) const  { return steps_.count(t) > 0; }
+    // Whether bytes more stay within the budget
+    bool Fits(size_t bytes) const { return budget_ == 0 || bytes_ + bytes <= budget_; }
+
+    // Adds t, to be read into volumes. A step read on demand counts as a miss
+    // and as used.
+    void Insert(int t, const StepFuture &volumes, size_t bytes, bool onDemand);
+    // t as the most recently used step, an invalid future if it is not here
+    StepFuture Use(int t);
+    // Evicts what the policy drops before the window [first, last] gets
+    // incoming bytes more. The caller unloads what is returned.
+    vector<pair<int, StepFuture> > Evict(int first, int last, size_t incoming);
+    void CutPrefetch()          { stats_.cutPrefetches++; }
+    // Everything, for unloading at the end
+    vector<StepFuture> Clear();
+
+    int          Policy() const  { return policy_; }
+    size_t       Budget() const  { return budget_; }
+    const Stats& GetStats() const { return stats_; }
+
+private:
+    struct Entry {
+        StepFuture volumes;
+        size_t     bytes;
+        bool       used;
+        list<int>::iterator lru;
+    };
+
+    void remove(int t);
+
+    map<int, Entry>  steps_;
+    list<int>        lru_;          // front is the most recently used
+    set<int>         pinned_;
+    set<int>         evicted_;      // to tell reloads apart
+    int              policy_ = CP_WINDOW;
+    size_t           budget_ = 0;
+    size_t           bytes_ = 0;
+    Stats            stats_;
+};
+
+#endif // TIMESTEPCACHE_H
@@ -6,18 +6,33 @@
 #include <fstream>
 #include <iostream>
 #include <cmath>
+#include <cfloat>
 #include <string>
 #include <vector>
 #include <list>
 #include <map>
+#include <set>
+#include <thread>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <climits>
 
-const float OPACITY_THRESHOLD  = 0.1;
+#include "IndexMap.h"
+#include "QuantizedVolume.h"
+
+const float OPACITY_THRESHOLD  = 0.1;       // defaults, overridden per run by the config
 const int MIN_NUM_VOXEL_IN_FEATURE = 10;
 const int FT_DIRECT = 0;
 const int FT_LINEAR = 1;
 const int FT_POLYNO = 2;
+const int FT_LEASTSQ = 3;
+const int FT_KALMAN = 4;
+const int MOTION_HISTORY_DEPTH = 6;     // time steps of motion kept per feature
 const int FT_FORWARD  = 0;
 const int FT_BACKWARD = 1;
+const int FT_BIDIRECTIONAL = 2;
 const int DEFAULT_TF_RES = 1024;
 
 using namespace std;
@@ -74,17 +89,176 @@ namespace util {
     static inline int round(float f) {
         return static_cast<int>(floor(f + 0.5f));
     }
+
+    // Raw binary I/O of count elements of a POD type
+    template<class T>
+    static inline void writeRaw(ostream &out, const T *p, size_t count) {
+        out.write(reinterpret_cast<const char*>(p), count*sizeof(T));
+    }
+
+    template<class T>
+    static inline bool readRaw(istream &in, T *p, size_t count) {
+        in.read(reinterpret_cast<char*>(p), count*sizeof(T));
+        return (size_t)in.gcount() == count*sizeof(T);
+    }
+
+    // Splits [begin, end) into numThreads contiguous chunks and runs
+    // func(chunkIndex, chunkBegin, chunkEnd) for each chunk on its own thread.
+    template<class Func>
+    static inline void parallelFor(int begin, int end, int numThreads, Func func) {
+        int n = end - begin;
+        numThreads = std::max(1, std::min(numThreads, n));
+        if (numThreads == 1) { func(0, begin, end); return; }
+
+        vector<std::thread> threads;
+        for (int k = 0; k < numThreads; ++k) {
+            int b = begin + (int)((long long)n * k / numThreads);
+            int e = begin + (int)((long long)n * (k+1) / numThreads);
+            threads.push_back(std::thread(func, k, b, e));
+        }
+        for (size_t k = 0; k < threads.size(); ++k) {
+            threads[k].join();
+        }
+    }
+
+    // Word w of a bit array with the bits outside [begin, end) cleared
+    static inline uint64_t maskedWord(const uint64_t *words, int w, int begin, int end) {
+        uint64_t word = words[w];
+        if (w == begin >> 6)                    { word &= ~0ULL << (begin & 63); }
+        if (w == (end-1) >> 6 && (end & 63))    { word &= (1ULL << (end & 63)) - 1; }
+        return word;
+    }
+
+    // Calls func(index) for every set bit in [begin, end) of a bit array,
+    // skipping 64 clear bits at a time
+    template<class Func>
+    static inline void forEachSetBit(const uint64_t *words, int begin, int end, Func func) {
+        if (begin >= end) return;
+        for (int w = begin >> 6; w <= (end-1) >> 6; ++w) {
+            for (uint64_t word = maskedWord(words, w, begin, end); word != 0; word &= word - 1) {
+                func(w*64 + __builtin_ctzll(word));
+            }
+        }
+    }
+
+    // Number of set bits in [begin, end) of a bit array
+    static inline int countSetBits(const uint64_t *words, int begin, int end) {
+        int count = 0;
+        if (begin >= end) return 0;
+        for (int w = begin >> 6; w <= (end-1) >> 6; ++w) {
+            count += __builtin_popcountll(maskedWord(words, w, begin, end));
+        }
+        return count;
+    }
+
+    // FNV-1a over raw bytes, to tell contents apart without comparing them
+    static inline uint64_t hashBytes(const void *p, size_t bytes) {
+        const unsigned char *c = static_cast<const unsigned char*>(p);
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < bytes; ++i) { h = (h ^ c[i]) * 1099511628211ULL; }
+        return h;
+    }
 }
 
 typedef util::vector3<int> vector3i;
 typedef util::vector3<float> vector3f;
 
+// Unordered set of voxels stored contiguously, with O(1) insert, lookup and
+// removal through a flat slot table. Removal swaps the last voxel into the
+// hole, so iteration order is not preserved.
+class VoxelSet {
+public:
+    typedef vector<vector3i>::const_iterator const_iterator;
+
+    const_iterator  begin() const                   { return voxels_.begin(); }
+    const_iterator  end() const                     { return voxels_.end(); }
+    const vector3i& back() const                    { return voxels_.back(); }
+    size_t          size() const                    { return voxels_.size(); }
+    bool            empty() const                   { return voxels_.empty(); }
+    bool            contains(const vector3i &v) const { return slots_.find(key(v)) != NULL; }
+
+    void reserve(size_t n) { voxels_.reserve(n); slots_.reserve(n); }
+    void clear()           { voxels_.clear(); slots_.clear(); }
+    void swap(VoxelSet &rhs) { voxels_.swap(rhs.voxels_); slots_.swap(rhs.slots_); }
+
+    // Returns false if the voxel is already in the set.
+    bool insert(const vector3i &v) {
+        if (contains(v)) return false;
+        slots_.set(key(v), voxels_.size());
+        voxels_.push_back(v);
+        return true;
+    }
+
+    // Returns false if the voxel is not in the set.
+    bool erase(const vector3i &v) {
+        const uint32_t *slot = slots_.find(key(v));
+        if (slot == NULL) return false;
+        uint32_t s = *slot;
+        const vector3i &last = voxels_.back();
+        if (s != voxels_.size() - 1) {
+            slots_.set(key(last), s);
+            voxels_[s] = last;
+        }
+        voxels_.pop_back();
+        slots_.erase(key(v));
+        return true;
+    }
+
+    void pop_back() { slots_.erase(key(voxels_.back())); voxels_.pop_back(); }
+
+private:
+    // coordinates are packed 21 bits each, enough for 2M^3 voxels
+    static uint64_t key(const vector3i &v) {
+        return  (uint64_t)(v.x & 0x1FFFFF)        | ((uint64_t)(v.y & 0x1FFFFF) << 21) |
+               ((uint64_t)(v.z & 0x1FFFFF) << 42);
+    }
+
+    vector<vector3i>   voxels_;
+    IndexMap<uint32_t> slots_;
+};
+
+// Integer feature label per voxel, 0 meaning background. Only labeled voxels
+// are stored, so clearing and swapping cost is proportional to the features,
+// not to the volume.
+class SparseMask {
+public:
+    int  Get(int index) const     { const int *label = labels_.find(key(index)); return label ? *label : 0; }
+    int  NumLabeled() const       { return (int)labels_.size(); }
+    void Clear()                  { labels_.clear(); }
+    void Swap(SparseMask &rhs)    { labels_.swap(rhs.labels_); }
+
+    void Set(int index, int label) {
+        if (label == 0) {
+            labels_.erase(key(index));
+        } else {
+            labels_.set(key(index), label);
+        }
+    }
+
+    // Visits every labeled voxel as func(index, label).
+    template<class Func>
+    void ForEach(Func func) const {
+        labels_.forEach([&](uint64_t index, int label) { func((int)index, label); });
+    }
+
+    // Expand to a dense float volume, as written to .mask files.
+    void ToDense(float *pData, int volumeSize) const {
+        std::fill(pData, pData+volumeSize, 0.0f);
+        ForEach([&](int index, int label) { pData[index] = (float)label; });
+    }
+
+private:
+    static uint64_t key(int index) { return (uint32_t)index; }
+
+    IndexMap<int> labels_;
+};
+
 struct Feature {
-    int             id;         // Unique ID for each feature
-    float           maskValue;  // Used to record the color of the feature
-    list<vector3i>  edgeVoxels; // Edge information of the feature
-    list<vector3i>  bodyVoxels; // All the voxels in the feature
-    vector3i        centroid;   // Centers position of the feature
+    int              id;         // Unique ID for each feature
+    int              maskValue;  // Label of the feature in the mask volume
+    vector<vector3i> edgeVoxels; // Edge information of the feature
+    VoxelSet         bodyVoxels; // All the voxels in the feature
+    vector3i         centroid;   // Centers position of the feature
 };
 
 struct Cluster {
@@ -92,7 +266,59 @@ struct Cluster {
     int numVoxels;
 };
 
-typedef unordered_map<int, float*> DataSequence;
+// Raw intensities of one time step, read in place, or their compact codes
+// (a QuantizedVolume::Type). Normalization to [0, 1] is applied lazily by
+// whoever reads it: value = (data[i] - offset) * scale.
+struct VolumeView {
+    const void *data;
+    int   type;
+    float offset;
+    float scale;
+    VolumeView(const void *d = NULL, int t = QuantizedVolume::FLOAT32, float o = 0.0f, float s = 1.0f)
+        : data(d), type(t), offset(o), scale(s) { }
+};
+
+// Counters of one pipeline stage: the time steps it finished, the time spent
+// on them and the time lost between it and the stage next to it
+struct StageStats {
+    int    items;
+    double busySeconds;
+    double waitSeconds;
+    StageStats() : items(0), busySeconds(0.0), waitSeconds(0.0) { }
+
+    void Print(const string &name, const string &waitLabel) const {
+        cout << name << ": " << items << " steps, busy " << busySeconds << "s";
+        if (busySeconds > 0) cout << " (" << items / busySeconds << " steps/s)";
+        cout << ", " << waitLabel << " " << waitSeconds << "s" << endl;
+    }
+};
+
+// Opacity per TF bin, with the hash of its content so a changed TF is told
+// from an unchanged one without comparing all of it
+struct TransferFunction {
+    vector<float> map;
+    uint64_t      hash;
+};
+
+// Values of one extra variable a feature is restricted to, normalized per
+// time step the same way as the primary one. Both ends are included.
+struct VariableRange {
+    float lo;
+    float hi;
+    VariableRange(float l = 0.0f, float h = 1.0f) : lo(l), hi(h) { }
+    bool Constrains() const { return lo > 0.0f || hi < 1.0f; }
+};
+
+// What makes a voxel part of a feature: its opacity under the TF reaches
+// opacity and every extra variable lies within its range. Connected parts
+// smaller than minVoxels are not kept as features.
+struct FeaturePredicate {
+    float                 opacity;
+    vector<VariableRange> ranges;       // one per extra variable, in their order
+    int                   minVoxels;
+    FeaturePredicate() : opacity(OPACITY_THRESHOLD), minVoxels(MIN_NUM_VOXEL_IN_FEATURE) { }
+};
+
 typedef unordered_map<int, vector<Feature> > FeatureVectorSequence;
 
 #endif // CONSTS_H
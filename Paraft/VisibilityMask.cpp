@@ -0,0 +1,224 @@
+#include "VisibilityMask.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using QuantizedVolume::Decode;
+#ifdef __SSE2__
+using QuantizedVolume::Load4;
+#endif
+
+const size_t MAX_SIMD_RANGES = 8;
+
+// A predicate prepared for one TF. Visible bins are collapsed into [lo, hi)
+// ranges of value*(tfRes-1); typical TFs have only a few, so each voxel is
+// tested with a handful of SIMD compares instead of a gather.
+struct CompiledPredicate {
+    vector<float> rangeLo;
+    vector<float> rangeHi;
+    vector<char>  visibleBins;  // fallback lookup when there are too many ranges
+    vector<int>   constrained;  // extra variables whose range rules out some values
+};
+
+static void compile(const FeaturePredicate &predicate, const vector<float> &tfMap, int numExtra,
+                    CompiledPredicate &c) {
+    const int tfRes = (int)tfMap.size();
+    c.visibleBins.assign(tfRes, 0);
+
+    for (int bin = 0; bin < tfRes; ++bin) {
+        if (tfMap[bin] < predicate.opacity) continue;
+        c.visibleBins[bin] = 1;
+
+        // (int)(value*(tfRes-1)) == bin  <=>  bin <= value*(tfRes-1) < bin+1,
+        // out of range values are clamped to the first and last bin
+        if (bin > 0 && c.visibleBins[bin-1]) {
+            c.rangeHi.back() = bin+1 == tfRes ? FLT_MAX : bin+1;
+        } else {
+            c.rangeLo.push_back(bin == 0 ? -FLT_MAX : bin);
+            c.rangeHi.push_back(bin+1 == tfRes ? FLT_MAX : bin+1);
+        }
+    }
+
+    for (int v = 0; v < std::min(numExtra, (int)predicate.ranges.size()); ++v) {
+        if (predicate.ranges[v].Constrains()) { c.constrained.push_back(v); }
+    }
+}
+
+// Bits of the voxels whose TF bin is visible. T is the element type of the
+// volume, compact ones are widened to float four at a time.
+template<class T>
+static uint64_t classifyWord(const CompiledPredicate &c, const T *data, int count, float offset, float scale) {
+    uint64_t word = 0;
+
+    if (c.rangeLo.size() > MAX_SIMD_RANGES) {
+        const int maxBin = (int)c.visibleBins.size() - 1;
+        for (int i = 0; i < count; ++i) {
+            int bin = std::max(0, std::min((int)((Decode(data, i) - offset) * scale), maxBin));
+            if (c.visibleBins[bin]) { word |= 1ULL << i; }
+        }
+        return word;
+    }
+
+    int i = 0;
+#ifdef __SSE2__
+    const __m128 voffset = _mm_set1_ps(offset);
+    const __m128 vscale = _mm_set1_ps(scale);
+    for (; i + 4 <= count; i += 4) {
+        __m128 s = _mm_mul_ps(_mm_sub_ps(Load4(data + i), voffset), vscale);
+        __m128 hit = _mm_setzero_ps();
+        for (size_t r = 0; r < c.rangeLo.size(); ++r) {
+            __m128 in = _mm_and_ps(_mm_cmpge_ps(s, _mm_set1_ps(c.rangeLo[r])),
+                                   _mm_cmplt_ps(s, _mm_set1_ps(c.rangeHi[r])));
+            hit = _mm_or_ps(hit, in);
+        }
+        word |= (uint64_t)_mm_movemask_ps(hit) << i;
+    }
+#endif
+    for (; i < count; ++i) {
+        float s = (Decode(data, i) - offset) * scale;
+        for (size_t r = 0; r < c.rangeLo.size(); ++r) {
+            if (s >= c.rangeLo[r] && s < c.rangeHi[r]) { word |= 1ULL << i; break; }
+        }
+    }
+    return word;
+}
+
+// Bits of the voxels whose normalized value lies in [lo, hi]
+template<class T>
+static uint64_t rangeWord(const T *data, int count, float offset, float scale, float lo, float hi) {
+    uint64_t word = 0;
+    int i = 0;
+#ifdef __SSE2__
+    const __m128 voffset = _mm_set1_ps(offset);
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 vlo = _mm_set1_ps(lo), vhi = _mm_set1_ps(hi);
+    for (; i + 4 <= count; i += 4) {
+        __m128 s = _mm_mul_ps(_mm_sub_ps(Load4(data + i), voffset), vscale);
+        __m128 in = _mm_and_ps(_mm_cmpge_ps(s, vlo), _mm_cmple_ps(s, vhi));
+        word |= (uint64_t)_mm_movemask_ps(in) << i;
+    }
+#endif
+    for (; i < count; ++i) {
+        float s = (Decode(data, i) - offset) * scale;
+        if (s >= lo && s <= hi) { word |= 1ULL << i; }
+    }
+    return word;
+}
+
+// The kernels above for the element type of the view, from voxel first on
+static uint64_t classifyWord(const CompiledPredicate &c, const VolumeView &view, int first, int count, float scale) {
+    switch (view.type) {
+    case QuantizedVolume::FLOAT16:
+        return classifyWord(c, static_cast<const QuantizedVolume::half*>(view.data) + first, count, view.offset, scale);
+    case QuantizedVolume::UINT16:
+        return classifyWord(c, static_cast<const unsigned short*>(view.data) + first, count, view.offset, scale);
+    case QuantizedVolume::UINT8:
+        return classifyWord(c, static_cast<const unsigned char*>(view.data) + first, count, view.offset, scale);
+    default:
+        return classifyWord(c, static_cast<const float*>(view.data) + first, count, view.offset, scale);
+    }
+}
+
+static uint64_t rangeWord(const VolumeView &view, int first, int count, float lo, float hi) {
+    switch (view.type) {
+    case QuantizedVolume::FLOAT16:
+        return rangeWord(static_cast<const QuantizedVolume::half*>(view.data) + first, count, view.offset, view.scale, lo, hi);
+    case QuantizedVolume::UINT16:
+        return rangeWord(static_cast<const unsigned short*>(view.data) + first, count, view.offset, view.scale, lo, hi);
+    case QuantizedVolume::UINT8:
+        return rangeWord(static_cast<const unsigned char*>(view.data) + first, count, view.offset, view.scale, lo, hi);
+    default:
+        return rangeWord(static_cast<const float*>(view.data) + first, count, view.offset, view.scale, lo, hi);
+    }
+}
+
+void VisibilityMask::Classify(const vector<VolumeView> &volumes, const vector3i &dim, const vector<float> &tfMap,
+                              const FeaturePredicate &predicate, int numThreads) {
+    vector<VisibilityMask*> masks(1, this);
+    ClassifyAll(masks, vector<FeaturePredicate>(1, predicate), volumes, dim, tfMap, numThreads);
+}
+
+void VisibilityMask::ClassifyAll(const vector<VisibilityMask*> &masks, const vector<FeaturePredicate> &predicates,
+                                 const vector<VolumeView> &volumes, const vector3i &dim, const vector<float> &tfMap,
+                                 int numThreads) {
+    const int size = dim.x * dim.y * dim.z;
+    const int numWords = (size + 63) / 64;
+    const int numPredicates = (int)predicates.size();
+
+    vector<CompiledPredicate> compiled(numPredicates);
+    for (int p = 0; p < numPredicates; ++p) {
+        compile(predicates[p], tfMap, (int)volumes.size() - 1, compiled[p]);
+        masks[p]->dim_ = dim;
+        masks[p]->size_ = size;
+        masks[p]->bits_.resize(numWords);
+    }
+
+    const VolumeView &primary = volumes[0];
+    const float scale = primary.scale * (float)(tfMap.size() - 1);
+
+    // the 64 voxels of a word stay in cache while every predicate tests them
+    util::parallelFor(0, numWords, numThreads, [&](int, int begin, int end) {
+        for (int w = begin; w < end; ++w) {
+            int first = w * 64, count = std::min(64, size - first);
+            for (int p = 0; p < numPredicates; ++p) {
+                const CompiledPredicate &c = compiled[p];
+                uint64_t word = classifyWord(c, primary, first, count, scale);
+                for (size_t k = 0; k < c.constrained.size() && word != 0; ++k) {
+                    int v = c.constrained[k];
+                    const VolumeView &extra = volumes[v+1];
+                    const VariableRange &range = predicates[p].ranges[v];
+                    word &= rangeWord(extra, first, count, range.lo, range.hi);
+                }
+                masks[p]->bits_[w] = word;
+            }
+        }
+    });
+
+    for (int p = 0; p < numPredicates; ++p) {
+        masks[p]->countBricks(numThreads);
+    }
+}
+
+void VisibilityMask::Swap(VisibilityMask &other) {
+    bits_.swap(other.bits_);
+    brickCounts_.swap(other.brickCounts_);
+    std::swap(dim_, other.dim_);
+    std::swap(numBricks_, other.numBricks_);
+    std::swap(size_, other.size_);
+}
+
+void VisibilityMask::countBricks(int numThreads) {
+    numBricks_ = vector3i((dim_.x + BRICK_SIZE-1) / BRICK_SIZE, (dim_.y + BRICK_SIZE-1) / BRICK_SIZE,
+                          (dim_.z + BRICK_SIZE-1) / BRICK_SIZE);
+    brickCounts_.assign(numBricks_.VolumeSize(), 0);
+
+    // a layer of bricks per thread, every row segment belongs to one brick
+    util::parallelFor(0, numBricks_.z, numThreads, [&](int, int begin, int end) {
+        for (int z = begin * BRICK_SIZE; z < std::min(end * BRICK_SIZE, dim_.z); ++z) {
+            for (int y = 0; y < dim_.y; ++y) {
+                int row = (z * dim_.y + y) * dim_.x;
+                int *counts = &brickCounts_[((z / BRICK_SIZE) * numBricks_.y + y / BRICK_SIZE) * numBricks_.x];
+                for (int bx = 0; bx < numBricks_.x; ++bx) {
+                    counts[bx] += util::countSetBits(bits_.data(), row + bx*BRICK_SIZE,
+                                                     row + std::min((bx+1)*BRICK_SIZE, dim_.x));
+                }
+            }
+        }
+    });
+}
+
+bool VisibilityMask::AnyVisible(const vector3i &lo, const vector3i &hi) const {
+    vector3i blo(std::max(lo.x, 0) / BRICK_SIZE, std::max(lo.y, 0) / BRICK_SIZE, std::max(lo.z, 0) / BRICK_SIZE);
+    vector3i bhi(std::min(hi.x, dim_.x-1) / BRICK_SIZE, std::min(hi.y, dim_.y-1) / BRICK_SIZE,
+                 std::min(hi.z, dim_.z-1) / BRICK_SIZE);
+    for (int z = blo.z; z <= bhi.z; ++z) {
+        for (int y = blo.y; y <= bhi.y; ++y) {
+            const int *counts = &brickCounts_[(z * numBricks_.y + y) * numBricks_.x];
+            for (int x = blo.x; x <= bhi.x; ++x) {
+                if (counts[x] > 0) return true;
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,48 @@
+#ifndef VISIBILITYMASK_H
+#define VISIBILITYMASK_H
+
+#include "Utils.h"
+
+// One bit per voxel telling whether it satisfies the feature predicate under
+// the current transfer function. Built once per timestep so region growing
+// only does bit tests instead of a TF lookup per neighbor visit. A count of
+// visible voxels per brick lets scans skip empty space.
+class VisibilityMask {
+public:
+    static const int BRICK_SIZE = 8;
+
+    VisibilityMask() : size_(0) { }
+
+    // Classify the voxels of a dim sized volume with the given TF, split over
+    // numThreads. volumes holds the primary variable and then the extra ones
+    // the predicate has ranges for. The normalization of the views is folded
+    // into the per-voxel scaling.
+    void Classify(const vector<VolumeView> &volumes, const vector3i &dim, const vector<float> &tfMap,
+                  const FeaturePredicate &predicate, int numThreads);
+    // Several predicates in one pass over the data, masks[i] gets predicates[i].
+    // Each run of voxels is read from memory once and tested against all of them.
+    static void ClassifyAll(const vector<VisibilityMask*> &masks, const vector<FeaturePredicate> &predicates,
+                            const vector<VolumeView> &volumes, const vector3i &dim, const vector<float> &tfMap,
+                            int numThreads);
+
+    void Swap(VisibilityMask &other);
+
+    bool Test(int index) const { return (bits_[index >> 6] >> (index & 63)) & 1; }
+    int  Size() const          { return size_; }
+    const uint64_t* Bits() const { return bits_.data(); }
+
+    // Whether any voxel of the bricks overlapping the inclusive box [lo, hi]
+    // is visible. False means none inside the box is.
+    bool AnyVisible(const vector3i &lo, const vector3i &hi) const;
+
+private:
+    void countBricks(int numThreads);
+
+    vector<uint64_t> bits_;
+    vector<int>      brickCounts_;  // visible voxels per brick, x fastest
+    vector3i         dim_;
+    vector3i         numBricks_;
+    int              size_;
+};
+
+#endif // VISIBILITYMASK_H
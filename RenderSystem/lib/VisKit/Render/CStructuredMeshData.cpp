@@ -6,23 +6,27 @@
 #include <cmath>
 #include <iostream>
 #include <fstream>
+#include <limits>
+#include "RangeKernels.h"
+#include "QuantizedVolume.h"
 using namespace std;
 
 CStructuredMeshData::CStructuredMeshData()
 {
 	m_rawData = NULL;
 	m_sf[0] = m_sf[1] = m_sf[2] = 1;
+	m_precision = m_rawType = QuantizedVolume::FLOAT32;
 }
 CStructuredMeshData::~CStructuredMeshData()
 {
-	if(m_rawData) delete [] m_rawData;
+	freeRawData();
 }
 bool CStructuredMeshData::readData(QString fn, int offset){
 
 	if(!fn.isEmpty()) // if fn== NULL, use m_filename, if not, replace m_filename
 		m_fileConfig.m_filename = fn;
 
-	if(m_rawData) delete [] m_rawData;
+	freeRawData();
 
 	if(!QFile::exists(m_fileConfig.m_filename)) {
 		qDebug("Missing Volume Data File: %s", m_fileConfig.m_filename.toLocal8Bit().constData());
@@ -74,7 +78,7 @@ bool CStructuredMeshData::readData(QString fn, int offset){
 	inpData.readRawData((char*)rawData,realFileSizeInBytes);
 	dataFile.close();
 
-	m_rawData = new float[m_dimX*m_dimY*m_dimZ];
+	float *values = new float[m_dimX*m_dimY*m_dimZ];
 	unsigned int index = 0;
 
 	if(m_fileConfig.m_meshAtt == FLOATT){
@@ -85,7 +89,7 @@ bool CStructuredMeshData::readData(QString fn, int offset){
 				for(size_t c=0;c<m_dimX;c=c+m_sf[0])
 				{
 					index = c + b*m_dimX + a*m_dimX*m_dimY;
-					m_rawData[index] = (float)((float*)rawData)[index];
+					values[index] = (float)((float*)rawData)[index];
 				}
 			}
 		}
@@ -98,7 +102,7 @@ bool CStructuredMeshData::readData(QString fn, int offset){
 				for(size_t c=0;c<m_dimX;c=c+m_sf[0])
 				{
 					index = c + b*m_dimX + a*m_dimX*m_dimY;
-					m_rawData[index] = (float)((unsigned char*)rawData)[index];
+					values[index] = (float)((unsigned char*)rawData)[index];
 				}
 			}
 		}
@@ -121,7 +125,7 @@ bool CStructuredMeshData::readData(QString fn, int offset){
 							*((char*)(&value)+0) = ((char*)rawData)[index*2+1];
 							*((char*)(&value)+1) = ((char*)rawData)[index*2+0];
 						}
-						m_rawData[index] = (float)(value);
+						values[index] = (float)(value);
 					}
 					else {
 						short value;
@@ -133,12 +137,12 @@ bool CStructuredMeshData::readData(QString fn, int offset){
 							*((char*)(&value)+0) = ((char*)rawData)[index*2+1];
 							*((char*)(&value)+1) = ((char*)rawData)[index*2+0];
 						}
-						m_rawData[index] = (float)(value);
+						values[index] = (float)(value);
 					}
 //					if(m_fileConfig.m_meshAtt == UNSIGNED_16BIT)
-//						m_rawData[index] = (float)((unsigned short*)rawData)[index];
+//						values[index] = (float)((unsigned short*)rawData)[index];
 //					else 
-//						m_rawData[index] = (float)((short*)rawData)[index];
+//						values[index] = (float)((short*)rawData)[index];
 				}
 			}
 		}
@@ -147,7 +151,8 @@ bool CStructuredMeshData::readData(QString fn, int offset){
 	delete [] (float*)rawData;
 
 	// normalize data
-	normalilze();
+	normalilze(values);
+	keepRawData(values);
 
 	// find out the max dim
 	size_t maxDim = max(m_dimX,max(m_dimY,m_dimZ));
@@ -173,7 +178,7 @@ int CStructuredMeshData::getTotalDataEntry(int idx)
 
 	return total;
 }
-void CStructuredMeshData::normalilze()
+void CStructuredMeshData::normalilze(float *values)
 {
 	size_t m_dimX = m_newDim[0];
 	size_t m_dimY = m_newDim[1];
@@ -181,38 +186,58 @@ void CStructuredMeshData::normalilze()
 
 	size_t dataSize = m_dimX*m_dimY*m_dimZ;
 
-	if(m_fileConfig.m_ifClampMax){
-		for(size_t x=0;x<dataSize;++x){
-			if(m_rawData[x] > m_fileConfig.m_clampMaxVal)
-				m_rawData[x] = m_fileConfig.m_clampMaxVal;
-		}
+	if(m_fileConfig.m_ifClampMax || m_fileConfig.m_ifClampMin){
+		float inf = numeric_limits<float>::infinity();
+		float lo = m_fileConfig.m_ifClampMin ? (float)m_fileConfig.m_clampMinVal : -inf;
+		float hi = m_fileConfig.m_ifClampMax ? (float)m_fileConfig.m_clampMaxVal : inf;
+		RangeKernels::Clamp(values, dataSize, lo, hi);
 	}
-	if(m_fileConfig.m_ifClampMin){
-		for(size_t x=0;x<dataSize;++x){
-			if(m_rawData[x] < m_fileConfig.m_clampMinVal)
-				m_rawData[x] = m_fileConfig.m_clampMinVal;
-		}
-	}	
 
 	if(!m_fileConfig.m_ifSetRange){	
-		m_fileConfig.m_dataMaxVal = -1E20;
-		m_fileConfig.m_dataMinVal = 1E20;
-		for(size_t x=0;x<dataSize;x++)
-		{	
-			if(m_fileConfig.m_dataMaxVal < m_rawData[x])
-				m_fileConfig.m_dataMaxVal = m_rawData[x];
-			if(m_fileConfig.m_dataMinVal > m_rawData[x])
-				m_fileConfig.m_dataMinVal = m_rawData[x];
-		}
+		float minVal = 1E20f, maxVal = -1E20f;
+		RangeKernels::MinMax(values, dataSize, minVal, maxVal);
+		m_fileConfig.m_dataMinVal = minVal;
+		m_fileConfig.m_dataMaxVal = maxVal;
+	}
+	RangeKernels::Normalize(values, dataSize, (float)m_fileConfig.m_dataMinVal, (float)m_fileConfig.m_dataMaxVal);
+}
+// Encoded with [0, 1] as the samples are normalized already
+void CStructuredMeshData::keepRawData(float *values)
+{
+	size_t dataSize = m_newDim[0]*m_newDim[1]*m_newDim[2];
+
+	m_rawType = m_precision;
+	if(m_rawType == QuantizedVolume::FLOAT32){
+		m_rawData = values;
+		return;
+	}
+	m_rawData = new unsigned char[dataSize*QuantizedVolume::ElementSize(m_rawType)];
+	QuantizedVolume::Encode(values, dataSize, 0.f, 1.f, m_rawType, m_rawData);
+	delete [] values;
+}
+void CStructuredMeshData::freeRawData()
+{
+	if(m_rawType == QuantizedVolume::FLOAT32)
+		delete [] (float*)m_rawData;
+	else
+		delete [] (unsigned char*)m_rawData;
+	m_rawData = NULL;
+}
+float CStructuredMeshData::getValue(size_t i)
+{
+	using QuantizedVolume::Decode;
+	float scale = QuantizedVolume::Scale(m_rawType);
+	switch(m_rawType){
+	case QuantizedVolume::FLOAT16:	return Decode((QuantizedVolume::half*)m_rawData, i);
+	case QuantizedVolume::UINT16:	return Decode((unsigned short*)m_rawData, i)*scale;
+	case QuantizedVolume::UINT8:	return Decode((unsigned char*)m_rawData, i)*scale;
+	default:						return Decode((float*)m_rawData, i);
 	}
-	double range = m_fileConfig.m_dataMaxVal-m_fileConfig.m_dataMinVal;
-	for(size_t s=0;s<dataSize;s++)
-		m_rawData[s] = (m_rawData[s]-m_fileConfig.m_dataMinVal)/range;
 }
 void CStructuredMeshData::outputData(char *filename,int type){
 	if(type == 0){ // binary raw
 		ofstream outD(filename,ios::out | ios::binary);
-		outD.write((char*)m_rawData,m_newDim[0]*m_newDim[1]*m_newDim[2]*sizeof(float));		
+		outD.write((char*)m_rawData,m_newDim[0]*m_newDim[1]*m_newDim[2]*QuantizedVolume::ElementSize(m_rawType));		
 		outD.close();		
 	}
 	else if(type == 1){ // vtk structure rect
@@ -231,7 +256,7 @@ bool CStructuredMeshData2D::readData(QString fn,int offset){
 	if(!fn.isEmpty()) // if fn== NULL, use m_filename, if not, replace m_filename
 		m_fileConfig.m_filename = fn;
 	
-	if(m_rawData) delete [] m_rawData;
+	freeRawData();
 	
 	if(!QFile::exists(m_fileConfig.m_filename)) {
 		qDebug("Missing Volume Data File: %s", m_fileConfig.m_filename.toLocal8Bit().constData());
@@ -287,7 +312,7 @@ bool CStructuredMeshData2D::readData(QString fn,int offset){
 	inpData.readRawData((char*)rawData,realFileSizeInBytes);
 	dataFile.close();
 	
-	m_rawData = new float[m_dimX*m_dimY*m_dimZ];
+	float *values = new float[m_dimX*m_dimY*m_dimZ];
 	unsigned int index = 0;
 	// only z slice (xy plane)
 	unsigned int indexbase = m_sliceDist*m_dimX*m_dimY;
@@ -297,7 +322,7 @@ bool CStructuredMeshData2D::readData(QString fn,int offset){
 			for(size_t c=0;c<m_dimX;c=c+m_sf[0]){
 				orgIndex = c + b*m_dimX;
 				index = orgIndex + indexbase;
-				m_rawData[orgIndex] = (float)((float*)rawData)[index];
+				values[orgIndex] = (float)((float*)rawData)[index];
 			}
 		}
 	}
@@ -306,7 +331,7 @@ bool CStructuredMeshData2D::readData(QString fn,int offset){
 			for(size_t c=0;c<m_dimX;c=c+m_sf[0]){
 				orgIndex = c + b*m_dimX;
 				index = orgIndex + indexbase;
-				m_rawData[orgIndex] = (float)((unsigned char*)rawData)[index];
+				values[orgIndex] = (float)((unsigned char*)rawData)[index];
 			}
 		}
 	}
@@ -316,9 +341,9 @@ bool CStructuredMeshData2D::readData(QString fn,int offset){
 				orgIndex = c + b*m_dimX;
 				index = orgIndex + indexbase;
 				if(m_fileConfig.m_meshAtt == UNSIGNED_16BIT)
-					m_rawData[orgIndex] = (float)((unsigned short*)rawData)[index];
+					values[orgIndex] = (float)((unsigned short*)rawData)[index];
 				else 
-					m_rawData[orgIndex] = (float)((short*)rawData)[index];
+					values[orgIndex] = (float)((short*)rawData)[index];
 			}
 		}
 	}
@@ -326,7 +351,8 @@ bool CStructuredMeshData2D::readData(QString fn,int offset){
 	delete [] (float*)rawData;
 	
 	// normalize data
-	normalilze();
+	normalilze(values);
+	keepRawData(values);
 	
 	// find out the max dim
 	size_t maxDim = max(m_dimX,max(m_dimY,m_dimZ));
@@ -19,7 +19,13 @@ public:
 	float	m_scaledDim[3]; 
 	float	m_scale[3];
 
-	float	*m_rawData;
+	void	*m_rawData;		// normalized samples, elements of rawType()
+
+	// QuantizedVolume::Type the next readData() keeps the samples as, float by default
+	void	setPrecision(int type){m_precision = type;}
+	int		getPrecision(){return m_precision;}
+	int		rawType(){return m_rawType;}
+	float	getValue(size_t i);	// normalized value of sample i
 
 	virtual void	setOrgDimensions(int dx,int dy,int dz,float sx=1.f, float sy=1.f, float sz=1.f)
 	{	m_orgDim[0]=dx;	m_orgDim[1]=dy;	m_orgDim[2]=dz; m_scale[0]=sx; m_scale[1]=sy; m_scale[2]=sz;}
@@ -32,7 +38,14 @@ public:
 	
 	void	outputData(char *filename,int type = 0);
 
-	virtual void	normalilze();
+	virtual void	normalilze(float *values);
+
+protected:
+	void	keepRawData(float *values);	// as m_precision, values are freed unless float
+	void	freeRawData();
+
+	int		m_precision;
+	int		m_rawType;
 };
 
 class CStructuredMeshData2D : public CStructuredMeshData
@@ -5,7 +5,7 @@
 TEMPLATE = lib
 TARGET = render
 DEPENDPATH += .
-INCLUDEPATH += . ../camera ../shadermanager ../UI/QAniEditor
+INCLUDEPATH += . ../camera ../shadermanager ../UI/QAniEditor ../util
 QT += opengl
 CONFIG += debug_and_release staticlib
 DEFINES += _LIBCOMPILE
@@ -15,7 +15,7 @@ HEADERS += QRenderWindow.h QRenderWidget.h LIGHTPARAM.h \
 	     CShader.h CObject.h CProperties.h CData.h CStructuredMeshData.h CImageData.h\
 	     ../UI/QTFEditor/QTFEditor.h \
 	     QRenderEffEditor.h \
-	     ../camera/camera.h box.h slicer.h 
+	     ../camera/camera.h box.h slicer.h ../util/RangeKernels.h
 SOURCES += QRenderWindow.cpp QRenderWidget.cpp \ 
            CShader.cpp CObject.cpp CProperties.cpp CData.cpp CStructuredMeshData.cpp CImageData.cpp\
 	   QRenderEffEditor.cpp box.cpp slicer.cpp
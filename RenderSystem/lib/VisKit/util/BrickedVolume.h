@@ -0,0 +1,371 @@
+//
+// C++ Interface: BrickedVolume
+//
+// Description: Bricked on-disk layout for float volumes, shared by the
+// renderers and the feature tracker.
+//
+// A file starts with a header and a table holding, per brick, where its
+// payload is, how it is coded and the min/max of its values. A reader can
+// thus fetch only the bricks of a region, and skip bricks whose range is of
+// no interest without touching their payload. Payloads are stored raw,
+// byte-shuffled and run-length coded, or not at all if the brick is
+// constant, whichever is smallest; all of them are lossless. Values are in
+// native byte order, x fastest within a brick, like the raw files.
+//
+
+#ifndef _BRICKEDVOLUME_H_
+#define _BRICKEDVOLUME_H_
+
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "RangeKernels.h"
+
+namespace BrickedVolume {
+
+const char     MAGIC[4] = { 'B', 'V', 'O', 'L' };
+const int32_t  VERSION = 1;
+const int      DEFAULT_BRICK_SIZE = 32;
+
+enum Codec {
+    CODEC_RAW = 0,
+    CODEC_SHUFFLE_RLE = 1,  // bytes of equal significance grouped, then run-length coded
+    CODEC_CONSTANT = 2      // no payload, every value is the brick's min
+};
+
+struct Extent {
+    int x, y, z;
+    Extent(int x_ = 0, int y_ = 0, int z_ = 0) : x(x_), y(y_), z(z_) { }
+    size_t Volume() const { return (size_t)x * y * z; }
+};
+
+struct BrickInfo {
+    uint64_t offset;    // of the payload from the start of the file
+    uint32_t bytes;     // of the payload
+    int32_t  codec;
+    float    min;
+    float    max;
+};
+
+struct Header {
+    char     magic[4];
+    int32_t  version;
+    int32_t  dim[3];
+    int32_t  brickSize[3];
+    float    min;       // of the whole volume
+    float    max;
+};
+
+namespace detail {
+
+inline void shuffle(const float *in, size_t count, unsigned char *out) {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>(in);
+    for (size_t k = 0; k < sizeof(float); ++k) {
+        for (size_t i = 0; i < count; ++i) {
+            out[k*count + i] = bytes[i*sizeof(float) + k];
+        }
+    }
+}
+
+inline void unshuffle(const unsigned char *in, size_t count, float *out) {
+    unsigned char *bytes = reinterpret_cast<unsigned char*>(out);
+    for (size_t k = 0; k < sizeof(float); ++k) {
+        for (size_t i = 0; i < count; ++i) {
+            bytes[i*sizeof(float) + k] = in[k*count + i];
+        }
+    }
+}
+
+inline size_t runLength(const unsigned char *in, size_t n, size_t i) {
+    size_t r = 1;
+    while (i + r < n && r < 130 && in[i + r] == in[i]) ++r;
+    return r;
+}
+
+// Control byte c < 128: c+1 literal bytes follow. c >= 128: the next byte
+// repeats c-125 times, so runs of 3 to 130.
+inline void rleEncode(const unsigned char *in, size_t n, std::vector<unsigned char> &out) {
+    size_t i = 0;
+    while (i < n) {
+        size_t r = runLength(in, n, i);
+        if (r >= 3) {
+            out.push_back((unsigned char)(r + 125));
+            out.push_back(in[i]);
+            i += r;
+            continue;
+        }
+        size_t j = i;
+        while (j < n && j - i < 128 && runLength(in, n, j) < 3) ++j;
+        out.push_back((unsigned char)(j - i - 1));
+        out.insert(out.end(), in + i, in + j);
+        i = j;
+    }
+}
+
+inline bool rleDecode(const unsigned char *in, size_t n, unsigned char *out, size_t outSize) {
+    size_t i = 0, o = 0;
+    while (i < n) {
+        unsigned char c = in[i++];
+        if (c < 128) {
+            size_t len = (size_t)c + 1;
+            if (i + len > n || o + len > outSize) return false;
+            memcpy(out + o, in + i, len);
+            i += len;
+            o += len;
+        } else {
+            size_t len = (size_t)c - 125;
+            if (i >= n || o + len > outSize) return false;
+            memset(out + o, in[i++], len);
+            o += len;
+        }
+    }
+    return o == outSize;
+}
+
+// All values bitwise equal, so a constant brick keeps -0 and NaN payloads
+inline bool isConstant(const std::vector<float> &values) {
+    for (size_t i = 1; i < values.size(); ++i) {
+        if (memcmp(&values[i], &values[0], sizeof(float)) != 0) return false;
+    }
+    return true;
+}
+
+inline int numBricks(int dim, int brick) {
+    return (dim + brick - 1) / brick;
+}
+
+} // namespace detail
+
+// Whether path starts like a bricked volume, so callers can take either layout
+inline bool IsBricked(const std::string &path) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    char magic[4];
+    return in.read(magic, 4) && std::equal(magic, magic + 4, MAGIC);
+}
+
+// Writes a dim.x*dim.y*dim.z volume, x fastest, in bricks of brickSize.
+// With compress, every brick takes the smallest of the codecs. Returns
+// false if the file cannot be written.
+inline bool Write(const std::string &path, const float *data, const Extent &dim,
+                  const Extent &brickSize = Extent(DEFAULT_BRICK_SIZE, DEFAULT_BRICK_SIZE, DEFAULT_BRICK_SIZE),
+                  bool compress = true) {
+    Extent grid(detail::numBricks(dim.x, brickSize.x), detail::numBricks(dim.y, brickSize.y),
+                detail::numBricks(dim.z, brickSize.z));
+    std::vector<BrickInfo> table(grid.Volume());
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+
+    Header header;
+    memcpy(header.magic, MAGIC, 4);
+    header.version = VERSION;
+    header.dim[0] = dim.x; header.dim[1] = dim.y; header.dim[2] = dim.z;
+    header.brickSize[0] = brickSize.x; header.brickSize[1] = brickSize.y; header.brickSize[2] = brickSize.z;
+    header.min = dim.Volume() > 0 ? FLT_MAX : 0.0f;
+    header.max = dim.Volume() > 0 ? -FLT_MAX : 0.0f;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    // the table is rewritten once the payloads are placed
+    if (!table.empty()) out.write(reinterpret_cast<const char*>(&table[0]), table.size() * sizeof(BrickInfo));
+    uint64_t offset = sizeof(header) + table.size() * sizeof(BrickInfo);
+
+    std::vector<float> brick;
+    std::vector<unsigned char> shuffled, coded;
+    for (int bz = 0, b = 0; bz < grid.z; ++bz) {
+        for (int by = 0; by < grid.y; ++by) {
+            for (int bx = 0; bx < grid.x; ++bx, ++b) {
+                Extent origin(bx * brickSize.x, by * brickSize.y, bz * brickSize.z);
+                Extent size(std::min(brickSize.x, dim.x - origin.x), std::min(brickSize.y, dim.y - origin.y),
+                            std::min(brickSize.z, dim.z - origin.z));
+                brick.resize(size.Volume());
+                for (int z = 0; z < size.z; ++z) {
+                    for (int y = 0; y < size.y; ++y) {
+                        const float *src = data + ((size_t)(origin.z + z) * dim.y + (origin.y + y)) * dim.x + origin.x;
+                        std::copy(src, src + size.x, brick.begin() + ((size_t)z * size.y + y) * size.x);
+                    }
+                }
+
+                BrickInfo &info = table[b];
+                RangeKernels::MinMax(&brick[0], brick.size(), info.min, info.max);
+                header.min = std::min(header.min, info.min);
+                header.max = std::max(header.max, info.max);
+                info.offset = offset;
+
+                const char *payload = reinterpret_cast<const char*>(&brick[0]);
+                info.codec = CODEC_RAW;
+                info.bytes = (uint32_t)(brick.size() * sizeof(float));
+                if (compress && detail::isConstant(brick)) {
+                    info.codec = CODEC_CONSTANT;
+                    info.min = info.max = brick[0];
+                    info.bytes = 0;
+                } else if (compress) {
+                    shuffled.resize(info.bytes);
+                    detail::shuffle(&brick[0], brick.size(), &shuffled[0]);
+                    coded.clear();
+                    detail::rleEncode(&shuffled[0], shuffled.size(), coded);
+                    if (coded.size() < info.bytes) {
+                        info.codec = CODEC_SHUFFLE_RLE;
+                        info.bytes = (uint32_t)coded.size();
+                        payload = reinterpret_cast<const char*>(&coded[0]);
+                    }
+                }
+                out.write(payload, info.bytes);
+                offset += info.bytes;
+            }
+        }
+    }
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!table.empty()) out.write(reinterpret_cast<const char*>(&table[0]), table.size() * sizeof(BrickInfo));
+    out.close();
+    return !out.fail();
+}
+
+// Reads bricks of a file written by Write. Holds the file open; one reader
+// must not be used by several threads at once.
+class Reader {
+public:
+    Reader() { }
+
+    // Reads the header and brick table. False if path is missing, not a
+    // bricked volume, or truncated.
+    bool Open(const std::string &path) {
+        _in.close();
+        _in.clear();
+        _in.open(path.c_str(), std::ios::binary);
+        if (!_in.read(reinterpret_cast<char*>(&_header), sizeof(_header)) ||
+            !std::equal(_header.magic, _header.magic + 4, MAGIC) || _header.version != VERSION) {
+            return false;
+        }
+        _dim = Extent(_header.dim[0], _header.dim[1], _header.dim[2]);
+        _brickSize = Extent(_header.brickSize[0], _header.brickSize[1], _header.brickSize[2]);
+        if (_dim.x < 0 || _dim.y < 0 || _dim.z < 0 || _brickSize.x <= 0 || _brickSize.y <= 0 || _brickSize.z <= 0) {
+            return false;
+        }
+        _grid = Extent(detail::numBricks(_dim.x, _brickSize.x), detail::numBricks(_dim.y, _brickSize.y),
+                       detail::numBricks(_dim.z, _brickSize.z));
+        _table.resize(_grid.Volume());
+        return _table.empty() ||
+               _in.read(reinterpret_cast<char*>(&_table[0]), _table.size() * sizeof(BrickInfo));
+    }
+
+    const Extent&    dim() const                { return _dim; }
+    const Extent&    brickSize() const          { return _brickSize; }
+    const Extent&    grid() const               { return _grid; }      // bricks per axis
+    int              numBricks() const          { return (int)_table.size(); }
+    const BrickInfo& brick(int i) const         { return _table[i]; }
+    float            min() const                { return _header.min; }
+    float            max() const                { return _header.max; }
+
+    Extent brickOrigin(int i) const {
+        return Extent(i % _grid.x * _brickSize.x, i / _grid.x % _grid.y * _brickSize.y, i / (_grid.x * _grid.y) * _brickSize.z);
+    }
+    Extent brickDim(int i) const {
+        Extent o = brickOrigin(i);
+        return Extent(std::min(_brickSize.x, _dim.x - o.x), std::min(_brickSize.y, _dim.y - o.y),
+                      std::min(_brickSize.z, _dim.z - o.z));
+    }
+
+    // From the table alone: whether brick i may hold values in [lo, hi]
+    bool BrickOverlaps(int i, float lo, float hi) const {
+        return _table[i].max >= lo && _table[i].min <= hi;
+    }
+
+    // Bricks overlapping the voxel box [lo, hi], bounds inclusive
+    void BricksInBox(const Extent &lo, const Extent &hi, std::vector<int> &bricks) const {
+        bricks.clear();
+        if (hi.x < lo.x || hi.y < lo.y || hi.z < lo.z) return;
+        for (int bz = lo.z / _brickSize.z; bz <= hi.z / _brickSize.z; ++bz) {
+            for (int by = lo.y / _brickSize.y; by <= hi.y / _brickSize.y; ++by) {
+                for (int bx = lo.x / _brickSize.x; bx <= hi.x / _brickSize.x; ++bx) {
+                    bricks.push_back((bz * _grid.y + by) * _grid.x + bx);
+                }
+            }
+        }
+    }
+
+    // The brickDim(i) values of brick i, x fastest
+    bool ReadBrick(int i, float *out) {
+        const BrickInfo &info = _table[i];
+        size_t count = brickDim(i).Volume();
+        if (info.codec == CODEC_CONSTANT) {
+            std::fill(out, out + count, info.min);
+            return true;
+        }
+        _in.clear();
+        _in.seekg((std::streamoff)info.offset);
+        if (info.codec == CODEC_RAW) {
+            return info.bytes == count * sizeof(float) &&
+                   _in.read(reinterpret_cast<char*>(out), info.bytes);
+        }
+        if (info.codec != CODEC_SHUFFLE_RLE) return false;
+        _coded.resize(info.bytes);
+        _shuffled.resize(count * sizeof(float));
+        if (info.bytes > 0 && !_in.read(reinterpret_cast<char*>(&_coded[0]), info.bytes)) return false;
+        if (!detail::rleDecode(info.bytes > 0 ? &_coded[0] : NULL, info.bytes,
+                               count > 0 ? &_shuffled[0] : NULL, _shuffled.size())) {
+            return false;
+        }
+        detail::unshuffle(count > 0 ? &_shuffled[0] : NULL, count, out);
+        return true;
+    }
+
+    // The voxels of box [lo, hi], bounds inclusive, x fastest, reading only
+    // the bricks it overlaps. Bricks whose range misses [rangeLo, rangeHi]
+    // are not read, their voxels get the brick's min.
+    bool ReadBox(const Extent &lo, const Extent &hi, float *out,
+                 float rangeLo = -FLT_MAX, float rangeHi = FLT_MAX) {
+        Extent size(hi.x - lo.x + 1, hi.y - lo.y + 1, hi.z - lo.z + 1);
+        std::vector<int> bricks;
+        BricksInBox(lo, hi, bricks);
+        for (size_t k = 0; k < bricks.size(); ++k) {
+            int i = bricks[k];
+            Extent o = brickOrigin(i), d = brickDim(i);
+            bool skipped = !BrickOverlaps(i, rangeLo, rangeHi);
+            if (!skipped) {
+                _brick.resize(d.Volume());
+                if (!ReadBrick(i, &_brick[0])) return false;
+            }
+            Extent from(std::max(lo.x, o.x), std::max(lo.y, o.y), std::max(lo.z, o.z));
+            Extent to(std::min(hi.x, o.x + d.x - 1), std::min(hi.y, o.y + d.y - 1), std::min(hi.z, o.z + d.z - 1));
+            for (int z = from.z; z <= to.z; ++z) {
+                for (int y = from.y; y <= to.y; ++y) {
+                    float *dst = out + ((size_t)(z - lo.z) * size.y + (y - lo.y)) * size.x + (from.x - lo.x);
+                    if (skipped) {
+                        std::fill(dst, dst + (to.x - from.x + 1), _table[i].min);
+                        continue;
+                    }
+                    const float *src = &_brick[0] + ((size_t)(z - o.z) * d.y + (y - o.y)) * d.x + (from.x - o.x);
+                    std::copy(src, src + (to.x - from.x + 1), dst);
+                }
+            }
+        }
+        return true;
+    }
+
+    // The whole volume, as it was before bricking
+    bool ReadAll(float *out) {
+        return ReadBox(Extent(0, 0, 0), Extent(_dim.x - 1, _dim.y - 1, _dim.z - 1), out);
+    }
+
+private:
+    std::ifstream               _in;
+    Header                      _header;
+    Extent                      _dim;
+    Extent                      _brickSize;
+    Extent                      _grid;
+    std::vector<BrickInfo>      _table;
+    std::vector<float>          _brick;     // scratch of ReadBox
+    std::vector<unsigned char>  _coded;     // scratch of ReadBrick
+    std::vector<unsigned char>  _shuffled;
+};
+
+} // namespace BrickedVolume
+
+#endif // _BRICKEDVOLUME_H_
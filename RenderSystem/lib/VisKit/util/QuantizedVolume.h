@@ -0,0 +1,247 @@
+//
+// C++ Interface: QuantizedVolume
+//
+// Description: Compact in-memory voxel types for float volumes, shared by
+// the renderers and the feature tracker. A volume is kept as 8 or 16-bit
+// codes, or as half floats, of its values normalized to [0, 1]:
+//
+//   normalized = code * Scale(type)
+//
+// Conversions are plain C++, the 4-wide loads use SSE2 when it is enabled.
+//
+
+#ifndef _QUANTIZEDVOLUME_H_
+#define _QUANTIZEDVOLUME_H_
+
+#include <stddef.h>
+#include <string.h>
+#include <string>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace QuantizedVolume {
+
+enum Type {
+    FLOAT32 = 0,    // the values as read, not normalized
+    FLOAT16 = 1,    // IEEE half, 11 significant bits
+    UINT16  = 2,
+    UINT8   = 3
+};
+
+// Bits of an IEEE half, a type of its own so that loads can be overloaded
+struct half {
+    unsigned short bits;
+};
+
+inline size_t ElementSize(int type) {
+    switch (type) {
+    case FLOAT16:
+    case UINT16: return 2;
+    case UINT8:  return 1;
+    default:     return 4;
+    }
+}
+
+inline const char* TypeName(int type) {
+    switch (type) {
+    case FLOAT16: return "half";
+    case UINT16:  return "uint16";
+    case UINT8:   return "uint8";
+    default:      return "float";
+    }
+}
+
+// -1 if name is none of the TypeName()s
+inline int ParseType(const std::string &name) {
+    for (int type = FLOAT32; type <= UINT8; ++type) {
+        if (name == TypeName(type)) return type;
+    }
+    return -1;
+}
+
+// Normalized value of code 1
+inline float Scale(int type) {
+    switch (type) {
+    case UINT16: return 1.0f / 65535.0f;
+    case UINT8:  return 1.0f / 255.0f;
+    default:     return 1.0f;
+    }
+}
+
+// Round to nearest even, overflow to infinity
+inline half FloatToHalf(float f) {
+    unsigned int x;
+    memcpy(&x, &f, sizeof(x));
+    unsigned int sign = (x >> 16) & 0x8000;
+    unsigned int abs = x & 0x7fffffff;
+
+    unsigned int h;
+    if (abs >= 0x7f800000) {                    // inf, NaN stays NaN
+        h = 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+    } else if (abs >= 0x477ff000) {             // rounds above 65504
+        h = 0x7c00;
+    } else if (abs < 0x38800000) {              // half subnormal or zero
+        h = 0;
+        if (abs > 0x33000000) {                 // more than half of the smallest one
+            unsigned int mant = (abs & 0x7fffff) | 0x800000;
+            int shift = 126 - (int)(abs >> 23);
+            unsigned int rest = mant & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+            h = mant >> shift;
+            if (rest > halfway || (rest == halfway && (h & 1))) h++;
+        }
+    } else {
+        unsigned int rest = abs & 0x1fff;
+        h = (abs - 0x38000000) >> 13;
+        if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;   // a carry moves into the exponent
+    }
+    half result;
+    result.bits = (unsigned short)(sign | h);
+    return result;
+}
+
+// Exact. The exponent is rebased by a multiply, which also normalizes the
+// subnormals, so the SSE2 version below gives the same bits.
+inline float HalfToFloat(half value) {
+    unsigned int h = value.bits;
+    unsigned int bits = (unsigned int)(h & 0x7fff) << 13, magic = 0x77800000;   // 2^112
+    float f, m;
+    memcpy(&f, &bits, sizeof(f));
+    memcpy(&m, &magic, sizeof(m));
+    f *= m;
+    memcpy(&bits, &f, sizeof(bits));
+    if ((h & 0x7c00) == 0x7c00) bits |= 0x7f800000;     // inf and NaN
+    bits |= (unsigned int)(h & 0x8000) << 16;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// Value i of data as float, normalized unless the type is FLOAT32
+inline float Decode(const float *data, size_t i)           { return data[i]; }
+inline float Decode(const half *data, size_t i)            { return HalfToFloat(data[i]); }
+inline float Decode(const unsigned short *data, size_t i)  { return (float)data[i]; }
+inline float Decode(const unsigned char *data, size_t i)   { return (float)data[i]; }
+
+#if defined(__SSE2__)
+// Four consecutive elements as floats, unaligned
+inline __m128 Load4(const float *p) {
+    return _mm_loadu_ps(p);
+}
+
+inline __m128 Load4(const unsigned char *p) {
+    int four;
+    memcpy(&four, p, sizeof(four));
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(four), zero);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero));
+}
+
+inline __m128i load4x16(const void *p) {
+    return _mm_unpacklo_epi16(_mm_loadl_epi64(static_cast<const __m128i*>(p)), _mm_setzero_si128());
+}
+
+inline __m128 Load4(const unsigned short *p) {
+    return _mm_cvtepi32_ps(load4x16(p));
+}
+
+// Same steps as HalfToFloat()
+inline __m128 Load4(const half *p) {
+    __m128i h = load4x16(p);
+    __m128i bits = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+    __m128 f = _mm_mul_ps(_mm_castsi128_ps(bits), _mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
+    __m128i special = _mm_cmpeq_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7c00)), _mm_set1_epi32(0x7c00));
+    __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+    __m128i high = _mm_or_si128(_mm_and_si128(special, _mm_set1_epi32(0x7f800000)), sign);
+    return _mm_or_ps(f, _mm_castsi128_ps(high));
+}
+
+// Four values into codes; rounded and clamped already unless T is half
+inline void Store4(half *p, __m128 v) {
+    __m128i u = _mm_castps_si128(v);
+    __m128i sign = _mm_and_si128(u, _mm_set1_epi32(0x80000000));
+    u = _mm_xor_si128(u, sign);
+
+    // normal: rounded to nearest even in place, then shifted down
+    __m128i odd = _mm_and_si128(_mm_srli_epi32(u, 13), _mm_set1_epi32(1));
+    __m128i normal = _mm_add_epi32(_mm_add_epi32(u, _mm_set1_epi32((int)(0xc8000000u + 0xfff))), odd);
+    normal = _mm_srli_epi32(normal, 13);
+    // subnormal: the float add rounds the mantissa into place
+    const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32(126 << 23));
+    __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(u), magic)), _mm_castps_si128(magic));
+    // at least 65536, inf and NaN
+    __m128i nan = _mm_cmpgt_epi32(u, _mm_set1_epi32(0x7f800000));
+    __m128i special = _mm_or_si128(_mm_set1_epi32(0x7c00), _mm_and_si128(nan, _mm_set1_epi32(0x200)));
+
+    __m128i isSubnormal = _mm_cmplt_epi32(u, _mm_set1_epi32(113 << 23));
+    __m128i isSpecial = _mm_cmpgt_epi32(u, _mm_set1_epi32((143 << 23) - 1));
+    __m128i h = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+    h = _mm_or_si128(_mm_and_si128(isSpecial, special), _mm_andnot_si128(isSpecial, h));
+    h = _mm_or_si128(h, _mm_srli_epi32(sign, 16));
+
+    h = _mm_srai_epi32(_mm_slli_epi32(h, 16), 16);      // signed, so the pack does not saturate
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packs_epi32(h, h));
+}
+
+inline void Store4(unsigned short *p, __m128 v) {
+    __m128i q = _mm_cvttps_epi32(v);
+    q = _mm_srai_epi32(_mm_slli_epi32(q, 16), 16);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packs_epi32(q, q));
+}
+
+inline void Store4(unsigned char *p, __m128 v) {
+    __m128i q = _mm_packs_epi32(_mm_cvttps_epi32(v), _mm_setzero_si128());
+    int four = _mm_cvtsi128_si32(_mm_packus_epi16(q, q));
+    memcpy(p, &four, sizeof(four));
+}
+#endif
+
+inline half encodeOne(float v, half*)                     { return FloatToHalf(v); }
+inline unsigned short encodeOne(float v, unsigned short*) { return (unsigned short)v; }
+inline unsigned char encodeOne(float v, unsigned char*)   { return (unsigned char)v; }
+
+// Codes of count values normalized with [min, max] into dst, which holds
+// count elements of type. FLOAT32 copies the values as they are. The SSE2
+// loop gives the same codes as the scalar one.
+template<class T>
+inline void encodeAs(const float *src, size_t count, float min, float scale, float levels, T *dst) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 vmin = _mm_set1_ps(min), vscale = _mm_set1_ps(scale);
+    const __m128 vround = _mm_set1_ps(levels > 0.0f ? 0.5f : 0.0f), vlevels = _mm_set1_ps(levels);
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(src + i), vmin), vscale), vround);
+        if (levels > 0.0f) v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), vlevels);   // NaN ends up 0
+        Store4(dst + i, v);
+    }
+#endif
+    for (; i < count; ++i) {
+        float v = (src[i] - min) * scale;
+        if (levels > 0.0f) {
+            v += 0.5f;
+            v = v > 0.0f ? (v < levels ? v : levels) : 0.0f;
+        }
+        dst[i] = encodeOne(v, dst);
+    }
+}
+
+inline void Encode(const float *src, size_t count, float min, float max, int type, void *dst) {
+    const float scale = max > min ? 1.0f / (max - min) : 0.0f;
+    switch (type) {
+    case FLOAT16:
+        encodeAs(src, count, min, scale, 0.0f, static_cast<half*>(dst));
+        break;
+    case UINT16:
+        encodeAs(src, count, min, scale * 65535.0f, 65535.0f, static_cast<unsigned short*>(dst));
+        break;
+    case UINT8:
+        encodeAs(src, count, min, scale * 255.0f, 255.0f, static_cast<unsigned char*>(dst));
+        break;
+    default:
+        memcpy(dst, src, count * sizeof(float));
+    }
+}
+
+} // namespace QuantizedVolume
+
+#endif // _QUANTIZEDVOLUME_H_
@@ -0,0 +1,198 @@
+//
+// C++ Interface: RangeKernels
+//
+// Description: Vectorized min/max, clamp and normalize passes over float
+// volumes, shared by the renderers and the feature tracker.
+//
+// The widest instruction set enabled at compile time is used (AVX, then
+// SSE, then plain loops). With C++11 threads available, the volume is split
+// into contiguous chunks that are processed in parallel.
+//
+
+#ifndef _RANGEKERNELS_H_
+#define _RANGEKERNELS_H_
+
+#include <stddef.h>
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#if __cplusplus >= 201103L && !defined(NO_CXX11_STL)
+#include <thread>
+#include <vector>
+#define RANGEKERNELS_THREADS
+#endif
+
+namespace RangeKernels {
+
+// Volumes smaller than this are not worth a thread per chunk
+const size_t MIN_CHUNK = 1 << 16;
+
+namespace detail {
+
+inline void minMaxChunk(const float *data, size_t count, float &min, float &max) {
+    size_t i = 0;
+    float lo = data[0], hi = data[0];
+#if defined(__AVX__)
+    if (count >= 8) {
+        __m256 vlo = _mm256_loadu_ps(data), vhi = vlo;
+        for (i = 8; i + 8 <= count; i += 8) {
+            __m256 v = _mm256_loadu_ps(data + i);
+            vlo = _mm256_min_ps(v, vlo);  // NaNs are skipped like in std::min
+            vhi = _mm256_max_ps(v, vhi);
+        }
+        float l[8], h[8];
+        _mm256_storeu_ps(l, vlo);
+        _mm256_storeu_ps(h, vhi);
+        lo = *std::min_element(l, l + 8);
+        hi = *std::max_element(h, h + 8);
+    }
+#elif defined(__SSE__)
+    if (count >= 4) {
+        __m128 vlo = _mm_loadu_ps(data), vhi = vlo;
+        for (i = 4; i + 4 <= count; i += 4) {
+            __m128 v = _mm_loadu_ps(data + i);
+            vlo = _mm_min_ps(v, vlo);     // NaNs are skipped like in std::min
+            vhi = _mm_max_ps(v, vhi);
+        }
+        float l[4], h[4];
+        _mm_storeu_ps(l, vlo);
+        _mm_storeu_ps(h, vhi);
+        lo = *std::min_element(l, l + 4);
+        hi = *std::max_element(h, h + 4);
+    }
+#endif
+    for (; i < count; ++i) {
+        lo = std::min(lo, data[i]);
+        hi = std::max(hi, data[i]);
+    }
+    min = lo;
+    max = hi;
+}
+
+// NaNs pass through unchanged, as with std::min/std::max
+inline void clampChunk(float *data, size_t count, float lo, float hi) {
+    size_t i = 0;
+#if defined(__AVX__)
+    const __m256 vlo = _mm256_set1_ps(lo), vhi = _mm256_set1_ps(hi);
+    for (; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_loadu_ps(data + i);
+        _mm256_storeu_ps(data + i, _mm256_min_ps(vhi, _mm256_max_ps(vlo, v)));
+    }
+#elif defined(__SSE__)
+    const __m128 vlo = _mm_set1_ps(lo), vhi = _mm_set1_ps(hi);
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_loadu_ps(data + i);
+        _mm_storeu_ps(data + i, _mm_min_ps(vhi, _mm_max_ps(vlo, v)));
+    }
+#endif
+    for (; i < count; ++i) {
+        data[i] = std::min(std::max(data[i], lo), hi);
+    }
+}
+
+// data[i] = (data[i] - offset) * scale
+inline void scaleChunk(float *data, size_t count, float offset, float scale) {
+    size_t i = 0;
+#if defined(__AVX__)
+    const __m256 voffset = _mm256_set1_ps(offset), vscale = _mm256_set1_ps(scale);
+    for (; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_loadu_ps(data + i);
+        _mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_sub_ps(v, voffset), vscale));
+    }
+#elif defined(__SSE__)
+    const __m128 voffset = _mm_set1_ps(offset), vscale = _mm_set1_ps(scale);
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_loadu_ps(data + i);
+        _mm_storeu_ps(data + i, _mm_mul_ps(_mm_sub_ps(v, voffset), vscale));
+    }
+#endif
+    for (; i < count; ++i) {
+        data[i] = (data[i] - offset) * scale;
+    }
+}
+
+// Runs func(chunkBegin, chunkEnd, chunkIndex) over numChunks pieces of
+// [0, count); returns the number of chunks actually used.
+template <class Func>
+inline int forChunks(size_t count, int numThreads, Func func) {
+    int numChunks = 1;
+#ifdef RANGEKERNELS_THREADS
+    numChunks = (int)std::max<size_t>(1, std::min<size_t>(numThreads, count / MIN_CHUNK));
+    if (numChunks > 1) {
+        std::vector<std::thread> threads;
+        for (int k = 0; k < numChunks; ++k) {
+            threads.push_back(std::thread(func, count * k / numChunks, count * (k+1) / numChunks, k));
+        }
+        for (size_t k = 0; k < threads.size(); ++k) {
+            threads[k].join();
+        }
+        return numChunks;
+    }
+#else
+    (void)numThreads;
+#endif
+    func((size_t)0, count, 0);
+    return numChunks;
+}
+
+struct MinMaxFunc {
+    const float *data;
+    float *mins;
+    float *maxs;
+    void operator()(size_t begin, size_t end, int k) const {
+        minMaxChunk(data + begin, end - begin, mins[k], maxs[k]);
+    }
+};
+
+struct ClampFunc {
+    float *data;
+    float lo, hi;
+    void operator()(size_t begin, size_t end, int) const {
+        clampChunk(data + begin, end - begin, lo, hi);
+    }
+};
+
+struct ScaleFunc {
+    float *data;
+    float offset, scale;
+    void operator()(size_t begin, size_t end, int) const {
+        scaleChunk(data + begin, end - begin, offset, scale);
+    }
+};
+
+} // namespace detail
+
+// Smallest and largest of count values. Leaves min and max untouched if count is 0.
+inline void MinMax(const float *data, size_t count, float &min, float &max, int numThreads = 1) {
+    if (count == 0) return;
+    const int maxChunks = 64;
+    float mins[maxChunks], maxs[maxChunks];
+    detail::MinMaxFunc func = { data, mins, maxs };
+    int numChunks = detail::forChunks(count, std::min(numThreads, maxChunks), func);
+    min = *std::min_element(mins, mins + numChunks);
+    max = *std::max_element(maxs, maxs + numChunks);
+}
+
+// Clamps every value into [lo, hi].
+inline void Clamp(float *data, size_t count, float lo, float hi, int numThreads = 1) {
+    if (count == 0) return;
+    detail::ClampFunc func = { data, lo, hi };
+    detail::forChunks(count, numThreads, func);
+}
+
+// Maps [min, max] to [0, 1] in place, multiplying by the reciprocal of the range.
+// A zero range maps everything to 0.
+inline void Normalize(float *data, size_t count, float min, float max, int numThreads = 1) {
+    if (count == 0) return;
+    detail::ScaleFunc func = { data, min, max > min ? 1.0f / (max - min) : 0.0f };
+    detail::forChunks(count, numThreads, func);
+}
+
+} // namespace RangeKernels
+
+#endif // _RANGEKERNELS_H_
@@ -2,6 +2,19 @@
 
 #define nullptr 0
 
+MSLib::GLTexture3D *newVolumeTexture(const Vector3i &dim, int precision, const GLvoid *data)
+{
+    GLint internalFormat = GL_R32F;
+    GLenum type = GL_FLOAT;
+    switch (precision)
+    {
+        case QuantizedVolume::FLOAT16: internalFormat = GL_R16F; type = GL_HALF_FLOAT;     break;
+        case QuantizedVolume::UINT16:  internalFormat = GL_R16;  type = GL_UNSIGNED_SHORT; break;
+        case QuantizedVolume::UINT8:   internalFormat = GL_R8;   type = GL_UNSIGNED_BYTE;  break;
+    }
+    return new MSLib::GLTexture3D(internalFormat, dim.x, dim.y, dim.z, 0, GL_RED, type, data);
+}
+
 RayCastingRenderer::RayCastingRenderer(QRenderWindow &renderWindow,
                                        QTFEditor &tfEditor,
                                        ParameterSet &ps,
@@ -71,16 +84,8 @@ void RayCastingRenderer::initShader()
 
 void RayCastingRenderer::initTextures()
 {
-    _dataTex = new MSLib::GLTexture3D(//GL_LUMINANCE32F_ARB,
-                                      GL_R32F,
-                                      _model->dim().x,
-                                      _model->dim().y,
-                                      _model->dim().z,
-                                      0,
-                                      //GL_LUMINANCE,
-                                      GL_RED,
-                                      GL_FLOAT,
-                                      _model->data(timeStep(), varIndex()));
+    _dataTex = newVolumeTexture(_model->dim(), _model->precision(timeStep(), varIndex()),
+                                _model->data(timeStep(), varIndex()));
 
     _tfTex = new MSLib::GLTexture1D(GL_RGBA32F,
                                     _tfEditor->getTFColorMapResolution(),
@@ -133,7 +138,7 @@ void RayCastingRenderer::updateTF()
 
 void RayCastingRenderer::updateData()
 {
-    float *data = _model->data(timeStep(), varIndex());
+    void *data = _model->data(timeStep(), varIndex());
     _dataTex->load(data);
 }
 
@@ -12,6 +12,10 @@
 ////
 #include "VolumeModel.h"
 
+// 3D texture of a volume kept as precision (QuantizedVolume::Type), the
+// shaders sample normalized floats from any of them
+MSLib::GLTexture3D *newVolumeTexture(const Vector3i &dim, int precision, const GLvoid *data);
+
 class RayCastingRenderer
 {
 public:
@@ -21,14 +21,7 @@ SegmentedVolumeRenderer::SegmentedVolumeRenderer(QRenderWindow &renderWindow,
     /*for (int i = 0; i < _model->blockCount(); i++)
     {
         RegularGridDataBlock &dataBlock = _model->volumeDataBlock(i, timeStep(), varIndex());
-        _dataBlockTex.append(new MSLib::GLTexture3D(GL_R32F,
-                                                    dataBlock.dim().x,
-                                                    dataBlock.dim().y,
-                                                    dataBlock.dim().z,
-                                                    0,
-                                                    GL_RED,
-                                                    GL_FLOAT,
-                                                    dataBlock.data()));
+        _dataBlockTex.append(newVolumeTexture(dataBlock.dim(), dataBlock.precision(), dataBlock.data()));
         Vector3i lo = dataBlock.lo();
         Vector3i hi = dataBlock.hi();
         qDebug("Block[%d]: lo(%d, %d, %d), hi(%d, %d, %d)", i, lo.x, lo.y, lo.z, hi.x, hi.y, hi.z);
@@ -78,14 +71,7 @@ void SegmentedVolumeRenderer::initDataTexture()
     {
         _model->loadData(timeStep(), varIndex());
         RegularGridDataBlock &dataBlock = _model->volumeDataBlock(i, timeStep(), varIndex());
-        _dataBlockTex.append(new MSLib::GLTexture3D(GL_R32F,
-                                                    dataBlock.dim().x,
-                                                    dataBlock.dim().y,
-                                                    dataBlock.dim().z,
-                                                    0,
-                                                    GL_RED,
-                                                    GL_FLOAT,
-                                                    dataBlock.data()));
+        _dataBlockTex.append(newVolumeTexture(dataBlock.dim(), dataBlock.precision(), dataBlock.data()));
 
         Vector3i lo = dataBlock.lo();
         Vector3i hi = dataBlock.hi();
@@ -111,7 +97,7 @@ void SegmentedVolumeRenderer::updateData()
     {
         qDebug("load subblock %d", i);
         _model->loadData(timeStep(), varIndex());
-        float *dataBlock = _model->volumeDataBlock(i, timeStep(), varIndex()).data();
+        void *dataBlock = _model->volumeDataBlock(i, timeStep(), varIndex()).data();
         _dataBlockTex[i]->load(dataBlock);
     }
 }
@@ -1,16 +1,23 @@
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <QThread>
+#include "RangeKernels.h"     // before VolumeData.h, whose nullptr macro breaks <thread>
+#include "BrickedVolume.h"
 #include "VolumeData.h"
 
 #define nullptr 0
 
-RegularGridData::RegularGridData() : _data(nullptr), _dataSize(0) { }
+RegularGridData::RegularGridData() : _data(nullptr), _dataSize(0), _precision(QuantizedVolume::FLOAT32) { }
 RegularGridData::~RegularGridData() { unload(); }
 
 bool RegularGridData::load(const VolumeMetadata &metadata) {
     unload();
 
+    if (BrickedVolume::IsBricked(metadata.fileName())) {
+        return loadBricked(metadata);
+    }
+
     size_t offset = (size_t)metadata.offset();
     _dim = metadata.dim();
 
@@ -84,66 +91,118 @@ bool RegularGridData::load(const VolumeMetadata &metadata) {
         }
     }
 
-    _dataSize = volumeSize * sizeof(float);
-    _data = new float[volumeSize];
+    float *values = new float[volumeSize];
 
-    if (_data == nullptr) {
+    if (values == nullptr) {
         return false;
     }
 
     switch (metadata.type()) {
         case VolumeMetadata::UNSIGNED_8BIT:
             for (size_t i = 0; i < volumeSize; i++)
-                _data[i] = (float)((unsigned char *)rawData)[i];
+                values[i] = (float)((unsigned char *)rawData)[i];
             break;
         case VolumeMetadata::SIGNED_8BIT:
             for (size_t i = 0; i < volumeSize; i++)
-                _data[i] = (float)((char *)rawData)[i];
+                values[i] = (float)((char *)rawData)[i];
             break;
         case VolumeMetadata::UNSIGNED_16BIT:
             for (size_t i = 0; i < volumeSize; i++)
-                _data[i] = (float)((unsigned short *)rawData)[i];
+                values[i] = (float)((unsigned short *)rawData)[i];
             break;
         case VolumeMetadata::SIGNED_16BIT:
             for (size_t i = 0; i < volumeSize; i++)
-                _data[i] = (float)((short *)rawData)[i];
+                values[i] = (float)((short *)rawData)[i];
             break;
         case VolumeMetadata::UNSIGNED_32BIT:
             for (size_t i = 0; i < volumeSize; i++)
-                _data[i] = (float)((unsigned int *)rawData)[i];
+                values[i] = (float)((unsigned int *)rawData)[i];
             break;
         case VolumeMetadata::SIGNED_32BIT:
             for (size_t i = 0; i < volumeSize; i++)
-                _data[i] = (float)((int *)rawData)[i];
+                values[i] = (float)((int *)rawData)[i];
             break;
         case VolumeMetadata::FLOAT:
-            memcpy((void *)_data, (void *)rawData, _dataSize);
+            memcpy((void *)values, (void *)rawData, volumeSize * sizeof(float));
             break;
         case VolumeMetadata::DOUBLE:
             for (size_t i = 0; i < volumeSize; i++)
-                _data[i] = (float)((double *)rawData)[i];
+                values[i] = (float)((double *)rawData)[i];
             break;
         default:    // unknown
+            delete [] values;
             return false;
     }
 
-    Vector2f range = metadata.rangeDefined() ? (Vector2f)metadata.range() : getRange();
+    Vector2f range = metadata.rangeDefined() ? (Vector2f)metadata.range() : getRange(values);
 
-    remapping(range.x, range.y);
+    keep(values, range.x, range.y, metadata.precision());
 
     delete [] rawData;
 
     return true;
 }
 
+// Dimensions, type and byte order come from the file itself
+bool RegularGridData::loadBricked(const VolumeMetadata &metadata) {
+    BrickedVolume::Reader reader;
+    if (!reader.Open(metadata.fileName())) {
+        return false;
+    }
+
+    _dim = Vector3i(reader.dim().x, reader.dim().y, reader.dim().z);
+    size_t volumeSize = reader.dim().Volume();
+    float *values = new float[volumeSize];
+    if (!reader.ReadAll(values)) {
+        delete [] values;
+        return false;
+    }
+
+    // the header holds the range, no pass over the data to find it
+    Vector2f range = metadata.rangeDefined() ? (Vector2f)metadata.range() : Vector2f(reader.min(), reader.max());
+
+    keep(values, range.x, range.y, metadata.precision());
+
+    return true;
+}
+
 bool compare(const std::pair<float, int> &lhs, const std::pair<float, int> &rhs) {
     return lhs.second > rhs.second;  // descending order
 }
 
-void RegularGridData::remapping(float min, float max) {
-    if (!isLoaded()) {
+// The remapped values are multiples of 1/1024: half holds them exactly,
+// uint16 to within 2^-17. Float values are kept as they are, others are
+// encoded and freed.
+void RegularGridData::keep(float *values, float min, float max, int precision) {
+    size_t elemCount = (size_t)_dim.x * _dim.y * _dim.z;
+    remapping(values, min, max);
+
+    _precision = precision;
+    _dataSize = elemCount * elementSize();
+    if (precision == QuantizedVolume::FLOAT32) {
+        _data = values;
         return;
     }
+    _data = new unsigned char[_dataSize];
+    QuantizedVolume::Encode(values, elemCount, 0.0f, 1.0f, precision, _data);
+    delete [] values;
+}
+
+float RegularGridData::value(size_t i) const {
+    using QuantizedVolume::Decode;
+    switch (_precision) {
+        case QuantizedVolume::FLOAT16:
+            return Decode(static_cast<const QuantizedVolume::half *>(_data), i);
+        case QuantizedVolume::UINT16:
+            return Decode(static_cast<const unsigned short *>(_data), i) * QuantizedVolume::Scale(_precision);
+        case QuantizedVolume::UINT8:
+            return Decode(static_cast<const unsigned char *>(_data), i) * QuantizedVolume::Scale(_precision);
+        default:
+            return Decode(static_cast<const float *>(_data), i);
+    }
+}
+
+void RegularGridData::remapping(float *values, float min, float max) const {
 
     typedef std::map<float, int> HistMap;
     typedef std::pair<float, int> HistPair;
@@ -154,13 +213,12 @@ void RegularGridData::remapping(float min, float max) {
     int granularity = 20;
     int binLength = histLength * granularity;
 
-    float range = max - min;
     int elemCount = _dim.x * _dim.y * _dim.z;
+    normalize(values, min, max);
+
     int binIndex = 0;
     for (int i = 0; i < elemCount; i++) {
-        _data[i] = (_data[i] - min) / range;  // normalize to [0,1]
-
-        binIndex = (int)(_data[i] * binLength);
+        binIndex = (int)(values[i] * binLength);
         if (histMap.find(binIndex) != histMap.end()) {
             histMap[binIndex]++;
         } else {
@@ -177,37 +235,32 @@ void RegularGridData::remapping(float min, float max) {
     }
 
     for (int i = 0; i < elemCount; i++) {
-        binIndex = (int)(_data[i] * binLength);
-        _data[i] = (float)histMap[binIndex] / histLength;
+        binIndex = (int)(values[i] * binLength);
+        values[i] = (float)histMap[binIndex] / histLength;
     }
 }
 
-void RegularGridData::normalize(float min, float max) {
-    if (!isLoaded() || min == max) { return; }
-    float invRange = 1.0f / (max - min);
+void RegularGridData::normalize(float *values, float min, float max) const {
+    if (min == max) { return; }
     size_t elemCount = _dim.x * _dim.y * _dim.z;
-    for (size_t i = 0; i < elemCount; i++) {
-        _data[i] = (_data[i] - min) * invRange;
-    }
+    RangeKernels::Normalize(values, elemCount, min, max, QThread::idealThreadCount());
 }
 
-Vector2f RegularGridData::getRange() const {
-    if (!isLoaded()) {
-        return Vector2f();
-    }
-    float min = _data[0];
-    float max = _data[0];
+Vector2f RegularGridData::getRange(const float *values) const {
+    float min = values[0];
+    float max = values[0];
     size_t elemCount = _dim.x * _dim.y * _dim.z;
-    for (size_t i = 0; i < elemCount; i++) {
-        min = std::min(min, _data[i]);
-        max = std::max(max, _data[i]);
-    }
+    RangeKernels::MinMax(values, elemCount, min, max, QThread::idealThreadCount());
     return Vector2f(min, max);
 }
 
 void RegularGridData::unload() {
     if (isLoaded()) {
-        delete [] _data;
+        if (_precision == QuantizedVolume::FLOAT32) {
+            delete [] static_cast<float *>(_data);
+        } else {
+            delete [] static_cast<unsigned char *>(_data);
+        }
         _data = nullptr;
         _dataSize = 0;
     }
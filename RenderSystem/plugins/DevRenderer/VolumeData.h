@@ -2,6 +2,7 @@
 #define VOLUMEDATA_H
 
 #include "VolumeMetadata.h"
+#include "QuantizedVolume.h"
 
 #define nullptr 0
 
@@ -12,25 +13,35 @@ public:
     virtual ~MSVolumeData() {}
 };
 
+// Normalized to [0, 1] when loaded and kept as the metadata's precision,
+// 32-bit floats or the compact QuantizedVolume codes
 class RegularGridData : public MSVolumeData {
 public:
     RegularGridData();
     virtual ~RegularGridData();
 
-    float *data() { return _data; }
+    void *data() { return _data; }
     size_t dataSize() const { return _dataSize; }
+    int precision() const { return _precision; }    // QuantizedVolume::Type of data()
+    size_t elementSize() const { return QuantizedVolume::ElementSize(_precision); }
+    float value(size_t i) const;                    // normalized value of voxel i
     const Vector3i &dimensions() const { return _dim; }
     const Vector3i &dim() const { return _dim; }            // alias of dimensions()
-    bool load(const VolumeMetadata &metadata);
+    bool load(const VolumeMetadata &metadata);    // raw layout of the metadata, or a bricked volume
     void unload();
     bool isLoaded() const { return (_data != nullptr); }
-    void remapping(float min, float max);
-    void normalize(float min, float max);
-    Vector2f getRange() const;  // x: min, y: max
 
 protected:
-    float *_data;
+    bool loadBricked(const VolumeMetadata &metadata);
+    // Takes the values read, remaps them with [min, max] and keeps them as precision
+    void keep(float *values, float min, float max, int precision);
+    void remapping(float *values, float min, float max) const;
+    void normalize(float *values, float min, float max) const;
+    Vector2f getRange(const float *values) const;  // x: min, y: max
+
+    void *_data;
     size_t _dataSize;           // data size in bytes
+    int _precision;
     Vector3i _dim;
 };
 
@@ -17,21 +17,23 @@ bool RegularGridDataBlock::load() {
     if (!_volumeData->isLoaded())
         return false;
 
+    // rows are copied as bytes of the whole volume's precision
     Vector3i bdim = dim();
+    size_t elemSize = _volumeData->elementSize();
     size_t elemCount = (size_t)(bdim.x * bdim.y * bdim.z);
-    _dataSize = elemCount * sizeof(float);
-    _data = new float[elemCount];
+    _dataSize = elemCount * elemSize;
+    _data = new unsigned char[_dataSize];
     if (_data == nullptr) {
         return false;
     }
 
-    float *wdata = wholeData();
+    const unsigned char *wdata = static_cast<const unsigned char *>(wholeData());
     const Vector3i &wdim = wholeDim();
     Vector3i blo = lo();
     Vector3i bhi = hi();
     for (int z = 0, zz = blo.z; zz <= bhi.z; z++, zz++)
         for (int y = 0, yy = blo.y; yy <= bhi.y; y++, yy++)
-            memcpy(&_data[(z * bdim.y + y) * bdim.x], &wdata[(zz * wdim.y + yy) * wdim.x + blo.x], sizeof(float) * bdim.x);
+            memcpy(&_data[((z * bdim.y + y) * bdim.x) * elemSize], &wdata[((zz * wdim.y + yy) * wdim.x + blo.x) * elemSize], elemSize * bdim.x);
 
     return true;
 }
@@ -9,10 +9,11 @@ class RegularGridDataBlock : public MSVolumeData {
 public:
     RegularGridDataBlock(RegularGridData *volumeData, const Vector3i &lo, const Vector3i &hi, const Vector3f &boxLo, const Vector3f &boxHi);
 
-    float *data() { return _data; }
+    void *data() { return _data; }                  // elements of precision()
     size_t dataSize() const { return _dataSize; }
+    int precision() const { return _volumeData->precision(); }
     RegularGridData *wholeVolumeData() { return _volumeData; }
-    float *wholeData() { return _volumeData->data(); }
+    void *wholeData() { return _volumeData->data(); }
     const Vector3i &wholeDim() const { return _volumeData->dim(); }
     const Vector3i &lo() const { return _lo; }
     const Vector3i &hi() const { return _hi; }
@@ -32,7 +33,7 @@ protected:
     static float max(const Vector3i &v);
 
 protected:
-    float *_data;
+    unsigned char *_data;
     size_t _dataSize;
     RegularGridData *_volumeData;
     Vector3i _lo;           // lo and hi defines the padded subblock
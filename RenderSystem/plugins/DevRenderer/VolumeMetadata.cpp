@@ -3,15 +3,17 @@
 #include <sstream>
 
 #include "VolumeMetadata.h"
+#include "QuantizedVolume.h"
 
-VolumeMetadata::VolumeMetadata() : _offset(0), _rangeDefined(false) { }
+VolumeMetadata::VolumeMetadata() : _offset(0), _rangeDefined(false), _precision(QuantizedVolume::FLOAT32) { }
 
 VolumeMetadata::VolumeMetadata(ByteOrder byteOrder, Type type, const Vector3i &dim)
     : _offset(0),
       _byteOrder(byteOrder),
       _type(type),
       _dim(dim),
-      _rangeDefined(false) {
+      _rangeDefined(false),
+      _precision(QuantizedVolume::FLOAT32) {
 }
 
 void VolumeMetadata::read(const Json::Value &val, const Json::Value &globalVal) {
@@ -35,6 +37,18 @@ void VolumeMetadata::read(const Json::Value &val, const Json::Value &globalVal)
     else if (type == "DOUBLE")         _type = DOUBLE;
     else                               _type = UNKNOWN_TYPE;
 
+    // "float", "half", "uint16" or "uint8", the volume is normalized either way
+    _precision = QuantizedVolume::FLOAT32;
+    if ((val.isObject() && val.contains("precision")) || globalVal.contains("precision")) {
+        const String &precision = (val.isObject() && val.contains("precision")) ?
+                                      val["precision"].toString() : globalVal["precision"].toString();
+        _precision = QuantizedVolume::ParseType(precision);
+        if (_precision < 0) {
+            std::cout << "unknown precision " << precision << ", using float" << std::endl;
+            _precision = QuantizedVolume::FLOAT32;
+        }
+    }
+
     if (val.isObject() && val.contains("dim")) {
         _dim.x = val["dim"][0].toInt();
         _dim.y = val["dim"][1].toInt();
@@ -76,6 +90,7 @@ void VolumeMetadata::write(Json::Value &val) const {
         case DOUBLE:         type = "DOUBLE";         break;
     }
     val["type"] = type;
+    val["precision"] = String(QuantizedVolume::TypeName(_precision));
     val["dim"].append(_dim.x);
     val["dim"].append(_dim.y);
     val["dim"].append(_dim.z);
@@ -33,6 +33,7 @@ public:
     double          min()          const { return _range.x; }
     double          max()          const { return _range.y; }
     bool            rangeDefined() const { return _rangeDefined; }
+    int             precision()    const { return _precision; }     // QuantizedVolume::Type kept in memory
 
     void setFileName(const String &fileName) { _fileName = fileName; }
     void setRange(double min, double max)    { _range = Vector2d(min, max); }
@@ -51,6 +52,7 @@ protected:
     //double    _min, _max;
     Vector2d  _range;
     bool      _rangeDefined;
+    int       _precision;
 };
 
 //
@@ -72,7 +72,7 @@ RegularGridData &VolumeModel::volumeData(int timeStep, int varIndex) {
     return *_pvolumes[timeStep][varIndex];
 }
 
-float *VolumeModel::data(int timeStep, int varIndex) {
+void *VolumeModel::data(int timeStep, int varIndex) {
     return volumeData(timeStep, varIndex).data();
 }
 
@@ -119,6 +119,6 @@ RegularGridDataBlock &VolumeModel::volumeDataBlock(int blockIndex, int timeStep,
     return _pvolumes[timeStep][varIndex]->volumeDataBlock(blockIndex);
 }
 
-float *VolumeModel::dataBlock(int blockIndex, int timeStep, int varIndex) {
+void *VolumeModel::dataBlock(int blockIndex, int timeStep, int varIndex) {
     return _pvolumes[timeStep][varIndex]->volumeDataBlock(blockIndex).data();
 }
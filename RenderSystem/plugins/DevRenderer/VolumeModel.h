@@ -22,16 +22,17 @@ public:
     Vector3f        scaledDim(int timeStep = 0, int varIndex = 0) const;
     double          max(int timeStep = 0, int varIndex = 0) const { return _volumeMetadata.getVolumeMetadata(timeStep, varIndex).max(); }
     double          min(int timeStep = 0, int varIndex = 0) const { return _volumeMetadata.getVolumeMetadata(timeStep, varIndex).min(); }
+    int             precision(int timeStep = 0, int varIndex = 0) const { return _volumeMetadata.getVolumeMetadata(timeStep, varIndex).precision(); }
 
     RegularGridData &volumeData(int timeStep = 0, int varIndex = 0);
-    float *data(int timeStep = 0, int varIndex = 0);
+    void *data(int timeStep = 0, int varIndex = 0);     // elements of precision()
 
     void initSubblocks(const Vector3i &gridDim, int padding = 4);
     int blockCount(int timeStep = 0, int varIndex = 0) const { return _pvolumes[timeStep][varIndex]->blockCount(); } //{ return (int)_blocks[timeStep][varIndex].size(); }
 
     void loadData(int timeStep = 0, int varIndex = 0);
     RegularGridDataBlock &volumeDataBlock(int blockIndex, int timeStep = 0, int varIndex = 0);
-    float *dataBlock(int blockIndex, int timeStep = 0, int varIndex = 0);
+    void *dataBlock(int blockIndex, int timeStep = 0, int varIndex = 0);
 
 protected:
     void _setTimeStamp(PRegularGridData *volume, int timeStamp);
@@ -94,10 +94,10 @@ void VolumeRenderWindow::initializeGL() {
 
     qDebug("Init histogram...");
     _mainUI->getTFEditor()->getHistogram()->clear();
-    float *rawData = _model->data();
+    const RegularGridData &volume = _model->volumeData();
     size_t dataSize = dim.x * dim.y * dim.z;
     for (size_t i = 0; i < dataSize; i++) {
-        _mainUI->getTFEditor()->incrementHistogram(rawData[i]);
+        _mainUI->getTFEditor()->incrementHistogram(volume.value(i));
     }
     m_histogram = new Histogram(256);
     *m_histogram = *(_mainUI->getTFEditor()->getHistogram());
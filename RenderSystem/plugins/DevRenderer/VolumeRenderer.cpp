@@ -48,14 +48,8 @@ VolumeRenderer::VolumeRenderer(QRenderWindow &renderWindow,
 }
 
 void VolumeRenderer::initDataTexture() {
-    _dataTex = new MSLib::GLTexture3D(GL_R32F,
-                                      _model->dim().x,
-                                      _model->dim().y,
-                                      _model->dim().z,
-                                      0,
-                                      GL_RED,
-                                      GL_FLOAT,
-                                      _model->data(timeStep(), varIndex()));
+    _dataTex = newVolumeTexture(_model->dim(), _model->precision(timeStep(), varIndex()),
+                                _model->data(timeStep(), varIndex()));
 }
 
 void VolumeRenderer::initTFTexture() {
@@ -85,7 +79,7 @@ void VolumeRenderer::initShaders(const String &workingPath) {
 }
 
 void VolumeRenderer::updateData() {
-    float *data = _model->data(timeStep(), varIndex());
+    void *data = _model->data(timeStep(), varIndex());
     _dataTex->load(data);
 }
 
@@ -122,6 +122,7 @@ GLTexture3D::GLTexture3D(GLint internalFormat, GLsizei width, GLsizei height, GL
     glTexParameteri(_target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(_target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(_target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);  // volume rows of 8 or 16-bit voxels are tightly packed
     glTexImage3D(_target, 0 /* mipmap level */, _internalFormat, _width, _height, _depth, _border, _format, _type, data);
     glBindTexture(_target, 0);
 }
@@ -129,6 +130,7 @@ GLTexture3D::GLTexture3D(GLint internalFormat, GLsizei width, GLsizei height, GL
 void GLTexture3D::load(const GLvoid *data)
 {
     bind();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     glTexSubImage3D(_target, 0 /* mipmap level */, 0 /* x offset */, 0 /* y offset */, 0 /* z offset */, _width, _height, _depth, _format, _type, data);
     release();
 }